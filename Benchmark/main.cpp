@@ -0,0 +1,471 @@
+/**
+ * 文法エンジンとスケッチマッチングのベンチマーク。
+ * GUIとOpenGLを使わずに、ルールの読み込み、derivation、式の評価、shape featureの読み込み、
+ * スケッチのマッチングの時間を測り、結果をJSONで出力する。
+ *
+ * 使い方:
+ *   Benchmark [--iterations N] [--cga-dir DIR] [--features FILE] [--sketch FILE] [--output FILE]
+ *
+ * --outputを指定しない場合は、標準出力にJSONを出力する。
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <QElapsedTimer>
+#include <QDir>
+#include <QFileInfo>
+#include "CGA.h"
+#include "Rectangle.h"
+#include "RuleParser.h"
+#include "ShapeFeature.h"
+#include "ShapeFeatureLoader.h"
+
+/**
+ * 1つのベンチマークの計測結果。
+ * countは、1回の計測で処理した量 (生成したshapeの数など) で、回帰を調べる時の目安にする。
+ */
+class BenchmarkResult {
+public:
+	std::string name;
+	std::vector<double> samples;	// [ms]
+	int count;
+
+public:
+	BenchmarkResult(const std::string& name) : name(name), count(0) {}
+
+	double mean() const {
+		double total = 0.0;
+		for (int i = 0; i < samples.size(); ++i) total += samples[i];
+		return samples.empty() ? 0.0 : total / samples.size();
+	}
+
+	double median() const {
+		if (samples.empty()) return 0.0;
+		std::vector<double> sorted = samples;
+		std::sort(sorted.begin(), sorted.end());
+		int n = sorted.size();
+		return n % 2 == 1 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) * 0.5;
+	}
+
+	double stddev() const {
+		if (samples.size() < 2) return 0.0;
+		double m = mean();
+		double total = 0.0;
+		for (int i = 0; i < samples.size(); ++i) total += (samples[i] - m) * (samples[i] - m);
+		return sqrt(total / (samples.size() - 1));
+	}
+
+	double minimum() const {
+		return samples.empty() ? 0.0 : *std::min_element(samples.begin(), samples.end());
+	}
+
+	double maximum() const {
+		return samples.empty() ? 0.0 : *std::max_element(samples.begin(), samples.end());
+	}
+};
+
+/**
+ * 関数をiterations回実行し、1回毎の時間を計測する。
+ * 最初に1回だけ、計測しない実行をしてキャッシュなどを温めておく。
+ * 関数は、処理した量を返す。
+ */
+template<typename Func>
+BenchmarkResult measure(const std::string& name, int iterations, Func func) {
+	std::cerr << name << "..." << std::endl;
+
+	BenchmarkResult result(name);
+	result.count = func();
+
+	QElapsedTimer timer;
+	for (int i = 0; i < iterations; ++i) {
+		timer.start();
+		func();
+		result.samples.push_back(timer.nsecsElapsed() * 1.0e-6);
+	}
+
+	return result;
+}
+
+/**
+ * 深いfacadeの文法を生成する。
+ * Lot -> Building -> Facade -> Floor -> Tile -> Detail0 -> ... -> Detail(depth-1) の順に分割する。
+ *
+ * @param filename		ファイル名
+ * @param depth			Tileの下の分割の深さ
+ */
+void writeFacadeGrammar(const std::string& filename, int depth) {
+	std::ofstream out(filename.c_str());
+	out << "<?xml version=\"1.0\"?>" << std::endl;
+	out << "<rules version=\"2015.9\" author=\"benchmark\">" << std::endl;
+	out << "\t<attr name=\"bldg_height\" value=\"60\"/>" << std::endl;
+	out << "\t<attr name=\"floor_height\" value=\"3.5\"/>" << std::endl;
+	out << "\t<attr name=\"tile_width\" value=\"3\"/>" << std::endl;
+	out << "\t<attr name=\"wall_ratio\" value=\"0.2\"/>" << std::endl;
+	out << "\t<attr name=\"frame_ratio\" value=\"0.1\"/>" << std::endl;
+
+	out << "\t<rule name=\"Lot\">" << std::endl;
+	out << "\t\t<extrude height=\"bldg_height\"/>" << std::endl;
+	out << "\t\t<copy name=\"Building\"/>" << std::endl;
+	out << "\t</rule>" << std::endl;
+
+	out << "\t<rule name=\"Building\">" << std::endl;
+	out << "\t\t<comp>" << std::endl;
+	out << "\t\t\t<param name=\"front\" value=\"Facade\"/>" << std::endl;
+	out << "\t\t\t<param name=\"side\" value=\"Facade\"/>" << std::endl;
+	out << "\t\t\t<param name=\"top\" value=\"Roof.\"/>" << std::endl;
+	out << "\t\t</comp>" << std::endl;
+	out << "\t</rule>" << std::endl;
+
+	out << "\t<rule name=\"Facade\">" << std::endl;
+	out << "\t\t<split splitAxis=\"y\">" << std::endl;
+	out << "\t\t\t<param type=\"absolute\" value=\"floor_height\" repeat=\"true\" name=\"Floor\"/>" << std::endl;
+	out << "\t\t</split>" << std::endl;
+	out << "\t</rule>" << std::endl;
+
+	out << "\t<rule name=\"Floor\">" << std::endl;
+	out << "\t\t<split splitAxis=\"x\">" << std::endl;
+	out << "\t\t\t<param type=\"absolute\" value=\"tile_width\" repeat=\"true\" name=\"Tile\"/>" << std::endl;
+	out << "\t\t</split>" << std::endl;
+	out << "\t</rule>" << std::endl;
+
+	out << "\t<rule name=\"Tile\">" << std::endl;
+	out << "\t\t<split splitAxis=\"x\">" << std::endl;
+	out << "\t\t\t<param type=\"floating\" value=\"wall_ratio\" name=\"Wall.\"/>" << std::endl;
+	out << "\t\t\t<param type=\"floating\" value=\"1\" name=\"Detail0\"/>" << std::endl;
+	out << "\t\t\t<param type=\"floating\" value=\"wall_ratio\" name=\"Wall.\"/>" << std::endl;
+	out << "\t\t</split>" << std::endl;
+	out << "\t</rule>" << std::endl;
+
+	// 窓枠のように、x方向とy方向に交互に入れ子で分割する
+	for (int i = 0; i < depth; ++i) {
+		std::stringstream next;
+		if (i + 1 < depth) {
+			next << "Detail" << (i + 1);
+		} else {
+			next << "Glass.";
+		}
+
+		out << "\t<rule name=\"Detail" << i << "\">" << std::endl;
+		out << "\t\t<split splitAxis=\"" << (i % 2 == 0 ? "y" : "x") << "\">" << std::endl;
+		out << "\t\t\t<param type=\"floating\" value=\"frame_ratio\" name=\"Frame.\"/>" << std::endl;
+		out << "\t\t\t<param type=\"floating\" value=\"1-frame_ratio\" name=\"" << next.str() << "\"/>" << std::endl;
+		out << "\t\t\t<param type=\"floating\" value=\"frame_ratio\" name=\"Frame.\"/>" << std::endl;
+		out << "\t\t</split>" << std::endl;
+		out << "\t</rule>" << std::endl;
+	}
+
+	out << "</rules>" << std::endl;
+}
+
+/**
+ * パーサの速度を測るための、大きな文法ライブラリを生成する。
+ * extrude, comp, splitを順番に使う、num_rules個のルールを連鎖させる。
+ *
+ * @param filename		ファイル名
+ * @param num_rules		ルールの数
+ */
+void writeLibraryGrammar(const std::string& filename, int num_rules) {
+	std::ofstream out(filename.c_str());
+	out << "<?xml version=\"1.0\"?>" << std::endl;
+	out << "<rules version=\"2015.9\" author=\"benchmark\">" << std::endl;
+	for (int i = 0; i < 100; ++i) {
+		out << "\t<attr name=\"param" << i << "\" value=\"" << (i % 10 + 1) << "\"/>" << std::endl;
+	}
+
+	for (int i = 0; i < num_rules; ++i) {
+		out << "\t<rule name=\"R" << i << "\">" << std::endl;
+		switch (i % 4) {
+		case 0:
+			out << "\t\t<extrude height=\"param" << (i % 100) << "\"/>" << std::endl;
+			out << "\t\t<copy name=\"R" << (i + 1) << "\"/>" << std::endl;
+			break;
+		case 1:
+			out << "\t\t<comp>" << std::endl;
+			out << "\t\t\t<param name=\"front\" value=\"R" << (i + 1) << "\"/>" << std::endl;
+			out << "\t\t\t<param name=\"side\" value=\"R" << (i + 1) << "\"/>" << std::endl;
+			out << "\t\t\t<param name=\"top\" value=\"Roof.\"/>" << std::endl;
+			out << "\t\t</comp>" << std::endl;
+			break;
+		case 2:
+			out << "\t\t<split splitAxis=\"y\">" << std::endl;
+			out << "\t\t\t<param type=\"absolute\" value=\"param" << (i % 100) << "\" repeat=\"true\" name=\"R" << (i + 1) << "\"/>" << std::endl;
+			out << "\t\t</split>" << std::endl;
+			break;
+		default:
+			out << "\t\t<split splitAxis=\"x\">" << std::endl;
+			out << "\t\t\t<param type=\"floating\" value=\"0.2\" name=\"Wall.\"/>" << std::endl;
+			out << "\t\t\t<param type=\"relative\" value=\"0.6\" name=\"R" << (i + 1) << "\"/>" << std::endl;
+			out << "\t\t\t<param type=\"floating\" value=\"0.2\" name=\"Wall.\"/>" << std::endl;
+			out << "\t\t</split>" << std::endl;
+			break;
+		}
+		out << "\t</rule>" << std::endl;
+	}
+
+	out << "</rules>" << std::endl;
+}
+
+/**
+ * GLWidget3Dと同じ、初期のLotを作成する。
+ */
+boost::shared_ptr<cga::Shape> createAxiom() {
+	return boost::shared_ptr<cga::Shape>(new cga::Rectangle("Lot", glm::translate(glm::rotate(glm::mat4(), (float)(-cga::M_PI * 0.5f), glm::vec3(1, 0, 0)), glm::vec3(-17.5, -12.5, 0)), glm::mat4(), 35, 25, glm::vec3(1, 1, 1)));
+}
+
+/**
+ * 手書きのスケッチの代わりに、建物の輪郭のような線画を作成する。
+ */
+cv::Mat createSyntheticSketch() {
+	cv::Mat sketch(600, 800, CV_8U, cv::Scalar(255));
+	cv::rectangle(sketch, cv::Point(250, 150), cv::Point(550, 500), cv::Scalar(0), 2);
+	cv::line(sketch, cv::Point(250, 150), cv::Point(330, 100), cv::Scalar(0), 2);
+	cv::line(sketch, cv::Point(550, 150), cv::Point(630, 100), cv::Scalar(0), 2);
+	cv::line(sketch, cv::Point(330, 100), cv::Point(630, 100), cv::Scalar(0), 2);
+	cv::line(sketch, cv::Point(550, 500), cv::Point(630, 450), cv::Scalar(0), 2);
+	cv::line(sketch, cv::Point(630, 100), cv::Point(630, 450), cv::Scalar(0), 2);
+	return sketch;
+}
+
+void writeJSON(std::ostream& out, const std::vector<BenchmarkResult>& results, int iterations) {
+	out << std::fixed << std::setprecision(4);
+	out << "{" << std::endl;
+#ifdef NDEBUG
+	out << "  \"build\": \"release\"," << std::endl;
+#else
+	out << "  \"build\": \"debug\"," << std::endl;
+#endif
+	out << "  \"iterations\": " << iterations << "," << std::endl;
+	out << "  \"benchmarks\": [" << std::endl;
+	for (int i = 0; i < results.size(); ++i) {
+		const BenchmarkResult& r = results[i];
+		out << "    {\"name\": \"" << r.name << "\", \"count\": " << r.count;
+		out << ", \"mean_ms\": " << r.mean() << ", \"median_ms\": " << r.median() << ", \"stddev_ms\": " << r.stddev();
+		out << ", \"min_ms\": " << r.minimum() << ", \"max_ms\": " << r.maximum() << "}";
+		if (i + 1 < results.size()) out << ",";
+		out << std::endl;
+	}
+	out << "  ]" << std::endl;
+	out << "}" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	int iterations = 20;
+	std::string cga_dir = "../cga";
+	std::string features_file = "../ShapeMatching/features.xml";
+	std::string sketch_file;
+	std::string output_file;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (i + 1 >= argc) {
+			std::cerr << "Missing value for " << arg << std::endl;
+			return 1;
+		}
+
+		if (arg == "--iterations") {
+			iterations = (std::max)(1, atoi(argv[++i]));
+		} else if (arg == "--cga-dir") {
+			cga_dir = argv[++i];
+		} else if (arg == "--features") {
+			features_file = argv[++i];
+		} else if (arg == "--sketch") {
+			sketch_file = argv[++i];
+		} else if (arg == "--output") {
+			output_file = argv[++i];
+		} else {
+			std::cerr << "Unknown option: " << arg << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<BenchmarkResult> results;
+
+	try {
+		// 実在の文法と、深さを変えた合成のfacadeの文法
+		std::vector<std::pair<std::string, std::string> > grammars;
+		grammars.push_back(std::make_pair(std::string("simpleMass"), cga_dir + "/simpleMass.xml"));
+		grammars.push_back(std::make_pair(std::string("LshapeMass"), cga_dir + "/LshapeMass.xml"));
+
+		int depths[] = { 2, 6, 10 };
+		for (int i = 0; i < 3; ++i) {
+			std::stringstream name;
+			name << "facade_depth" << depths[i];
+			std::string filename = QDir::temp().absoluteFilePath(QString("benchmark_%1.xml").arg(name.str().c_str())).toUtf8().constData();
+			writeFacadeGrammar(filename, depths[i]);
+			grammars.push_back(std::make_pair(name.str(), filename));
+		}
+
+		for (int i = 0; i < grammars.size(); ++i) {
+			const std::string& filename = grammars[i].second;
+			results.push_back(measure("parse/" + grammars[i].first, iterations, [&]() -> int {
+				cga::RuleSet ruleSet;
+				cga::parseRules(filename, ruleSet);
+				return (int)ruleSet.rules.size();
+			}));
+		}
+
+		// 10000ルールの文法で、パーサのスループットを測る (countはルールの数)
+		{
+			std::string filename = QDir::temp().absoluteFilePath("benchmark_library_10k.xml").toUtf8().constData();
+			writeLibraryGrammar(filename, 10000);
+			results.push_back(measure("parse/library_10k", iterations, [&]() -> int {
+				cga::RuleSet ruleSet;
+				cga::parseRules(filename, ruleSet);
+				return (int)ruleSet.rules.size();
+			}));
+		}
+
+		for (int i = 0; i < grammars.size(); ++i) {
+			cga::CGA cga_system;
+			cga_system.axiom = createAxiom();
+			cga::parseRules(grammars[i].second, cga_system.ruleSet);
+
+			results.push_back(measure("derive/" + grammars[i].first, iterations, [&]() -> int {
+				cga_system.generate();
+				return (int)cga_system.shapes.size();
+			}));
+		}
+
+		// 式の評価は1回が短いので、まとめて評価する
+		{
+			cga::RuleSet ruleSet;
+			cga::parseRules(cga_dir + "/LshapeMass.xml", ruleSet);
+			boost::shared_ptr<cga::Shape> shape = createAxiom();
+
+			const char* expressions[][2] = {
+				{ "attr", "bldg_height" },
+				{ "arith", "1-bldg_height_lower_ratio" },
+				{ "scope", "scope.sx*0.5+(bldg_height-3)/2" }
+			};
+			for (int i = 0; i < 3; ++i) {
+				std::string expression = expressions[i][1];
+				results.push_back(measure(std::string("eval/") + expressions[i][0] + "_x1000", iterations, [&]() -> int {
+					float total = 0.0f;
+					for (int k = 0; k < 1000; ++k) {
+						total += ruleSet.evalFloat(expression, shape);
+					}
+					return total != 0.0f ? 1000 : 0;
+				}));
+			}
+
+			// compile()後は、scope.*を参照しない式は評価済みの値を返す
+			ruleSet.compile();
+			for (int i = 0; i < 3; ++i) {
+				std::string expression = expressions[i][1];
+				results.push_back(measure(std::string("eval_compiled/") + expressions[i][0] + "_x1000", iterations, [&]() -> int {
+					float total = 0.0f;
+					for (int k = 0; k < 1000; ++k) {
+						total += ruleSet.evalFloat(expression, shape);
+					}
+					return total != 0.0f ? 1000 : 0;
+				}));
+			}
+		}
+
+		// ファサードのように、同じsplitを多数のshapeに適用する場合 (countは断片の数)
+		{
+			cga::RuleSet ruleSet;
+			ruleSet.addAttr("wall_width", "0.5");
+			ruleSet.addAttr("tile_width", "3");
+			ruleSet.compile();
+
+			std::vector<cga::Value> sizes;
+			sizes.push_back(cga::Value(cga::Value::TYPE_ABSOLUTE, "wall_width"));
+			sizes.push_back(cga::Value(cga::Value::TYPE_FLOATING, "tile_width", true));
+			sizes.push_back(cga::Value(cga::Value::TYPE_ABSOLUTE, "wall_width"));
+
+			std::vector<boost::shared_ptr<cga::Shape> > shapes;
+			std::vector<float> extents;
+			for (int i = 0; i < 1000; ++i) {
+				shapes.push_back(boost::shared_ptr<cga::Shape>(new cga::Rectangle("Facade", glm::mat4(), glm::mat4(), 20.0f + i % 40, 3.0f, glm::vec3(1, 1, 1))));
+				extents.push_back(shapes.back()->_scope.x);
+			}
+
+			cga::DecodedSplits decoded;
+			results.push_back(measure("split/decode_x1000", iterations, [&]() -> int {
+				int count = 0;
+				for (int i = 0; i < shapes.size(); ++i) {
+					cga::Rule::decodeSplitSizes(sizes, ruleSet, &shapes[i], &extents[i], 1, decoded);
+					count += decoded.sizes.size();
+				}
+				return count;
+			}));
+			results.push_back(measure("split/decode_batch_1000", iterations, [&]() -> int {
+				cga::Rule::decodeSplitSizes(sizes, ruleSet, &shapes[0], &extents[0], shapes.size(), decoded);
+				return (int)decoded.sizes.size();
+			}));
+		}
+
+		// shape featureの画像のパスは、featureファイルのディレクトリからの相対パス
+		{
+			QFileInfo featuresInfo(features_file.c_str());
+			QString origDir = QDir::currentPath();
+			QDir::setCurrent(featuresInfo.absolutePath());
+			std::string filename = featuresInfo.fileName().toUtf8().constData();
+
+			std::vector<ShapeFeature> features;
+			results.push_back(measure("features/load", iterations, [&]() -> int {
+				loadShapeFeatures(filename, features);
+				return (int)features.size();
+			}));
+
+			QDir::setCurrent(origDir);
+
+			if (features.empty()) {
+				std::cerr << "No shape features are found in " << features_file << ". Skipping the matching benchmarks." << std::endl;
+			} else {
+				cv::Mat sketch;
+				if (!sketch_file.empty()) {
+					sketch = cv::imread(sketch_file, CV_LOAD_IMAGE_GRAYSCALE);
+				}
+				if (sketch.empty()) {
+					sketch = createSyntheticSketch();
+				}
+
+				results.push_back(measure("match/normalize", iterations, [&]() -> int {
+					cv::Mat normalized = normalizeSketch(sketch);
+					return normalized.cols * normalized.rows;
+				}));
+
+				cv::Mat normalized = normalizeSketch(sketch);
+				results.push_back(measure("match/compare", iterations, [&]() -> int {
+					float min_diff;
+					findClosestShapeFeature(normalized, features, min_diff);
+					return (int)features.size();
+				}));
+
+				results.push_back(measure("match/latency", iterations, [&]() -> int {
+					float min_diff;
+					findClosestShapeFeature(normalizeSketch(sketch), features, min_diff);
+					return (int)features.size();
+				}));
+			}
+		}
+	} catch (const char* ex) {
+		std::cerr << "ERROR:" << std::endl << ex << std::endl;
+		return 1;
+	} catch (const std::string& ex) {
+		std::cerr << "ERROR:" << std::endl << ex << std::endl;
+		return 1;
+	}
+
+	if (output_file.empty()) {
+		writeJSON(std::cout, results, iterations);
+	} else {
+		std::ofstream out(output_file.c_str());
+		if (!out.is_open()) {
+			std::cerr << "Cannot open " << output_file << std::endl;
+			return 1;
+		}
+		writeJSON(out, results, iterations);
+	}
+
+	return 0;
+}
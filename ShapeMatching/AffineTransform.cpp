@@ -0,0 +1,64 @@
+#include "AffineTransform.h"
+
+namespace cga {
+
+/**
+ * 4x4の変換行列から、回転と平行移動を取り出す。
+ * 射影成分は無視する。
+ */
+AffineTransform::AffineTransform(const glm::mat4& mat) {
+	rotation = glm::mat3(mat);
+	translation = glm::vec3(mat[3]);
+}
+
+glm::mat4 AffineTransform::toMat4() const {
+	glm::mat4 mat(rotation);
+	mat[3] = glm::vec4(translation, 1);
+	return mat;
+}
+
+AffineTransform AffineTransform::inverse() const {
+	glm::mat3 inv = glm::inverse(rotation);
+	return AffineTransform(inv, -(inv * translation));
+}
+
+/**
+ * 変換を合成する (otherを適用した後に、この変換を適用する)。
+ */
+AffineTransform AffineTransform::operator*(const AffineTransform& other) const {
+	return AffineTransform(rotation * other.rotation, rotation * other.translation + translation);
+}
+
+/**
+ * この座標系で、offsetだけ平行移動した座標系を返す。
+ * glm::translate(toMat4(), offset)と同じ。
+ */
+AffineTransform AffineTransform::translated(const glm::vec3& offset) const {
+	return AffineTransform(rotation, translation + rotation[0] * offset.x + rotation[1] * offset.y + rotation[2] * offset.z);
+}
+
+/**
+ * この座標系を、x軸周りに90度回転した座標系を返す。
+ * glm::rotate(toMat4(), M_PI * 0.5f, glm::vec3(1, 0, 0))と同じだが、軸を入れ替えるだけなので誤差もない。
+ */
+AffineTransform AffineTransform::rotatedX90() const {
+	return AffineTransform(glm::mat3(rotation[0], rotation[2], -rotation[1]), translation);
+}
+
+/**
+ * この座標系を、z軸周りに90度のnum倍だけ回転した座標系を返す (numは負でもよい)。
+ */
+AffineTransform AffineTransform::rotatedZ90(int num) const {
+	switch (((num % 4) + 4) % 4) {
+	case 1:
+		return AffineTransform(glm::mat3(rotation[1], -rotation[0], rotation[2]), translation);
+	case 2:
+		return AffineTransform(glm::mat3(-rotation[0], -rotation[1], rotation[2]), translation);
+	case 3:
+		return AffineTransform(glm::mat3(-rotation[1], rotation[0], rotation[2]), translation);
+	default:
+		return *this;
+	}
+}
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+namespace cga {
+
+/**
+ * 回転 (3x3行列) と平行移動だけからなる変換。
+ * shapeのscopeの座標系を、4x4行列の代わりにこれで表す。
+ * splitやcompでは、平行移動と軸の入れ替えだけで済むので、4x4行列の積を計算しなくてよい。
+ */
+class AffineTransform {
+public:
+	glm::mat3 rotation;			// 各列が、x, y, z軸の向き
+	glm::vec3 translation;		// 原点の位置
+
+public:
+	AffineTransform() {}
+	AffineTransform(const glm::mat3& rotation, const glm::vec3& translation) : rotation(rotation), translation(translation) {}
+	AffineTransform(const glm::mat4& mat);
+
+	glm::mat4 toMat4() const;
+	AffineTransform inverse() const;
+	AffineTransform operator*(const AffineTransform& other) const;
+	glm::vec3 transformPoint(const glm::vec3& p) const { return rotation * p + translation; }
+	glm::vec3 transformVector(const glm::vec3& v) const { return rotation * v; }
+
+	AffineTransform translated(const glm::vec3& offset) const;
+	AffineTransform rotatedX90() const;
+	AffineTransform rotatedZ90(int num) const;
+};
+
+}
@@ -1,4 +1,6 @@
 #include "BoundingBox.h"
+#include <algorithm>
+#include <limits>
 
 namespace cga {
 
@@ -11,10 +13,10 @@ BoundingBox::BoundingBox(const std::vector<glm::vec2>& points) {
 	maxPt.z = 0.0f;
 
 	for (int i = 0; i < points.size(); ++i) {
-		minPt.x = min(minPt.x, points[i].x);
-		minPt.y = min(minPt.y, points[i].y);
-		maxPt.x = max(maxPt.x, points[i].x);
-		maxPt.y = max(maxPt.y, points[i].y);
+		minPt.x = (std::min)(minPt.x, points[i].x);
+		minPt.y = (std::min)(minPt.y, points[i].y);
+		maxPt.x = (std::max)(maxPt.x, points[i].x);
+		maxPt.y = (std::max)(maxPt.y, points[i].y);
 	}
 }
 
@@ -27,12 +29,12 @@ BoundingBox::BoundingBox(const std::vector<glm::vec3>& points) {
 	maxPt.z = -(std::numeric_limits<float>::max)();
 
 	for (int i = 0; i < points.size(); ++i) {
-		minPt.x = min(minPt.x, points[i].x);
-		minPt.y = min(minPt.y, points[i].y);
-		minPt.z = min(minPt.z, points[i].z);
-		maxPt.x = max(maxPt.x, points[i].x);
-		maxPt.y = max(maxPt.y, points[i].y);
-		maxPt.z = max(maxPt.z, points[i].z);
+		minPt.x = (std::min)(minPt.x, points[i].x);
+		minPt.y = (std::min)(minPt.y, points[i].y);
+		minPt.z = (std::min)(minPt.z, points[i].z);
+		maxPt.x = (std::max)(maxPt.x, points[i].x);
+		maxPt.y = (std::max)(maxPt.y, points[i].y);
+		maxPt.z = (std::max)(maxPt.z, points[i].z);
 	}
 }
 
@@ -1,6 +1,5 @@
 #pragma once
 
-#include "RenderManager.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/string_cast.hpp>
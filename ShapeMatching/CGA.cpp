@@ -2,98 +2,189 @@
 #include "GLUtils.h"
 #include <map>
 #include <iostream>
-#include <QDir>
+#include <sstream>
+#include <algorithm>
+#include <limits>
+#include <boost/filesystem.hpp>
 #include "RuleParser.h"
+#include "Profiler.h"
+#include "SplitOperator.h"
 
 namespace cga {
 
 CGA::CGA() {
+	lotOffsets.push_back(0);
+	lodRules.resize(NUM_LODS);
+	numRenderedLots = 0;
+
+	// 不正なattr (0に近いrepeatのサイズなど) で、derivationが終わらなくならないようにする
+	maxShapes = 1000000;
+	maxDepth = 100;
+	timeLimit = 0;
+	numDerivedShapes = 0;
 }
 
-void CGA::loadRules() {
+/**
+ * floorとwindowのルールを読み込む。
+ * ルールはruleCacheを通して読み込むので、2回目以降の起動ではXMLをパースしない。
+ * 各ルールは、提案でmergeするときの開始ルール (Start) から到達できるものだけを残す。
+ * ruleCacheのcache_dirが空なら、cga_dir/cacheをキャッシュのディレクトリとする。
+ *
+ * @param cga_dir		ルールのディレクトリ (floors, windowsのサブディレクトリのxmlファイルを読み込む)
+ */
+void CGA::loadRules(const std::string& cga_dir) {
+	PROFILE_SCOPE("cga", "CGA::loadRules");
+
+	if (ruleCache.cache_dir.empty()) {
+		ruleCache.cache_dir = cga_dir + "/cache";
+	}
+
 	// load floor rules
 	{
-		QDir dir("../cga/floors");
-		QStringList filters;
-		filters << "*.xml";
-		QFileInfoList fileInfoList = dir.entryInfoList(filters, QDir::Files|QDir::NoDotAndDotDot);
-		for (int i = 0; i < fileInfoList.size(); ++i) {
-			RuleSet ruleSet;
-			parseRules(fileInfoList[i].absoluteFilePath().toUtf8().constData(), ruleSet);
-
-			ruleRepository["floors"].push_back(ruleSet);
+		std::vector<std::string> filenames;
+		listRuleFiles(cga_dir + "/floors", filenames);
+		for (int i = 0; i < filenames.size(); ++i) {
+			ruleRepository["floors"].push_back(ruleCache.load(filenames[i], "Start"));
 		}
 	}
 
 	// load window rules
 	{
-		QDir dir("../cga/windows");
-		QStringList filters;
-		filters << "*.xml";
-		QFileInfoList fileInfoList = dir.entryInfoList(filters, QDir::Files|QDir::NoDotAndDotDot);
-		for (int i = 0; i < fileInfoList.size(); ++i) {
-			RuleSet ruleSet;
-			parseRules(fileInfoList[i].absoluteFilePath().toUtf8().constData(), ruleSet);
-
-			ruleRepository["windows"].push_back(ruleSet);
+		std::vector<std::string> filenames;
+		listRuleFiles(cga_dir + "/windows", filenames);
+		for (int i = 0; i < filenames.size(); ++i) {
+			ruleRepository["windows"].push_back(ruleCache.load(filenames[i], "Start"));
 		}
 	}
 }
 
+/**
+ * 現在のルールをbaseとする、空の提案を作成する。
+ * 現在のルールはfreeze()して共有するので、文法全体も、compile()の結果もコピーしない。
+ */
+void CGA::beginProposal() {
+	ruleSet.freeze();
+	proposedRuleSet = ruleSet;
+}
+
+/**
+ * 提案を採用する。提案はbaseを共有しているので、コピーするのは提案で変更した部分だけである。
+ */
 void CGA::acceptProposal() {
 	ruleSet = proposedRuleSet;
 	proposedShapes.clear();
 	generate();
 }
 
+/**
+ * 各敷地のaxiomから、derivationを行う。
+ * 敷地毎に、terminalのshapeと、各LODのshapeを分けて保存する。
+ */
 void CGA::generate() {
-	shapes.clear();
-	stack.clear();
-	stack.push_back(axiom->clone(axiom->_name));
+	PROFILE_SCOPE("cga", "CGA::generate");
+	ruleSet.compile();
+	findLODRules(ruleSet);
 
-	while (!stack.empty()) {
-		boost::shared_ptr<Shape> shape = stack.front();
-		stack.pop_front();
+	std::vector<boost::shared_ptr<Shape> > axioms;
+	listAxioms(axioms);
 
-		if (ruleSet.contain(shape->_name)) {
-			ruleSet.getRule(shape->_name).apply(shape, ruleSet, stack);
-		} else {
-			if (shape->_name.back() != '!' && shape->_name.back() != '.') {
-				//std::cout << "Warning: " << "no rule is found for " << shape->_name << "." << std::endl;
-			}
-			shapes.push_back(shape);
-		}
+	shapes.clear();
+	lotOffsets.assign(1, 0);
+	lodShapes.assign(axioms.size(), std::vector<std::vector<boost::shared_ptr<Shape> > >(NUM_LODS));
+	truncationMessage.clear();
+	for (int i = 0; i < axioms.size(); ++i) {
+		derive(ruleSet, axioms[i], shapes, &lodShapes[i]);
+		lotOffsets.push_back(shapes.size());
 	}
 }
 
 void CGA::generateProposal() {
+	PROFILE_SCOPE("cga", "CGA::generateProposal");
+	proposedRuleSet.compile();
+
+	std::vector<boost::shared_ptr<Shape> > axioms;
+	listAxioms(axioms);
+
 	proposedShapes.clear();
-	stack.clear();
-	stack.push_back(axiom->clone(axiom->_name));
+	truncationMessage.clear();
+	for (int i = 0; i < axioms.size(); ++i) {
+		derive(proposedRuleSet, axioms[i], proposedShapes, NULL);
+	}
+}
 
-	while (!stack.empty()) {
-		boost::shared_ptr<Shape> shape = stack.front();
-		stack.pop_front();
+/**
+ * derivationを行い、terminalのshapeを溜めずに、1つずつsinkへ書き出す。
+ * shapesとlodShapesは空になる。大きなモデルをファイルに書き出す場合に、メモリの使用量を抑えるために使う。
+ *
+ * @param sink			書き出し先 (object名は"shape")
+ * @return				書き出したterminalのshapeの数
+ */
+int CGA::generate(GeometrySink* sink) {
+	PROFILE_SCOPE("cga", "CGA::generate(sink)");
+	ruleSet.compile();
 
-		if (proposedRuleSet.contain(shape->_name)) {
-			proposedRuleSet.getRule(shape->_name).apply(shape, proposedRuleSet, stack);
-		} else {
-			if (shape->_name.back() != '!' && shape->_name.back() != '.') {
-				//std::cout << "Warning: " << "no rule is found for " << shape->_name << "." << std::endl;
+	std::vector<boost::shared_ptr<Shape> > axioms;
+	listAxioms(axioms);
+
+	shapes.clear();
+	lotOffsets.assign(axioms.size() + 1, 0);
+	lodShapes.assign(axioms.size(), std::vector<std::vector<boost::shared_ptr<Shape> > >(NUM_LODS));
+	truncationMessage.clear();
+	int numTerminals = 0;
+	for (int i = 0; i < axioms.size(); ++i) {
+		numTerminals += derive(ruleSet, axioms[i], shapes, NULL, sink);
+	}
+	return numTerminals;
+}
+
+/**
+ * 敷地毎に、詳細から粗い順のLODを別のobjectとして登録し、1つのLODグループにまとめる。
+ * 描画側では、敷地毎に画面上のサイズからLODを選択するので、近くの建物は詳細に、遠くの建物は粗く描画される。
+ */
+void CGA::render(GeometrySink* sink, bool showScopeCoordinateSystem) {
+	for (int i = 0; i < numLots(); ++i) {
+		std::vector<std::string> level_names;
+		for (int k = LOD_FULL; k < NUM_LODS; ++k) {
+			std::string object_name = objectName(i, k);
+			sink->removeObject(object_name);
+
+			if (k == LOD_FULL) {
+				for (int j = lotOffsets[i]; j < lotOffsets[i + 1]; ++j) {
+					shapes[j]->render(sink, object_name, 1.0f, showScopeCoordinateSystem);
+				}
+			} else {
+				for (int j = 0; j < lodShapes[i][k].size(); ++j) {
+					lodShapes[i][k][j]->render(sink, object_name, 1.0f, false);
+				}
 			}
-			proposedShapes.push_back(shape);
+			level_names.push_back(object_name);
 		}
+		sink->setLODGroup(objectName(i, LOD_FULL), level_names);
 	}
+
+	// 敷地が減った場合は、前回の残りを削除する
+	for (int i = numLots(); i < numRenderedLots; ++i) {
+		for (int k = LOD_FULL; k < NUM_LODS; ++k) {
+			sink->removeObject(objectName(i, k));
+		}
+		sink->setLODGroup(objectName(i, LOD_FULL), std::vector<std::string>());
+	}
+	numRenderedLots = numLots();
+
+	renderProposal(sink, showScopeCoordinateSystem);
 }
 
-void CGA::render(RenderManager* renderManager, bool showScopeCoordinateSystem) {
-	renderManager->removeObject("shape");
+/**
+ * 提案のshapeだけを、"proposal"として描画する。
+ * 提案をバックグラウンドで生成する場合に、現在のモデルに触れずに、提案のジオメトリだけを作成するために使う。
+ */
+void CGA::renderProposal(GeometrySink* sink, bool showScopeCoordinateSystem) {
+	sink->removeObject("proposal");
 
-	for (int i = 0; i < shapes.size(); ++i) {
-		shapes[i]->render(renderManager, "shape", 1.0f, showScopeCoordinateSystem);
-	}
+	// 提案は半透明のレイヤとして、OITで描画する
+	sink->setTranslucent("proposal", true);
 	for (int i = 0; i < proposedShapes.size(); ++i) {
-		proposedShapes[i]->render(renderManager, "shape", 0.2f, showScopeCoordinateSystem);
+		proposedShapes[i]->render(sink, "proposal", 0.2f, showScopeCoordinateSystem);
 	}
 }
 
@@ -116,4 +207,346 @@ bool CGA::hitFace(const glm::vec3& cameraPos, const glm::vec3& viewDir, Face& fa
 	return hit;
 }
 
+/**
+ * 指定された敷地の、指定されたLODのobject名を返却する。
+ * 最も詳細なLODのobject名は、その敷地のLODグループ名も兼ねる。
+ *
+ * @param lot		敷地のindex
+ * @param lod		LOD
+ * @return			object名
+ */
+std::string CGA::objectName(int lot, int lod) {
+	std::stringstream ss;
+	ss << "lot" << lot;
+	if (lod != LOD_FULL) {
+		ss << "_lod" << lod;
+	}
+	return ss.str();
+}
+
+/**
+ * derivationを開始するshapeを返却する。
+ * lotsが指定されていればその全て、そうでなければaxiomだけとする。
+ *
+ * @param axioms [OUT]		各敷地のaxiom
+ */
+void CGA::listAxioms(std::vector<boost::shared_ptr<Shape> >& axioms) const {
+	if (lots.empty()) {
+		axioms.push_back(axiom);
+	} else {
+		axioms = lots;
+	}
+}
+
+/**
+ * 各LODで、derivationを打ち切るshape名を、ルールの役割から求める。
+ * massは、compで始まるルールのshape (面に分ける前の立体)、
+ * facadeは、そのcompで作成される面 (1枚のテクスチャ付きの四角形として描画する)、
+ * floorは、facadeのルールのsplitで作成される断片とする。
+ * 文法にその役割のルールが無いLODは空のままにし、描画側でより詳細なLODを使わせる。
+ *
+ * @param ruleSet		ルール
+ */
+void CGA::findLODRules(const RuleSet& ruleSet) {
+	lodRules.assign(NUM_LODS, std::set<std::string>());
+
+	// 上のレイヤから順に、有効なルールを集める
+	std::map<std::string, const Rule*> rules;
+	for (const RuleSet* layer = &ruleSet; layer != NULL; layer = layer->base.get()) {
+		for (auto it = layer->rules.begin(); it != layer->rules.end(); ++it) {
+			if (rules.find(it->first) == rules.end()) {
+				rules[it->first] = &it->second;
+			}
+		}
+	}
+
+	for (auto it = rules.begin(); it != rules.end(); ++it) {
+		const Rule& rule = *it->second;
+		if (rule.operators.empty() || rule.operators[0]->name != "comp") continue;
+
+		lodRules[LOD_MASS].insert(it->first);
+
+		std::vector<std::string> faces;
+		rule.operators[0]->getOutputNames(faces);
+		for (int i = 0; i < faces.size(); ++i) {
+			if (faces[i] != "NIL") lodRules[LOD_FACADE].insert(faces[i]);
+		}
+	}
+
+	for (auto it = lodRules[LOD_FACADE].begin(); it != lodRules[LOD_FACADE].end(); ++it) {
+		auto rule = rules.find(*it);
+		if (rule == rules.end()) continue;
+
+		const std::vector<boost::shared_ptr<Operator> >& operators = rule->second->operators;
+		for (int i = 0; i < operators.size(); ++i) {
+			if (operators[i]->name != "split") continue;
+
+			std::vector<std::string> floors;
+			operators[i]->getOutputNames(floors);
+			lodRules[LOD_FLOOR].insert(floors.begin(), floors.end());
+		}
+	}
+}
+
+/**
+ * 指定されたaxiomから、指定されたルールでderivationを行い、terminalのshapeをshapesに追加する。
+ * lodShapesが指定された場合は、各LODのshape名でderivationを打ち切った場合のshapeも、同時に格納する。
+ * sinkが指定された場合は、terminalのshapeをshapesに格納せず、その場でsinkへ書き出して捨てる。
+ * この時は深さ優先で展開するので、stackに残るshapeの数も、ルールの木の深さ程度に収まる。
+ * sinkが指定されない場合は、deriveGrouped()で、同じルールのshapeをまとめて展開する。
+ * maxShapes, maxDepth, timeLimitを超えた場合は、残りのshapeを展開せずにterminalとして扱い、
+ * 打ち切った理由をtruncationMessageにセットする。repeatの断片の数をMAX_REPEATに制限した場合も同様である。
+ *
+ * @param ruleSet				ルール
+ * @param start					axiom
+ * @param shapes [OUT]			terminalのshape (追加する)
+ * @param lodShapes [OUT]		各LODのshape (追加する。NULLなら、LODを作成しない)
+ * @param sink					terminalのshapeの書き出し先 (NULLなら、shapesに格納する)
+ * @return						terminalのshapeの数
+ */
+int CGA::derive(const RuleSet& ruleSet, const boost::shared_ptr<Shape>& start, std::vector<boost::shared_ptr<Shape> >& shapes, std::vector<std::vector<boost::shared_ptr<Shape> > >* lodShapes, GeometrySink* sink) {
+	int numTerminals = 0;
+
+	numDerivedShapes = 1;
+	derivationTimer.start();
+	SplitOperator::takeClampedRepeats();
+
+	if (sink == NULL) {
+		numTerminals = deriveGrouped(ruleSet, start, shapes, lodShapes);
+		checkClampedRepeats();
+		return numTerminals;
+	}
+
+	stack.clear();
+	stack.push_back(start->clone(start->_name));
+	stack.back()->_depth = 0;
+	stack.back()->_lodCut = 0;
+
+	while (!stack.empty()) {
+		boost::shared_ptr<Shape> shape = stack.front();
+		stack.pop_front();
+
+		bool terminal = !ruleSet.contain(shape->_name);
+		if (!terminal && exceedsBudget(shape->_depth)) {
+			// 上限に達したので、展開せずにそのまま書き出す
+			terminal = true;
+		}
+		storeLODShape(shape, terminal, lodShapes);
+
+		if (!terminal) {
+			int depth = shape->_depth;
+			int lodCut = shape->_lodCut;
+			size_t num = stack.size();
+			ruleSet.getRule(shape->_name).apply(shape, ruleSet, stack);
+
+			// 新たにstackに追加されたshapeに、derivationの深さと、打ち切ったLODをセットする
+			size_t added = stack.size() - num;
+			numDerivedShapes += added;
+			auto first = stack.end();
+			for (size_t i = 0; i < added; ++i) {
+				--first;
+				(*first)->_depth = depth + 1;
+				(*first)->_lodCut = lodCut;
+			}
+
+			// 追加されたshapeを先頭に移して、深さ優先で展開する
+			// (stackが空だった場合は、既に先頭にあり、移す範囲に移動先が含まれてしまうので移さない)
+			if (first != stack.begin()) {
+				stack.splice(stack.begin(), stack, first, stack.end());
+			}
+		} else {
+			if (shape->_name.back() != '!' && shape->_name.back() != '.') {
+				//std::cout << "Warning: " << "no rule is found for " << shape->_name << "." << std::endl;
+			}
+			numTerminals++;
+			shape->render(sink, "shape", 1.0f, false);
+		}
+	}
+
+	checkClampedRepeats();
+	return numTerminals;
+}
+
+/**
+ * 指定されたaxiomから、幅優先でderivationを行い、terminalのshapeをshapesに追加する。
+ * 展開待ちのshapeを、深さとルール名毎にまとめておき、同じルールのshapeにまとめてルールを適用する。
+ * 1つのルールのオペレーションを続けて適用するので、キャッシュが効きやすく、
+ * splitなどは、全てのshapeの分をまとめて計算できる。
+ *
+ * @param ruleSet				ルール
+ * @param start					axiom
+ * @param shapes [OUT]			terminalのshape (追加する)
+ * @param lodShapes [OUT]		各LODのshape (追加する。NULLなら、LODを作成しない)
+ * @return						terminalのshapeの数
+ */
+int CGA::deriveGrouped(const RuleSet& ruleSet, const boost::shared_ptr<Shape>& start, std::vector<boost::shared_ptr<Shape> >& shapes, std::vector<std::vector<boost::shared_ptr<Shape> > >* lodShapes) {
+	int numTerminals = 0;
+
+	// 深さが浅い順、同じ深さならルール名の順に展開する
+	std::map<std::pair<int, std::string>, std::vector<boost::shared_ptr<Shape> > > buckets;
+	boost::shared_ptr<Shape> axiom = start->clone(start->_name);
+	axiom->_depth = 0;
+	axiom->_lodCut = 0;
+	buckets[std::make_pair(0, axiom->_name)].push_back(axiom);
+
+	std::vector<boost::shared_ptr<Shape> > bucket;
+	std::vector<boost::shared_ptr<Shape> > batch;
+	while (!buckets.empty()) {
+		auto it = buckets.begin();
+		int depth = it->first.first;
+		std::string name = it->first.second;
+		bucket.swap(it->second);
+		buckets.erase(it);
+
+		// 上限を大きく超えないよう、BATCH_SIZE個ずつ適用し、その度に上限を確認する
+		// (打ち切ったLODの異なるshapeは、子に引き継ぐ値が異なるので、別のbatchにする)
+		const Rule* rule = ruleSet.contain(name) ? &ruleSet.getRule(name) : NULL;
+		int done = 0;
+		stack.clear();
+		while (rule != NULL && done < bucket.size() && !exceedsBudget(depth)) {
+			int lodCut = bucket[done]->_lodCut;
+			int end = done + 1;
+			while (end < bucket.size() && end - done < BATCH_SIZE && bucket[end]->_lodCut == lodCut) ++end;
+			batch.assign(bucket.begin() + done, bucket.begin() + end);
+			for (int i = 0; i < batch.size(); ++i) {
+				storeLODShape(batch[i], false, lodShapes);
+			}
+			lodCut = batch[0]->_lodCut;
+
+			size_t num = stack.size();
+			rule->applyBatch(batch, ruleSet, stack);
+			size_t added = stack.size() - num;
+			numDerivedShapes += added;
+
+			auto s = stack.end();
+			for (size_t i = 0; i < added; ++i) {
+				--s;
+				(*s)->_lodCut = lodCut;
+			}
+			done = end;
+		}
+
+		// 展開しなかったshape (ルールが無いか、上限に達したもの) は、terminalとして残す
+		for (int i = done; i < bucket.size(); ++i) {
+			storeLODShape(bucket[i], true, lodShapes);
+			shapes.push_back(bucket[i]);
+		}
+		numTerminals += bucket.size() - done;
+		bucket.clear();
+
+		// 新たにstackに追加されたshapeに、derivationの深さをセットし、ルール名毎のbucketへ振り分ける
+		// (splitの断片のように、同じ名前のshapeは続けて追加されることが多いので、直前のbucketを覚えておく)
+		std::vector<boost::shared_ptr<Shape> >* target = NULL;
+		const std::string* target_name = NULL;
+		for (auto s = stack.begin(); s != stack.end(); ++s) {
+			(*s)->_depth = depth + 1;
+			if (target == NULL || (*s)->_name != *target_name) {
+				auto b = buckets.insert(std::make_pair(std::make_pair(depth + 1, (*s)->_name), std::vector<boost::shared_ptr<Shape> >())).first;
+				target = &b->second;
+				target_name = &b->first.second;
+			}
+			target->push_back(*s);
+		}
+		stack.clear();
+	}
+
+	return numTerminals;
+}
+
+/**
+ * derivationの上限に達したか、中止が要求されたか調べ、打ち切る場合はtruncationMessageに理由をセットする。
+ * shapeの数と時間、中止の要求は、一度超えると超えたままなので、以降のshapeは全て展開されずに残る。
+ * 上限の確認はルールの適用の前に行うので、shapeの数は、最後に適用したルール1回分 (deriveGroupedではBATCH_SIZE個のshapeの分) だけmaxShapesを超えうる。
+ *
+ * @param depth		これから展開するshapeの深さ
+ * @return			展開せずに打ち切る場合はtrue
+ */
+bool CGA::exceedsBudget(int depth) {
+	if (cancellationToken && cancellationToken->isCancelled()) {
+		if (truncationMessage.empty()) {
+			truncationMessage = "Derivation was cancelled.";
+		}
+		return true;
+	}
+
+	bool tooManyShapes = maxShapes > 0 && numDerivedShapes >= maxShapes;
+	bool timeOver = !tooManyShapes && timeLimit > 0 && derivationTimer.elapsed() >= timeLimit;
+	bool tooDeep = maxDepth > 0 && depth >= maxDepth;
+	if (!tooManyShapes && !timeOver && !tooDeep) return false;
+
+	if (truncationMessage.empty()) {
+		std::stringstream ss;
+		ss << "Derivation was truncated: ";
+		if (tooManyShapes) {
+			ss << "more than " << maxShapes << " shapes were created.";
+		} else if (timeOver) {
+			ss << "the time limit of " << timeLimit << " ms was exceeded.";
+		} else {
+			ss << "the depth limit of " << maxDepth << " was reached.";
+		}
+		truncationMessage = ss.str();
+	}
+	return true;
+}
+
+/**
+ * derivation中に、repeatの断片の数をRule::MAX_REPEATに制限したsplitがあれば、truncationMessageに理由をセットする。
+ * 制限したsplitでは、断片がMAX_REPEAT個に均等に広がるので、指定よりも大きなサイズになっている。
+ */
+void CGA::checkClampedRepeats() {
+	int clamped = SplitOperator::takeClampedRepeats();
+	if (clamped == 0 || !truncationMessage.empty()) return;
+
+	std::stringstream ss;
+	ss << "Derivation was truncated: " << clamped << " repeat split(s) were limited to " << Rule::MAX_REPEAT << " pieces.";
+	truncationMessage = ss.str();
+}
+
+/**
+ * 粗いLODのshapeを保存する。
+ * shape名がそのLODで打ち切る名前 (lodRules) なら、ルールを適用する前のshapeを保存し、shapeの_lodCutにそのLODのビットを立てる。
+ * _lodCutは子に引き継ぐので、以降の子孫は、そのLODには保存しない。
+ * 打ち切る前に到達したterminalのshapeは、そのまま保存する。
+ * 文法に打ち切る役割のルールが無いLODは、詳細なLODと同じになるので保存しない。
+ *
+ * @param shape					shape
+ * @param terminal				terminalのshapeか
+ * @param lodShapes [OUT]		各LODのshape (NULLなら、何もしない)
+ */
+void CGA::storeLODShape(const boost::shared_ptr<Shape>& shape, bool terminal, std::vector<std::vector<boost::shared_ptr<Shape> > >* lodShapes) {
+	if (lodShapes == NULL) return;
+
+	for (int k = LOD_FULL + 1; k < NUM_LODS; ++k) {
+		if (lodRules[k].empty() || (shape->_lodCut & (1 << k))) continue;
+
+		if (terminal) {
+			(*lodShapes)[k].push_back(shape);
+		} else if (lodRules[k].find(shape->_name) != lodRules[k].end()) {
+			(*lodShapes)[k].push_back(shape->clone(shape->_name));
+			shape->_lodCut |= 1 << k;
+		}
+	}
+}
+
+/**
+ * 指定されたディレクトリのxmlファイルを、名前順に列挙する。
+ * ディレクトリがなければ、何もしない。
+ *
+ * @param dirname			ディレクトリ
+ * @param filenames [OUT]	xmlファイルのパス
+ */
+void CGA::listRuleFiles(const std::string& dirname, std::vector<std::string>& filenames) {
+	namespace fs = boost::filesystem;
+
+	fs::path dir(dirname);
+	if (!fs::is_directory(dir)) return;
+
+	for (fs::directory_iterator it(dir); it != fs::directory_iterator(); ++it) {
+		if (fs::is_regular_file(it->status()) && it->path().extension() == ".xml") {
+			filenames.push_back(fs::absolute(it->path()).string());
+		}
+	}
+	std::sort(filenames.begin(), filenames.end());
+}
+
 }
@@ -1,14 +1,21 @@
 #pragma once
 
-#include "RenderManager.h"
 #include <vector>
+#include <list>
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <boost/atomic.hpp>
+#include <QElapsedTimer>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include "Vertex.h"
 #include "Rule.h"
 #include "Shape.h"
 #include "Face.h"
+#include "GeometrySink.h"
+#include "RuleCache.h"
 #include <map>
+#include <set>
 
 namespace cga {
 
@@ -22,33 +29,84 @@ enum { AXES_SELECTOR_XYZ = 0, AXES_SELECTOR_X, AXES_SELECTOR_Y, AXES_SELECTOR_Z,
 
 
 enum { STEP_FLOOR = 0, STEP_WINDOW };
+enum { LOD_FULL = 0, LOD_FLOOR, LOD_FACADE, LOD_MASS, NUM_LODS };
 
 
 const float M_PI = 3.1415926f;
 
+/**
+ * derivationの中止の要求。
+ * 別のスレッドからcancel()すると、derivationは次に上限を確認した時点で打ち切られる。
+ */
+class CancellationToken {
+private:
+	boost::atomic<bool> cancelled;
+
+public:
+	CancellationToken() : cancelled(false) {}
+
+	void cancel() { cancelled.store(true, boost::memory_order_release); }
+	bool isCancelled() const { return cancelled.load(boost::memory_order_acquire); }
+};
+
 class CGA {
+public:
+	// deriveGroupedで、上限を確認する間隔 (まとめてルールを適用するshapeの数)
+	static enum { BATCH_SIZE = 64 };
+
 public:
 	glm::mat4 modelMat;
 	boost::shared_ptr<Shape> axiom;
+	std::vector<boost::shared_ptr<Shape> > lots;	// 複数の敷地を生成する場合の、各敷地のaxiom (空なら、axiomだけを生成する)
 	std::list<boost::shared_ptr<Shape> > stack;
 	std::vector<boost::shared_ptr<Shape> > shapes;
 	std::vector<boost::shared_ptr<Shape> > proposedShapes;
+	std::vector<int> lotOffsets;		// 敷地iのterminalのshapeは、shapes[lotOffsets[i]]からshapes[lotOffsets[i + 1] - 1]
+	std::vector<std::vector<std::vector<boost::shared_ptr<Shape> > > > lodShapes;	// 敷地毎、LOD毎のshape
+	std::vector<std::set<std::string> > lodRules;								// 各LODで、derivationを打ち切るshape名
+
+	int maxShapes;					// 1回のderivationで作成するshapeの上限 (0なら制限しない)
+	int maxDepth;					// derivationの深さの上限 (0なら制限しない)
+	int timeLimit;					// 1回のderivationの制限時間 [ms] (0なら制限しない)
+	std::string truncationMessage;	// 直前のderivationを打ち切った理由 (打ち切らなかった場合は空)
+	boost::shared_ptr<const CancellationToken> cancellationToken;	// derivationの中止の要求 (NULLなら中止しない)
 
 	RuleSet ruleSet;
 	RuleSet proposedRuleSet;
 
-	std::map<std::string, std::vector<RuleSet> > ruleRepository;
+	RuleCache ruleCache;
+	std::map<std::string, std::vector<boost::shared_ptr<const RuleSet> > > ruleRepository;
+
+private:
+	QElapsedTimer derivationTimer;
+	int numDerivedShapes;
+	int numRenderedLots;
 
 public:
 	CGA();
 
-	void loadRules();
+	void loadRules(const std::string& cga_dir = "../cga");
+	void beginProposal();
 	void acceptProposal();
 	void generate();
+	int generate(GeometrySink* sink);
 	void generateProposal();
-	void render(RenderManager* renderManager, bool showScopeCoordinateSystem = false);
+	void render(GeometrySink* sink, bool showScopeCoordinateSystem = false);
+	void renderProposal(GeometrySink* sink, bool showScopeCoordinateSystem = false);
 
 	bool hitFace(const glm::vec3& cameraPos, const glm::vec3& viewDir, Face& face);
+	int numLots() const { return (int)lotOffsets.size() - 1; }
+	static std::string objectName(int lot, int lod);
+
+private:
+	static void listRuleFiles(const std::string& dirname, std::vector<std::string>& filenames);
+	void listAxioms(std::vector<boost::shared_ptr<Shape> >& axioms) const;
+	void findLODRules(const RuleSet& ruleSet);
+	int derive(const RuleSet& ruleSet, const boost::shared_ptr<Shape>& start, std::vector<boost::shared_ptr<Shape> >& shapes, std::vector<std::vector<boost::shared_ptr<Shape> > >* lodShapes, GeometrySink* sink = NULL);
+	int deriveGrouped(const RuleSet& ruleSet, const boost::shared_ptr<Shape>& start, std::vector<boost::shared_ptr<Shape> >& shapes, std::vector<std::vector<boost::shared_ptr<Shape> > >* lodShapes);
+	bool exceedsBudget(int depth);
+	void checkClampedRepeats();
+	void storeLODShape(const boost::shared_ptr<Shape>& shape, bool terminal, std::vector<std::vector<boost::shared_ptr<Shape> > >* lodShapes);
 };
 
 }
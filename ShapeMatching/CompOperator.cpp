@@ -1,5 +1,7 @@
 #include "CompOperator.h"
 #include "CGA.h"
+#include "Profiler.h"
+#include "RuleCache.h"
 
 namespace cga {
 
@@ -9,6 +11,8 @@ CompOperator::CompOperator(const std::map<std::string, std::string>& name_map) {
 }
 
 boost::shared_ptr<Shape> CompOperator::apply(boost::shared_ptr<Shape>& shape, const RuleSet& ruleSet, std::list<boost::shared_ptr<Shape> >& stack) {
+	PROFILE_SCOPE("operator", name);
+
 	std::vector<boost::shared_ptr<Shape> > shapes;
 	
 	shape->comp(name_map, shapes);
@@ -17,4 +21,29 @@ boost::shared_ptr<Shape> CompOperator::apply(boost::shared_ptr<Shape>& shape, co
 	return boost::shared_ptr<Shape>();
 }
 
+void CompOperator::save(std::ostream& out) const {
+	writeInt(out, name_map.size());
+	for (auto it = name_map.begin(); it != name_map.end(); ++it) {
+		writeString(out, it->first);
+		writeString(out, it->second);
+	}
+}
+
+boost::shared_ptr<Operator> CompOperator::load(std::istream& in) {
+	std::map<std::string, std::string> name_map;
+	int num = readInt(in);
+	for (int i = 0; i < num; ++i) {
+		std::string key = readString(in);
+		name_map[key] = readString(in);
+	}
+
+	return boost::shared_ptr<Operator>(new CompOperator(name_map));
+}
+
+void CompOperator::getOutputNames(std::vector<std::string>& names) const {
+	for (auto it = name_map.begin(); it != name_map.end(); ++it) {
+		names.push_back(it->second);
+	}
+}
+
 }
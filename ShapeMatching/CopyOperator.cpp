@@ -1,6 +1,8 @@
 #include "CopyOperator.h"
 #include "CGA.h"
 #include "Shape.h"
+#include "Profiler.h"
+#include "RuleCache.h"
 
 namespace cga {
 
@@ -10,10 +12,24 @@ CopyOperator::CopyOperator(const std::string& copy_name) {
 }
 
 boost::shared_ptr<Shape> CopyOperator::apply(boost::shared_ptr<Shape>& shape, const RuleSet& ruleSet, std::list<boost::shared_ptr<Shape> >& stack) {
+	PROFILE_SCOPE("operator", name);
+
 	boost::shared_ptr<Shape> copy = shape->clone(copy_name);
 	stack.push_back(copy);
 
 	return shape;
 }
 
+void CopyOperator::save(std::ostream& out) const {
+	writeString(out, copy_name);
+}
+
+boost::shared_ptr<Operator> CopyOperator::load(std::istream& in) {
+	return boost::shared_ptr<Operator>(new CopyOperator(readString(in)));
+}
+
+void CopyOperator::getOutputNames(std::vector<std::string>& names) const {
+	names.push_back(copy_name);
+}
+
 }
@@ -12,6 +12,9 @@ public:
 	CopyOperator(const std::string& copy_name);
 
 	boost::shared_ptr<Shape> apply(boost::shared_ptr<Shape>& shape, const RuleSet& ruleSet, std::list<boost::shared_ptr<Shape> >& stack);
+	void save(std::ostream& out) const;
+	void getOutputNames(std::vector<std::string>& names) const;
+	static boost::shared_ptr<Operator> load(std::istream& in);
 };
 
 }
\ No newline at end of file
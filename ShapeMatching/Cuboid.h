@@ -6,18 +6,16 @@
 #include <vector>
 #include "Shape.h"
 
-class RenderManager;
-
 namespace cga {
 
 class Cuboid : public Shape {
 public:
 	Cuboid() {}
-	Cuboid(const std::string& name, const glm::mat4& pivot, const glm::mat4& modelMat, float width, float depth, float height, const glm::vec3& color);
+	Cuboid(const std::string& name, const AffineTransform& pivot, const AffineTransform& modelMat, float width, float depth, float height, const glm::vec3& color);
 	boost::shared_ptr<Shape> clone(const std::string& name) const;
 	void comp(const std::map<std::string, std::string>& name_map, std::vector<boost::shared_ptr<Shape> >& shapes);
-	void split(int splitAxis, const std::vector<float>& sizes, const std::vector<std::string>& names, std::vector<boost::shared_ptr<Shape> >& objects);
-	void render(RenderManager* renderManager, const std::string& name, float opacity, bool showScopeCoordinateSystem) const;
+	void split(int splitAxis, const float* sizes, const int* name_ids, int num, const std::vector<std::string>& names, std::vector<boost::shared_ptr<Shape> >& objects);
+	void render(GeometrySink* sink, const std::string& name, float opacity, bool showScopeCoordinateSystem) const;
 };
 
 }
@@ -1,6 +1,8 @@
 #include "ExtrudeOperator.h"
 #include "CGA.h"
 #include "Shape.h"
+#include "Profiler.h"
+#include "RuleCache.h"
 
 namespace cga {
 
@@ -10,9 +12,41 @@ ExtrudeOperator::ExtrudeOperator(const std::string& height) {
 }
 
 boost::shared_ptr<Shape> ExtrudeOperator::apply(boost::shared_ptr<Shape>& shape, const RuleSet& ruleSet, std::list<boost::shared_ptr<Shape> >& stack) {
+	PROFILE_SCOPE("operator", name);
+
 	float actual_height = ruleSet.evalFloat(height, shape);
 
 	return shape->extrude(shape->_name, actual_height);
 }
 
+/**
+ * 複数のshapeを、まとめてextrudeする。
+ * scope.*を参照しない高さは、全てのshapeで同じなので、1回だけ評価する。
+ */
+void ExtrudeOperator::applyBatch(std::vector<boost::shared_ptr<Shape> >& shapes, const RuleSet& ruleSet, std::list<boost::shared_ptr<Shape> >& stack) {
+	if (shapes.empty() || RuleSet::classifyExpression(height) == RuleSet::EXPRESSION_SCOPE) {
+		Operator::applyBatch(shapes, ruleSet, stack);
+		return;
+	}
+
+	PROFILE_SCOPE("operator", name);
+
+	float actual_height = ruleSet.evalFloat(height, shapes[0]);
+	for (int i = 0; i < shapes.size(); ++i) {
+		shapes[i] = shapes[i]->extrude(shapes[i]->_name, actual_height);
+	}
+}
+
+void ExtrudeOperator::save(std::ostream& out) const {
+	writeString(out, height);
+}
+
+boost::shared_ptr<Operator> ExtrudeOperator::load(std::istream& in) {
+	return boost::shared_ptr<Operator>(new ExtrudeOperator(readString(in)));
+}
+
+void ExtrudeOperator::getExpressions(std::vector<std::string>& expressions) const {
+	expressions.push_back(height);
+}
+
 }
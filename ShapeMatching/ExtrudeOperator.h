@@ -12,6 +12,10 @@ public:
 	ExtrudeOperator(const std::string& height);
 
 	boost::shared_ptr<Shape> apply(boost::shared_ptr<Shape>& shape, const RuleSet& ruleSet, std::list<boost::shared_ptr<Shape> >& stack);
+	void applyBatch(std::vector<boost::shared_ptr<Shape> >& shapes, const RuleSet& ruleSet, std::list<boost::shared_ptr<Shape> >& stack);
+	void save(std::ostream& out) const;
+	void getExpressions(std::vector<std::string>& expressions) const;
+	static boost::shared_ptr<Operator> load(std::istream& in);
 };
 
 }
\ No newline at end of file
@@ -1,5 +1,4 @@
 ﻿#include "GLUtils.h"
-#include <QGLWidget>
 #include <opencv/cv.h>
 #include <opencv/highgui.h>
 #include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
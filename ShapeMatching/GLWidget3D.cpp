@@ -1,6 +1,7 @@
 ﻿#include "GLWidget3D.h"
 #include <iostream>
 #include "RuleParser.h"
+#include "RuleGraph.h"
 #include "Rectangle.h"
 #include "GLUtils.h"
 #include "Face.h"
@@ -9,6 +10,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/convenience.hpp>
 #include "ShapeFeatureLoader.h"
+#include "Profiler.h"
 
 GLWidget3D::GLWidget3D(QWidget *parent) : QGLWidget(QGLFormat(QGL::SampleBuffers), parent) {
 	setAutoFillBackground(false);
@@ -17,10 +19,11 @@ GLWidget3D::GLWidget3D(QWidget *parent) : QGLWidget(QGLFormat(QGL::SampleBuffers
 	// ShadowMappingは平行光源を使っている。この位置から原点方向を平行光源の方向とする。
 	light_dir = glm::normalize(glm::vec3(-4, -5, -8));
 
-	// シャドウマップ用のmodel/view/projection行列を作成
-	glm::mat4 light_pMatrix = glm::ortho<float>(-100, 100, -100, 100, 0.1, 200);
-	glm::mat4 light_mvMatrix = glm::lookAt(-light_dir * 50.0f, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
-	light_mvpMatrix = light_pMatrix * light_mvMatrix;
+	// シャドウマップ用の行列は、描画毎にカメラの視錐台に合わせて作成する (ShadowMapping::update)
+	light_mvpMatrix = glm::mat4();
+
+	// CGAのジオメトリは、sinkを通してRenderManagerに登録する
+	renderSink.renderManager = &renderManager;
 
 	// initialize keys
 	ctrlPressed = false;
@@ -28,8 +31,14 @@ GLWidget3D::GLWidget3D(QWidget *parent) : QGLWidget(QGLFormat(QGL::SampleBuffers
 	// initial sketch step
 	sketch_step = cga::STEP_FLOOR;
 
+	// 不正なattrでderivationが長引いても、操作が止まらないようにする
+	cga_system.timeLimit = 500;
+
 	// load rules
 	cga_system.loadRules();
+
+	// 提案のderivationは、操作が止まらないようにバックグラウンドで行う
+	proposalWorker.start();
 }
 
 void GLWidget3D::keyPressEvent(QKeyEvent *e) {
@@ -40,8 +49,10 @@ void GLWidget3D::keyPressEvent(QKeyEvent *e) {
 		ctrlPressed = true;
 		break;
 	case Qt::Key_Return:
+		// 生成中の提案は、採用した後に表示されないよう取り消す
+		proposalWorker.cancel();
 		cga_system.acceptProposal();
-		cga_system.render(&renderManager, true);
+		cga_system.render(&renderSink, true);
 		update();
 		break;
 	case Qt::Key_Space:
@@ -60,19 +71,24 @@ void GLWidget3D::keyReleaseEvent(QKeyEvent* e) {
  * Draw the scene.
  */
 void GLWidget3D::drawScene(int drawMode) {
+	PassTimerScope scope(renderManager.timer, drawMode == 0 ? "main" : "shadow.draw");
+
 	if (drawMode == 0) {
-		glUniform1i(glGetUniformLocation(renderManager.program,"depthComputation"), 0);
+		renderManager.setDrawMode(false, false);
 	} else {
-		glUniform1i(glGetUniformLocation(renderManager.program,"depthComputation"), 1);
+		renderManager.setDrawMode(true, false);
 	}
 
-	glUniform1i(glGetUniformLocation(renderManager.program,"lineRendering"), 0);
-
 	if (showScopeCoordinateSystem) {
 		renderManager.renderAll(showWireframe);
 	} else {
 		renderManager.renderAllExcept("axis", showWireframe);
 	}
+
+	// 半透明のレイヤは、不透明なシーンの後に描画する (シャドウマップには含めない)
+	if (drawMode == 0) {
+		renderManager.renderTranslucent(showWireframe);
+	}
 }
 
 void GLWidget3D::drawLineTo(const QPoint &endPoint) {
@@ -106,11 +122,9 @@ void GLWidget3D::inferRuleFromSketch() {
 		// strokeから、ルールを探す
 		face.shape->findRule(strokes, sketch_step, &cga_system);
 
-		// CGAモデルを生成しなおす
-		cga_system.generateProposal();
-
-		// 描画する
-		cga_system.render(&renderManager, true);
+		// 提案のderivationをバックグラウンドで開始する (生成中の古い提案は中止する)
+		// 結果は、paintEvent()で受け取って描画する
+		proposalWorker.request(cga_system);
 	}
 
 	strokes.clear();
@@ -118,6 +132,30 @@ void GLWidget3D::inferRuleFromSketch() {
 	update();
 }
 
+/**
+ * バックグラウンドで生成が終わった提案を受け取り、描画に反映する。
+ * ジオメトリは生成したスレッドで作成済みなので、ここではRenderManagerに登録するだけである。
+ *
+ * @return		まだ生成中の提案があればtrue
+ */
+bool GLWidget3D::receiveProposal() {
+	ProposalResult* result = proposalWorker.popResult();
+	if (result != NULL) {
+		if (!result->errorMessage.empty()) {
+			std::cout << "ERROR:" << std::endl << result->errorMessage << std::endl;
+		} else {
+			if (!result->truncationMessage.empty()) {
+				std::cout << "WARNING: " << result->truncationMessage << std::endl;
+			}
+			cga_system.proposedShapes.swap(result->shapes);
+			result->geometry.replay(&renderSink);
+		}
+		delete result;
+	}
+
+	return proposalWorker.hasPending();
+}
+
 glm::vec3 GLWidget3D::unprojectByPlane(const glm::vec2& point, const glm::vec3& face_point, const glm::vec3& face_normal) {
 	glm::vec3 cameraPos = camera.cameraPosInWorld();
 	glm::vec3 dir((point.x - width() * 0.5f) * 2.0f / width() * camera.aspect(), (height() * 0.5f - point.y) * 2.0f / height(), -camera.f());
@@ -193,6 +231,7 @@ void GLWidget3D::clearSketch() {
 }
 
 void GLWidget3D::clear3DModel() {
+	proposalWorker.cancel();
 	renderManager.removeObjects();
 
 	std::vector<Vertex> vertices;
@@ -214,11 +253,9 @@ void GLWidget3D::analyzeRules() {
 	glDisable(GL_TEXTURE_2D);
 
 	// pass the light direction to the shader
-	//glUniform1fv(glGetUniformLocation(renderManager.program, "lightDir"), 3, &light_dir[0]);
-	glUniform3f(glGetUniformLocation(renderManager.program, "lightDir"), light_dir.x, light_dir.y, light_dir.z);
+	renderManager.setLight(light_dir, light_mvpMatrix);
 	
-	glUniform1i(glGetUniformLocation(renderManager.program,"depthComputation"), 0);
-	glUniform1i(glGetUniformLocation(renderManager.program,"lineRendering"), 1);
+	renderManager.setDrawMode(false, true);
 
 	shapeFeatures.clear();
 	char filenames[][255] = {"../cga/simpleMass.xml", "../cga/LshapeMass.xml"};
@@ -234,8 +271,14 @@ void GLWidget3D::analyzeRules() {
 	for (int fi = 0; fi < 2; ++fi) {
 		try {
 			cga::parseRules(filenames[fi], cga_system.ruleSet);
+
+			// axiomから到達できないルールを除き、終わらない可能性のある再帰を警告する
+			cga::RuleGraph graph;
+			graph.check(cga_system.ruleSet, cga_system.axiom->_name, filenames[fi], std::cout);
 		} catch (const char* ex) {
 			std::cout << "ERROR:" << std::endl << ex << std::endl;
+		} catch (const std::string& ex) {
+			std::cout << "ERROR:" << std::endl << ex << std::endl;
 		}
 
 		for (int si = 0; si < num_samples[fi]; ++si) {
@@ -250,11 +293,13 @@ void GLWidget3D::analyzeRules() {
 					it->second = boost::lexical_cast<std::string>((int)(si % 5) * 0.1f + 0.3f);
 				}
 			}
+			// attrsを直接書き換えたので、前のサンプルのcompile()の結果を捨てる
+			cga_system.ruleSet.invalidate();
 
 			renderManager.removeObjects();
 			try {
 				cga_system.generate();
-				cga_system.render(&renderManager, true);
+				cga_system.render(&renderSink, true);
 			} catch (const char* ex) {
 				std::cout << "ERROR:" << std::endl << ex << std::endl;
 			}
@@ -279,10 +324,11 @@ void GLWidget3D::analyzeRules() {
 					glEnable(GL_DEPTH_TEST);
 
 					// Model view projection行列をシェーダに渡す
-					glUniformMatrix4fv(glGetUniformLocation(renderManager.program, "mvpMatrix"),  1, GL_FALSE, &camera.mvpMatrix[0][0]);
-					glUniformMatrix4fv(glGetUniformLocation(renderManager.program, "mvMatrix"),  1, GL_FALSE, &camera.mvMatrix[0][0]);
+					renderManager.setMatrices(camera.mvpMatrix, camera.mvMatrix);
 
-					renderManager.render("shape", true);
+					for (int li = 0; li < cga_system.numLots(); ++li) {
+						renderManager.render(cga::CGA::objectName(li, cga::LOD_FULL).c_str(), true);
+					}
 
 
 					unsigned char* data = new unsigned char[sizeof(unsigned char) * 3 * width() * height()];
@@ -351,6 +397,8 @@ void GLWidget3D::analyzeRules() {
 }
 
 void GLWidget3D::findMatchingRule() {
+	PROFILE_SCOPE("matching", "findMatchingRule");
+
 	/*
 	shapeFeatures.clear();
 	
@@ -409,45 +457,23 @@ void GLWidget3D::findMatchingRule() {
 	// convert the sketch to grayscale
 	cv::cvtColor(matSketch, matSketch, CV_BGR2GRAY);
 
-	// blur the sketch
-	cv::GaussianBlur(matSketch, matSketch, cv::Size(11, 11), 11, 11);
-
-	// conver the sketch to mono color
-	cv::threshold(matSketch, matSketch, 253, 255, 0);
-
-	// rectangle
-	cv::Rect roi = cvutils::computeBoundingBoxFromImage(matSketch);
-	cv::Mat matSketch2;
-	matSketch(roi).copyTo(matSketch2);
-
-	cv::resize(matSketch2, matSketch2, cv::Size(matSketch2.cols * 0.2, matSketch2.rows * 0.2));
+	cv::Mat matSketch2 = normalizeSketch(matSketch);
 
 	cv::imwrite("test_sketch.jpg", matSketch2);
 
 
 	//
 	// compare the sketch with the shape features extracted from the CGA grammars
-	float min_diff = std::numeric_limits<float>::max();
-	ShapeFeature min_sf;
-
-	for (int i = 0; i < shapeFeatures.size(); ++i) {
-		cv::Mat shapeMat2;
-		cv::resize(shapeFeatures[i].image, shapeMat2, matSketch2.size());
-
-		cv::Mat matDiff;
-		cv::absdiff(shapeMat2, matSketch2, matDiff);
-		float diff = cvutils::mat_sum(matDiff);// / cvutils::mat_sum(shapeMat2);
-
-		if (diff < min_diff) {
-			min_diff = diff;
-			min_sf = shapeFeatures[i];
-		}
-	}
+	float min_diff;
+	int min_index = findClosestShapeFeature(matSketch2, shapeFeatures, min_diff);
+	if (min_index < 0) return;
+	const ShapeFeature& min_sf = shapeFeatures[min_index];
 
 	cv::imwrite("test_matched.jpg", min_sf.image);
 
 
 
+	proposalWorker.cancel();
 	renderManager.removeObjects();
 
 	std::vector<Vertex> vertices;
@@ -459,17 +485,31 @@ void GLWidget3D::findMatchingRule() {
 
 
 	try {
-		cga::parseRules(min_sf.cga_filename, cga_system.ruleSet);
+		// 同じルールは何度もマッチするので、キャッシュのルールをbaseとし、attrだけ上書きする
+		cga_system.ruleSet.clear();
+		// (読み込み時に、axiomから到達できないルールは除かれ、再帰しているルールは警告される)
+		cga_system.ruleSet.base = cga_system.ruleCache.load(min_sf.cga_filename, cga_system.axiom->_name);
 
 		// set parameter values
+		// axiom以下のderivationで参照されないattrは、結果に影響しないので警告する
+		cga::RuleGraph graph;
+		graph.analyze(*cga_system.ruleSet.base, cga_system.axiom->_name);
 		for (auto it = min_sf.attrs.begin(); it != min_sf.attrs.end(); ++it) {
+			if (!graph.dependsOn(cga_system.axiom->_name, it->first)) {
+				std::cout << "Warning: attr " << it->first << " is not used by " << min_sf.cga_filename << std::endl;
+			}
 			cga_system.ruleSet.attrs[it->first] = it->second;
 		}
 
 		cga_system.generate();
-		cga_system.render(&renderManager, true);
+		if (!cga_system.truncationMessage.empty()) {
+			std::cout << "WARNING: " << cga_system.truncationMessage << std::endl;
+		}
+		cga_system.render(&renderSink, true);
 	} catch (const char* ex) {
 		std::cout << "ERROR:" << std::endl << ex << std::endl;
+	} catch (const std::string& ex) {
+		std::cout << "ERROR:" << std::endl << ex << std::endl;
 	}
 
 	camera.yrot = min_sf.yaw_angle;
@@ -485,6 +525,7 @@ void GLWidget3D::resizeGL(int width, int height) {
 	height = height ? height : 1;
 	glViewport(0, 0, width, height);
 	camera.updatePMatrix(width, height);
+	renderManager.resize(width, height);
 }
 
 void GLWidget3D::mousePressEvent(QMouseEvent *e) {
@@ -529,9 +570,10 @@ void GLWidget3D::mouseMoveEvent(QMouseEvent *e) {
 }
 
 void GLWidget3D::initializeGL() {
-	renderManager.init("../shaders/vertex.glsl", "../shaders/geometry.glsl", "../shaders/fragment.glsl", 8192);
+	renderManager.init("../shaders/vertex_barycentric.glsl", "", "../shaders/fragment.glsl", 2048, GL_DEPTH_COMPONENT24, 4);
 	showWireframe = true;
 	showScopeCoordinateSystem = false;
+	showPassTimings = false;
 
 	std::vector<Vertex> vertices;
 	glm::mat4 mat = glm::translate(glm::mat4(), glm::vec3(0, -1, 0));
@@ -548,8 +590,10 @@ void GLWidget3D::initializeGL() {
 	/*
 	try {
 		cga::parseRules("../cga/simpleMass.xml", cga_system.ruleSet);
+		cga::RuleGraph graph;
+		graph.check(cga_system.ruleSet, cga_system.axiom->_name, "../cga/simpleMass.xml", std::cout);
 		cga_system.generate();
-		cga_system.render(&renderManager, true);
+		cga_system.render(&renderSink, true);
 	} catch (const char* ex) {
 		std::cout << "ERROR:" << std::endl << ex << std::endl;
 	}
@@ -564,11 +608,27 @@ void GLWidget3D::paintEvent(QPaintEvent *event) {
 	// OpenGLで描画
 	makeCurrent();
 
+	// 各パスの時間を計測する (フレーム全体は、他のパスを含むのでCPU時間だけ)
+	renderManager.timer.beginFrame();
+	PassTimerScope frameScope(renderManager.timer, "frame", false);
+
 	glMatrixMode(GL_MODELVIEW);
 	glPushMatrix();
 
 	glUseProgram(renderManager.program);
 
+	// バックグラウンドでデコードが終わったテクスチャを転送する
+	// まだデコード中のものがあれば、少し後に再描画する
+	if (renderManager.processTextureUploads()) {
+		QTimer::singleShot(30, this, SLOT(update()));
+	}
+
+	// バックグラウンドで生成が終わった提案を登録する
+	// まだ生成中なら、少し後に再描画する
+	if (receiveProposal()) {
+		QTimer::singleShot(30, this, SLOT(update()));
+	}
+
 	glClearColor(1, 1, 1, 0);
 	//glClearColor(0.443, 0.439, 0.458, 0.0);
 
@@ -581,12 +641,15 @@ void GLWidget3D::paintEvent(QPaintEvent *event) {
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	// Model view projection行列をシェーダに渡す
-	glUniformMatrix4fv(glGetUniformLocation(renderManager.program, "mvpMatrix"),  1, GL_FALSE, &camera.mvpMatrix[0][0]);
-	glUniformMatrix4fv(glGetUniformLocation(renderManager.program, "mvMatrix"),  1, GL_FALSE, &camera.mvMatrix[0][0]);
+	renderManager.setMatrices(camera.mvpMatrix, camera.mvMatrix);
 
-	// pass the light direction to the shader
-	//glUniform1fv(glGetUniformLocation(renderManager.program, "lightDir"), 3, &light_dir[0]);
-	glUniform3f(glGetUniformLocation(renderManager.program, "lightDir"), light_dir.x, light_dir.y, light_dir.z);
+	// 画面上のサイズに応じて、描画するLODを選択
+	renderManager.updateLOD(camera.mvpMatrix, height());
+
+	// カメラの視錐台に合わせたカスケードシャドウマップを、変わったものだけ作り直す
+	// (光の方向と光源行列もここでシェーダに渡す)
+	renderManager.updateShadowMap(this, light_dir, camera);
+	light_mvpMatrix = renderManager.shadow.light_mvpMatrices[0];
 	
 	drawScene(0);
 
@@ -600,6 +663,7 @@ void GLWidget3D::paintEvent(QPaintEvent *event) {
 	glPopMatrix();
 
 	// QPainterで描画
+	renderManager.timer.begin("overlay");
 	QPainter painter(this);
 	painter.setPen(QPen(QColor(0, 0, 0)));
 	painter.setOpacity(0.5);
@@ -613,7 +677,11 @@ void GLWidget3D::paintEvent(QPaintEvent *event) {
 			painter.drawLine(currentStroke->points[k].x, currentStroke->points[k].y, currentStroke->points[k+1].x, currentStroke->points[k+1].y);
 		}
 	}
+	if (showPassTimings) {
+		renderManager.timer.drawOverlay(painter, 10, 10);
+	}
 	painter.end();
+	renderManager.timer.end("overlay");
 
 	glEnable(GL_DEPTH_TEST);
 }
@@ -2,6 +2,8 @@
 #define GLWIDGET_H
 
 #include "RenderManager.h"
+#include "RenderManagerSink.h"
+#include "ProposalWorker.h"
 #include <QPen>
 #include <QGLWidget>
 #include "CGA.h"
@@ -23,10 +25,13 @@ public:
 	glm::vec3 light_dir;
 	glm::mat4 light_mvpMatrix;
 	RenderManager renderManager;
+	RenderManagerSink renderSink;
 	bool showWireframe;
 	bool showScopeCoordinateSystem;
+	bool showPassTimings;
 
 	cga::CGA cga_system;
+	ProposalWorker proposalWorker;
 	int sketch_step;
 
 	bool ctrlPressed;
@@ -45,6 +50,7 @@ public:
 	void drawLineTo(const QPoint &endPoint);
 
 	void inferRuleFromSketch();
+	bool receiveProposal();
 	glm::vec3 unprojectByPlane(const glm::vec2& point, const glm::vec3& face_point, const glm::vec3& face_normal);
 	glm::vec3 unprojectByLine(const glm::vec2& point, const glm::vec3& reference_point, const glm::vec3& vec);
 	glm::vec2 normalizeScreenCoordinates(const glm::vec2& point);
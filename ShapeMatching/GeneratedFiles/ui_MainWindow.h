@@ -49,9 +49,13 @@ public:
     QAction *actionStepFloor;
     QAction *actionStepWindow;
     QAction *actionViewWireFrame;
+    QAction *actionViewPassTimings;
+    QAction *actionSavePassTimings;
     QAction *actionAnalyzeRules;
     QAction *actionFindMatchingRule;
     QAction *actionClear3DModel;
+    QAction *actionRecordProfile;
+    QAction *actionSaveProfileTrace;
     QWidget *centralWidget;
     QMenuBar *menuBar;
     QMenu *menuFile;
@@ -121,12 +125,22 @@ public:
         actionViewWireFrame = new QAction(MainWindowClass);
         actionViewWireFrame->setObjectName(QString::fromUtf8("actionViewWireFrame"));
         actionViewWireFrame->setCheckable(true);
+        actionViewPassTimings = new QAction(MainWindowClass);
+        actionViewPassTimings->setObjectName(QString::fromUtf8("actionViewPassTimings"));
+        actionViewPassTimings->setCheckable(true);
+        actionSavePassTimings = new QAction(MainWindowClass);
+        actionSavePassTimings->setObjectName(QString::fromUtf8("actionSavePassTimings"));
         actionAnalyzeRules = new QAction(MainWindowClass);
         actionAnalyzeRules->setObjectName(QString::fromUtf8("actionAnalyzeRules"));
         actionFindMatchingRule = new QAction(MainWindowClass);
         actionFindMatchingRule->setObjectName(QString::fromUtf8("actionFindMatchingRule"));
         actionClear3DModel = new QAction(MainWindowClass);
         actionClear3DModel->setObjectName(QString::fromUtf8("actionClear3DModel"));
+        actionRecordProfile = new QAction(MainWindowClass);
+        actionRecordProfile->setObjectName(QString::fromUtf8("actionRecordProfile"));
+        actionRecordProfile->setCheckable(true);
+        actionSaveProfileTrace = new QAction(MainWindowClass);
+        actionSaveProfileTrace->setObjectName(QString::fromUtf8("actionSaveProfileTrace"));
         centralWidget = new QWidget(MainWindowClass);
         centralWidget->setObjectName(QString::fromUtf8("centralWidget"));
         MainWindowClass->setCentralWidget(centralWidget);
@@ -166,8 +180,14 @@ public:
         menuStep->addAction(actionStepFloor);
         menuStep->addAction(actionStepWindow);
         menuView->addAction(actionViewWireFrame);
+        menuView->addSeparator();
+        menuView->addAction(actionViewPassTimings);
+        menuView->addAction(actionSavePassTimings);
         menuTest->addAction(actionAnalyzeRules);
         menuTest->addAction(actionFindMatchingRule);
+        menuTest->addSeparator();
+        menuTest->addAction(actionRecordProfile);
+        menuTest->addAction(actionSaveProfileTrace);
 
         retranslateUi(MainWindowClass);
 
@@ -207,11 +227,17 @@ public:
         actionStepWindow->setText(QApplication::translate("MainWindowClass", "Window", 0, QApplication::UnicodeUTF8));
         actionViewWireFrame->setText(QApplication::translate("MainWindowClass", "WireFrame", 0, QApplication::UnicodeUTF8));
         actionViewWireFrame->setShortcut(QApplication::translate("MainWindowClass", "W", 0, QApplication::UnicodeUTF8));
+        actionViewPassTimings->setText(QApplication::translate("MainWindowClass", "Pass Timings", 0, QApplication::UnicodeUTF8));
+        actionViewPassTimings->setShortcut(QApplication::translate("MainWindowClass", "T", 0, QApplication::UnicodeUTF8));
+        actionSavePassTimings->setText(QApplication::translate("MainWindowClass", "Save Pass Timings...", 0, QApplication::UnicodeUTF8));
         actionAnalyzeRules->setText(QApplication::translate("MainWindowClass", "Analyze Rules", 0, QApplication::UnicodeUTF8));
         actionAnalyzeRules->setShortcut(QApplication::translate("MainWindowClass", "Ctrl+R", 0, QApplication::UnicodeUTF8));
         actionFindMatchingRule->setText(QApplication::translate("MainWindowClass", "Find Matching Rule", 0, QApplication::UnicodeUTF8));
         actionFindMatchingRule->setShortcut(QApplication::translate("MainWindowClass", "Ctrl+M", 0, QApplication::UnicodeUTF8));
         actionClear3DModel->setText(QApplication::translate("MainWindowClass", "Clear 3D Model", 0, QApplication::UnicodeUTF8));
+        actionRecordProfile->setText(QApplication::translate("MainWindowClass", "Record Profile", 0, QApplication::UnicodeUTF8));
+        actionRecordProfile->setShortcut(QApplication::translate("MainWindowClass", "Ctrl+P", 0, QApplication::UnicodeUTF8));
+        actionSaveProfileTrace->setText(QApplication::translate("MainWindowClass", "Save Profile Trace...", 0, QApplication::UnicodeUTF8));
         menuFile->setTitle(QApplication::translate("MainWindowClass", "&File", 0, QApplication::UnicodeUTF8));
         menuStep->setTitle(QApplication::translate("MainWindowClass", "Step", 0, QApplication::UnicodeUTF8));
         menuView->setTitle(QApplication::translate("MainWindowClass", "View", 0, QApplication::UnicodeUTF8));
@@ -0,0 +1,47 @@
+#include "GeometryBuffer.h"
+
+void GeometryBuffer::addObject(const std::string& object_name, const std::string& texture_file, const std::vector<Vertex>& vertices) {
+	// shape毎に呼ばれるので、最後のremoveObject()等の後に、同じobjectとテクスチャへの追加があれば、頂点を連結する
+	// (追加同士の順序は、描画の結果に影響しない)
+	for (int i = (int)commands.size() - 1; i >= 0 && commands[i].type == COMMAND_ADD; --i) {
+		if (commands[i].object_name == object_name && commands[i].texture_file == texture_file) {
+			commands[i].vertices.insert(commands[i].vertices.end(), vertices.begin(), vertices.end());
+			return;
+		}
+	}
+
+	commands.push_back(Command(COMMAND_ADD, object_name));
+	commands.back().texture_file = texture_file;
+	commands.back().vertices = vertices;
+}
+
+void GeometryBuffer::removeObject(const std::string& object_name) {
+	commands.push_back(Command(COMMAND_REMOVE, object_name));
+}
+
+void GeometryBuffer::setTranslucent(const std::string& object_name, bool translucent) {
+	commands.push_back(Command(COMMAND_TRANSLUCENT, object_name));
+	commands.back().translucent = translucent;
+}
+
+void GeometryBuffer::clear() {
+	commands.clear();
+}
+
+/**
+ * 記録した呼び出しを、同じ順に指定されたsinkへ渡す。
+ *
+ * @param sink		渡し先
+ */
+void GeometryBuffer::replay(cga::GeometrySink* sink) const {
+	for (int i = 0; i < commands.size(); ++i) {
+		const Command& command = commands[i];
+		if (command.type == COMMAND_ADD) {
+			sink->addObject(command.object_name, command.texture_file, command.vertices);
+		} else if (command.type == COMMAND_REMOVE) {
+			sink->removeObject(command.object_name);
+		} else {
+			sink->setTranslucent(command.object_name, command.translucent);
+		}
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "GeometrySink.h"
+
+/**
+ * sinkへの呼び出しを記録しておき、後で別のsinkに同じ順に渡し直すsink。
+ * RenderManagerはGLのスレッドでしか使えないので、別のスレッドで作成したジオメトリは、
+ * 一旦ここに溜めて、GLのスレッドでreplay()する。
+ * 同じobjectへのaddObject()は、間にremoveObject()等が無ければ、1回分にまとめる。
+ */
+class GeometryBuffer : public cga::GeometrySink {
+public:
+	static enum { COMMAND_ADD = 0, COMMAND_REMOVE, COMMAND_TRANSLUCENT };
+
+	class Command {
+	public:
+		int type;
+		std::string object_name;
+		std::string texture_file;
+		std::vector<Vertex> vertices;
+		bool translucent;
+
+	public:
+		Command(int type, const std::string& object_name) : type(type), object_name(object_name), translucent(false) {}
+	};
+
+public:
+	std::vector<Command> commands;
+
+public:
+	GeometryBuffer() {}
+
+	void addObject(const std::string& object_name, const std::string& texture_file, const std::vector<Vertex>& vertices);
+	void removeObject(const std::string& object_name);
+	void setTranslucent(const std::string& object_name, bool translucent);
+
+	void clear();
+	void replay(cga::GeometrySink* sink) const;
+};
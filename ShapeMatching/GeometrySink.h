@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Vertex.h"
+
+namespace cga {
+
+/**
+ * derivationの結果のジオメトリを受け取るインタフェース。
+ * CGA::render()やShape::render()は、三角形の頂点をobject名毎にこのsinkへ渡す。
+ * GUIではRenderManagerに登録し、バッチ処理ではファイルに書き出すなど、
+ * CGAのコアはOpenGLやGUIに依存しない。
+ */
+class GeometrySink {
+public:
+	virtual ~GeometrySink() {}
+
+	/**
+	 * 三角形のリストを、指定されたobjectに追加する。
+	 *
+	 * @param object_name		object名
+	 * @param texture_file		テクスチャファイル名 (テクスチャを使わない場合は空)
+	 * @param vertices			頂点 (3つで1つの三角形)
+	 */
+	virtual void addObject(const std::string& object_name, const std::string& texture_file, const std::vector<Vertex>& vertices) = 0;
+
+	/**
+	 * 指定されたobjectを削除する。
+	 */
+	virtual void removeObject(const std::string& object_name) = 0;
+
+	/**
+	 * 半透明で描画するobjectを指定する。描画しないsinkは無視してよい。
+	 */
+	virtual void setTranslucent(const std::string& object_name, bool translucent) {}
+
+	/**
+	 * 同じジオメトリの詳細から粗い順のLODを、1つのグループとして登録する。描画しないsinkは無視してよい。
+	 */
+	virtual void setLODGroup(const std::string& group_name, const std::vector<std::string>& level_names) {}
+};
+
+}
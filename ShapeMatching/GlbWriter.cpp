@@ -0,0 +1,251 @@
+#include "GlbWriter.h"
+#include <cstdio>
+#include <sstream>
+#include <map>
+#include <algorithm>
+
+namespace cga {
+
+namespace {
+
+const unsigned int GLB_MAGIC = 0x46546C67;		// "glTF"
+const unsigned int GLB_VERSION = 2;
+const unsigned int CHUNK_JSON = 0x4E4F534A;		// "JSON"
+const unsigned int CHUNK_BIN = 0x004E4942;		// "BIN\0"
+
+const int GL_FLOAT_ = 5126;
+const int GL_ARRAY_BUFFER_ = 34962;
+const int GL_TRIANGLES_ = 4;
+
+// glTFはリトルエンディアンなので、x86ではそのまま書き出せる
+void writeUInt32(std::ostream& out, unsigned int value) {
+	out.write((const char*)&value, 4);
+}
+
+void writeFloats(std::ostream& out, const float* values, int num) {
+	out.write((const char*)values, num * 4);
+}
+
+void writeEscaped(std::ostream& out, const std::string& str) {
+	for (int i = 0; i < str.size(); ++i) {
+		char c = str[i];
+		if (c == '"' || c == '\\') {
+			out << '\\' << c;
+		} else if ((unsigned char)c < 0x20) {
+			out << ' ';
+		} else {
+			out << c;
+		}
+	}
+}
+
+void writeAccessor(std::ostream& out, int bufferView, int byteOffset, int count, const char* type) {
+	out << "{\"bufferView\":" << bufferView << ",\"byteOffset\":" << byteOffset << ",\"componentType\":" << GL_FLOAT_ << ",\"count\":" << count << ",\"type\":\"" << type << "\"";
+}
+
+}
+
+GlbWriter::GlbWriter() : numVertices(0), numTriangles(0) {
+}
+
+GlbWriter::~GlbWriter() {
+	close();
+}
+
+/**
+ * GLBファイルの書き出しを開始する。
+ * 頂点は、close()までfilename + ".tmp"に書き出す。
+ *
+ * @param filename		ファイル名
+ * @return				開けたらtrue
+ */
+bool GlbWriter::open(const std::string& filename) {
+	close();
+
+	this->filename = filename;
+	tmp_filename = filename + ".tmp";
+
+	tmp.open(tmp_filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!tmp.is_open()) return false;
+
+	// MSVCのfilebufは、open()の前に指定したバッファを無視するので、開いた後、書き込む前に指定する
+	buffer.resize(BUFFER_SIZE);
+	tmp.rdbuf()->pubsetbuf(&buffer[0], buffer.size());
+
+	numVertices = 0;
+	numTriangles = 0;
+	runs.clear();
+
+	return true;
+}
+
+/**
+ * JSONと一時ファイルの頂点を、GLBファイルにまとめて書き出し、一時ファイルを削除する。
+ *
+ * @return				書き出せたらtrue
+ */
+bool GlbWriter::close() {
+	if (!tmp.is_open()) return false;
+
+	tmp.close();
+	bool ok = !tmp.fail();
+	tmp.clear();
+
+	if (ok) {
+		std::string json = createJSON();
+
+		// チャンクの長さは4バイト境界に揃える (JSONは空白、バイナリは0で埋める)
+		while (json.size() % 4 != 0) json += ' ';
+		unsigned int binLength = numVertices * VERTEX_STRIDE;
+		unsigned int totalLength = 12 + 8 + json.size() + (binLength > 0 ? 8 + binLength : 0);
+
+		std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		std::ifstream in(tmp_filename.c_str(), std::ios::in | std::ios::binary);
+		ok = out.is_open() && in.is_open();
+		if (ok) {
+			writeUInt32(out, GLB_MAGIC);
+			writeUInt32(out, GLB_VERSION);
+			writeUInt32(out, totalLength);
+
+			writeUInt32(out, json.size());
+			writeUInt32(out, CHUNK_JSON);
+			out.write(json.data(), json.size());
+
+			if (binLength > 0) {
+				writeUInt32(out, binLength);
+				writeUInt32(out, CHUNK_BIN);
+
+				// 一時ファイルの内容を、バッファ1つ分ずつ連結する
+				buffer.resize(BUFFER_SIZE);
+				while (in) {
+					in.read(&buffer[0], buffer.size());
+					out.write(&buffer[0], in.gcount());
+				}
+			}
+			ok = !out.fail();
+		}
+	}
+
+	std::remove(tmp_filename.c_str());
+	runs.clear();
+
+	return ok;
+}
+
+/**
+ * 三角形のリストを、一時ファイルに書き出す。
+ * 直前と同じobject名なら、同じprimitiveに追加する。
+ */
+void GlbWriter::addObject(const std::string& object_name, const std::string& texture_file, const std::vector<Vertex>& vertices) {
+	int num = vertices.size() / 3 * 3;
+	if (!tmp.is_open() || num == 0) return;
+
+	if (runs.empty() || runs.back().object_name != object_name) {
+		Run run;
+		run.object_name = object_name;
+		run.first = numVertices;
+		run.count = 0;
+		run.minPt = vertices[0].position;
+		run.maxPt = vertices[0].position;
+		runs.push_back(run);
+	}
+	Run& run = runs.back();
+
+	for (int i = 0; i < num; ++i) {
+		const Vertex& v = vertices[i];
+		writeFloats(tmp, &v.position.x, 3);
+		writeFloats(tmp, &v.normal.x, 3);
+		writeFloats(tmp, &v.color.x, 4);
+		writeFloats(tmp, &v.texCoord.x, 2);
+
+		run.minPt = glm::min(run.minPt, v.position);
+		run.maxPt = glm::max(run.maxPt, v.position);
+	}
+
+	run.count += num;
+	numVertices += num;
+	numTriangles += num / 3;
+}
+
+/**
+ * glTFのJSONを作成する。
+ * object名毎に1つのmeshとnodeを作り、runをそのmeshのprimitiveとする。
+ * 各runは、インタリーブした頂点の1つのbufferViewと、属性毎のaccessorを持つ。
+ */
+std::string GlbWriter::createJSON() const {
+	std::vector<std::string> mesh_names;
+	std::map<std::string, std::vector<int> > mesh_runs;
+	for (int i = 0; i < runs.size(); ++i) {
+		if (mesh_runs.find(runs[i].object_name) == mesh_runs.end()) {
+			mesh_names.push_back(runs[i].object_name);
+		}
+		mesh_runs[runs[i].object_name].push_back(i);
+	}
+
+	std::stringstream out;
+	out.precision(9);
+	out << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"cga\"},\"scene\":0,\"scenes\":[{\"nodes\":[";
+	for (int i = 0; i < mesh_names.size(); ++i) {
+		if (i > 0) out << ",";
+		out << i;
+	}
+	out << "]}]";
+
+	if (!runs.empty()) {
+		out << ",\"nodes\":[";
+		for (int i = 0; i < mesh_names.size(); ++i) {
+			if (i > 0) out << ",";
+			out << "{\"mesh\":" << i << ",\"name\":\"";
+			writeEscaped(out, mesh_names[i]);
+			out << "\"}";
+		}
+		out << "]";
+
+		out << ",\"meshes\":[";
+		for (int i = 0; i < mesh_names.size(); ++i) {
+			if (i > 0) out << ",";
+			out << "{\"name\":\"";
+			writeEscaped(out, mesh_names[i]);
+			out << "\",\"primitives\":[";
+			const std::vector<int>& indices = mesh_runs[mesh_names[i]];
+			for (int k = 0; k < indices.size(); ++k) {
+				int accessor = indices[k] * 4;
+				if (k > 0) out << ",";
+				out << "{\"attributes\":{\"POSITION\":" << accessor << ",\"NORMAL\":" << accessor + 1 << ",\"COLOR_0\":" << accessor + 2 << ",\"TEXCOORD_0\":" << accessor + 3 << "},\"mode\":" << GL_TRIANGLES_ << "}";
+			}
+			out << "]}";
+		}
+		out << "]";
+
+		out << ",\"buffers\":[{\"byteLength\":" << numVertices * VERTEX_STRIDE << "}]";
+
+		out << ",\"bufferViews\":[";
+		for (int i = 0; i < runs.size(); ++i) {
+			if (i > 0) out << ",";
+			out << "{\"buffer\":0,\"byteOffset\":" << runs[i].first * VERTEX_STRIDE << ",\"byteLength\":" << runs[i].count * VERTEX_STRIDE << ",\"byteStride\":" << VERTEX_STRIDE << ",\"target\":" << GL_ARRAY_BUFFER_ << "}";
+		}
+		out << "]";
+
+		out << ",\"accessors\":[";
+		for (int i = 0; i < runs.size(); ++i) {
+			const Run& run = runs[i];
+			if (i > 0) out << ",";
+			writeAccessor(out, i, 0, run.count, "VEC3");
+			out << ",\"min\":[" << run.minPt.x << "," << run.minPt.y << "," << run.minPt.z << "]";
+			out << ",\"max\":[" << run.maxPt.x << "," << run.maxPt.y << "," << run.maxPt.z << "]},";
+			writeAccessor(out, i, 12, run.count, "VEC3");
+			out << "},";
+			writeAccessor(out, i, 24, run.count, "VEC4");
+			out << "},";
+			writeAccessor(out, i, 40, run.count, "VEC2");
+			out << "}";
+		}
+		out << "]";
+	}
+
+	out << "}";
+
+	return out.str();
+}
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "GeometrySink.h"
+
+namespace cga {
+
+/**
+ * 受け取ったジオメトリを、バイナリglTF (GLB) ファイルに書き出すsink。
+ * GLBでは、JSONのヘッダがバイナリデータより前に来るが、その内容は全ての頂点を受け取るまで決まらない。
+ * そこで、頂点は一時ファイルへ書き出しておき、close()でJSONを書いた後に一時ファイルの内容を連結する。
+ * メモリに残すのは、同じobject名が連続する範囲 (run) 毎の頂点数とbounding boxだけである。
+ * 頂点は共有せず、3つで1つの三角形とする。テクスチャは書き出さない。
+ */
+class GlbWriter : public GeometrySink {
+public:
+	static enum { BUFFER_SIZE = 1 << 20 };
+
+	// 1頂点のバイト数 (位置, 法線, 色, テクスチャ座標をインタリーブする)
+	static enum { VERTEX_STRIDE = (3 + 3 + 4 + 2) * 4 };
+
+	int numVertices;
+	int numTriangles;
+
+private:
+	/**
+	 * 同じobject名が連続する頂点の範囲。1つのprimitiveとして書き出す。
+	 */
+	class Run {
+	public:
+		std::string object_name;
+		int first;
+		int count;
+		glm::vec3 minPt;
+		glm::vec3 maxPt;
+	};
+
+	std::string filename;
+	std::string tmp_filename;
+	std::vector<char> buffer;
+	std::ofstream tmp;
+	std::vector<Run> runs;
+
+public:
+	GlbWriter();
+	~GlbWriter();
+
+	bool open(const std::string& filename);
+	bool close();
+	bool isOpen() const { return tmp.is_open(); }
+
+	void addObject(const std::string& object_name, const std::string& texture_file, const std::vector<Vertex>& vertices);
+	void removeObject(const std::string& object_name) {}
+
+private:
+	std::string createJSON() const;
+	GlbWriter(const GlbWriter&);
+	GlbWriter& operator=(const GlbWriter&);
+};
+
+}
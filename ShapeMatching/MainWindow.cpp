@@ -2,6 +2,8 @@
 #include <QFileDialog>
 #include <QDate>
 #include <time.h>
+#include <iostream>
+#include "Profiler.h"
 
 MainWindow::MainWindow(QWidget *parent, Qt::WFlags flags) : QMainWindow(parent, flags) {
 	ui.setupUi(this);
@@ -25,9 +27,13 @@ MainWindow::MainWindow(QWidget *parent, Qt::WFlags flags) : QMainWindow(parent,
 	connect(ui.actionStepFloor, SIGNAL(triggered()), this, SLOT(onStepFloor()));
 	connect(ui.actionStepWindow, SIGNAL(triggered()), this, SLOT(onStepWindow()));
 	connect(ui.actionViewWireFrame, SIGNAL(triggered()), this, SLOT(onViewWireFrame()));
+	connect(ui.actionViewPassTimings, SIGNAL(triggered()), this, SLOT(onViewPassTimings()));
+	connect(ui.actionSavePassTimings, SIGNAL(triggered()), this, SLOT(onSavePassTimings()));
 
 	connect(ui.actionAnalyzeRules, SIGNAL(triggered()), this, SLOT(onAnalyzeRules()));
 	connect(ui.actionFindMatchingRule, SIGNAL(triggered()), this, SLOT(onFindMatchingRule()));
+	connect(ui.actionRecordProfile, SIGNAL(triggered()), this, SLOT(onRecordProfile()));
+	connect(ui.actionSaveProfileTrace, SIGNAL(triggered()), this, SLOT(onSaveProfileTrace()));
 
 	glWidget = new GLWidget3D(this);
 	setCentralWidget(glWidget);
@@ -91,6 +97,20 @@ void MainWindow::onViewWireFrame() {
 	glWidget->update();
 }
 
+void MainWindow::onViewPassTimings() {
+	glWidget->showPassTimings = ui.actionViewPassTimings->isChecked();
+	glWidget->update();
+}
+
+void MainWindow::onSavePassTimings() {
+	QString filename = QFileDialog::getSaveFileName(this, tr("Save pass timings..."), "", tr("CSV Files (*.csv)"));
+	if (filename.isEmpty()) return;
+
+	if (!glWidget->renderManager.timer.saveCSV(filename)) {
+		std::cout << "Error: could not write " << filename.toUtf8().constData() << std::endl;
+	}
+}
+
 void MainWindow::onAnalyzeRules() {
 	glWidget->analyzeRules();
 }
@@ -98,3 +118,20 @@ void MainWindow::onAnalyzeRules() {
 void MainWindow::onFindMatchingRule() {
 	glWidget->findMatchingRule();
 }
+
+void MainWindow::onRecordProfile() {
+	// 記録を始める時は、前回の記録を消す
+	if (ui.actionRecordProfile->isChecked()) {
+		profiler::clear();
+	}
+	profiler::setEnabled(ui.actionRecordProfile->isChecked());
+}
+
+void MainWindow::onSaveProfileTrace() {
+	QString filename = QFileDialog::getSaveFileName(this, tr("Save profile trace..."), "", tr("Trace Files (*.json)"));
+	if (filename.isEmpty()) return;
+
+	if (!profiler::saveChromeTrace(filename.toUtf8().constData())) {
+		std::cout << "Error: could not write " << filename.toUtf8().constData() << std::endl;
+	}
+}
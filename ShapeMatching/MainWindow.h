@@ -30,8 +30,12 @@ public slots:
 	void onStepFloor();
 	void onStepWindow();
 	void onViewWireFrame();
+	void onViewPassTimings();
+	void onSavePassTimings();
 	void onAnalyzeRules();
 	void onFindMatchingRule();
+	void onRecordProfile();
+	void onSaveProfileTrace();
 };
 
 #endif // MAINWINDOW_H
@@ -30,7 +30,7 @@ namespace myeval {
     namespace qi = boost::spirit::qi;
     namespace ascii = boost::spirit::ascii;
 
-	static qi::symbols<char, float> variables;
+    typedef qi::symbols<char, float> variable_table;
 
     ///////////////////////////////////////////////////////////////////////////
     //  Our calculator grammar
@@ -38,7 +38,9 @@ namespace myeval {
     template <typename Iterator>
     struct calculator : qi::grammar<Iterator, float(), ascii::space_type>
     {
-        calculator() : calculator::base_type(expression)
+        //  variables are held by reference, so that each thread can
+        //  evaluate with its own table.
+        calculator(variable_table& variables) : calculator::base_type(expression)
         {
             using qi::_val;
             using qi::_1;
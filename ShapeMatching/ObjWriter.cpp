@@ -0,0 +1,85 @@
+#include "ObjWriter.h"
+
+namespace cga {
+
+ObjWriter::ObjWriter() : numVertices(0), numTriangles(0) {
+}
+
+ObjWriter::~ObjWriter() {
+	close();
+}
+
+/**
+ * OBJファイルを開く。
+ *
+ * @param filename		ファイル名
+ * @return				開けたらtrue
+ */
+bool ObjWriter::open(const std::string& filename) {
+	close();
+
+	out.open(filename.c_str());
+	if (!out.is_open()) return false;
+
+	// 細かい書き込みが多いので、大きめのバッファを使う
+	// (MSVCのfilebufは、open()の前に指定したバッファを無視するので、開いた後、書き込む前に指定する)
+	buffer.resize(BUFFER_SIZE);
+	out.rdbuf()->pubsetbuf(&buffer[0], buffer.size());
+
+	// 都市規模の座標でも、cm単位まで書き出す (デフォルトの6桁では、m単位に丸められてしまう)
+	out.precision(9);
+
+	numVertices = 0;
+	numTriangles = 0;
+	current_group.clear();
+
+	return true;
+}
+
+/**
+ * OBJファイルを閉じる。
+ *
+ * @return				最後まで書き出せたらtrue
+ */
+bool ObjWriter::close() {
+	if (!out.is_open()) return false;
+
+	out.close();
+	bool ok = !out.fail();
+	out.clear();
+
+	return ok;
+}
+
+/**
+ * 三角形のリストを書き出す。
+ * 各頂点について、位置、法線、テクスチャ座標を1つずつ書き出すので、頂点は共有しない。
+ */
+void ObjWriter::addObject(const std::string& object_name, const std::string& texture_file, const std::vector<Vertex>& vertices) {
+	if (!out.is_open() || vertices.empty()) return;
+
+	if (object_name != current_group) {
+		out << "g " << object_name << "\n";
+		current_group = object_name;
+	}
+
+	for (int i = 0; i < vertices.size(); ++i) {
+		const Vertex& v = vertices[i];
+		out << "v " << v.position.x << " " << v.position.y << " " << v.position.z << "\n";
+		out << "vn " << v.normal.x << " " << v.normal.y << " " << v.normal.z << "\n";
+		out << "vt " << v.texCoord.x << " " << v.texCoord.y << "\n";
+	}
+
+	// OBJのインデックスは1から始まる
+	for (int i = 0; i + 2 < vertices.size(); i += 3) {
+		int i1 = numVertices + i + 1;
+		int i2 = i1 + 1;
+		int i3 = i1 + 2;
+		out << "f " << i1 << "/" << i1 << "/" << i1 << " " << i2 << "/" << i2 << "/" << i2 << " " << i3 << "/" << i3 << "/" << i3 << "\n";
+		numTriangles++;
+	}
+
+	numVertices += vertices.size();
+}
+
+}
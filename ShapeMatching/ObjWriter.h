@@ -0,0 +1,43 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "GeometrySink.h"
+
+namespace cga {
+
+/**
+ * 受け取ったジオメトリを、そのままOBJファイルに書き出すsink。
+ * 頂点は溜め込まずに、addObject()の度にファイルへ書き出す。
+ * object名が変わる度に、OBJのグループを切り替える。
+ */
+class ObjWriter : public GeometrySink {
+public:
+	static enum { BUFFER_SIZE = 1 << 20 };
+
+	int numVertices;
+	int numTriangles;
+
+private:
+	std::vector<char> buffer;
+	std::ofstream out;
+	std::string current_group;
+
+public:
+	ObjWriter();
+	~ObjWriter();
+
+	bool open(const std::string& filename);
+	bool close();
+	bool isOpen() const { return out.is_open(); }
+
+	void addObject(const std::string& object_name, const std::string& texture_file, const std::vector<Vertex>& vertices);
+	void removeObject(const std::string& object_name) {}
+
+private:
+	ObjWriter(const ObjWriter&);
+	ObjWriter& operator=(const ObjWriter&);
+};
+
+}
@@ -0,0 +1,216 @@
+#include "PassTimer.h"
+#include <QPainter>
+#include <QFile>
+#include <QTextStream>
+#include <algorithm>
+
+void TimingHistory::push(float value) {
+	if (samples.size() < HISTORY_SIZE) {
+		samples.push_back(value);
+	} else {
+		samples[next] = value;
+	}
+	next = (next + 1) % HISTORY_SIZE;
+}
+
+/**
+ * 古い順にindex番目の計測値を返す。
+ */
+float TimingHistory::at(int index) const {
+	if (samples.size() < HISTORY_SIZE) return samples[index];
+	return samples[(next + index) % HISTORY_SIZE];
+}
+
+float TimingHistory::average() const {
+	if (samples.empty()) return 0.0f;
+
+	float total = 0.0f;
+	for (int i = 0; i < samples.size(); ++i) {
+		total += samples[i];
+	}
+	return total / samples.size();
+}
+
+float TimingHistory::maximum() const {
+	float result = 0.0f;
+	for (int i = 0; i < samples.size(); ++i) {
+		result = (std::max)(result, samples[i]);
+	}
+	return result;
+}
+
+PassTiming::PassTiming() {
+	for (int i = 0; i < NUM_QUERY_FRAMES; ++i) {
+		queries[i] = 0;
+		queryIssued[i] = false;
+	}
+	gpuUsedThisFrame = false;
+	usedThisFrame = false;
+	nesting = 0;
+	cpuThisFrame = 0.0;
+}
+
+PassTimer::PassTimer() {
+	enabled = true;
+	gpuTimerSupported = false;
+	frameIndex = 0;
+}
+
+/**
+ * GPUのタイマクエリが使えるか調べる。
+ * 本関数は、glewInit()の後に呼び出すこと。
+ */
+void PassTimer::init() {
+	gpuTimerSupported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+}
+
+/**
+ * 新しいフレームの計測を開始する。
+ * 前のフレームのCPU時間を確定し、結果が返ってきたGPUのクエリを回収する。
+ */
+void PassTimer::beginFrame() {
+	if (!enabled) return;
+
+	frameIndex++;
+	int slot = frameIndex % PassTiming::NUM_QUERY_FRAMES;
+
+	for (auto it = passes.begin(); it != passes.end(); ++it) {
+		PassTiming& pass = it.value();
+		if (pass.usedThisFrame) {
+			pass.cpu.push(pass.cpuThisFrame);
+		}
+		pass.cpuThisFrame = 0.0;
+		pass.usedThisFrame = false;
+		pass.gpuUsedThisFrame = false;
+
+		collectQueries(pass, slot);
+	}
+}
+
+/**
+ * パスの計測を開始する。
+ *
+ * @param pass_name		パス名
+ * @param measureGPU	GPU時間も測るか (フレーム全体のように、他のパスを含むものはfalseにする)
+ */
+void PassTimer::begin(const QString& pass_name, bool measureGPU) {
+	if (!enabled) return;
+
+	if (!passes.contains(pass_name)) {
+		passOrder.push_back(pass_name);
+		PassTiming& pass = passes[pass_name];
+		pass.name = pass_name;
+		if (gpuTimerSupported) {
+			glGenQueries(PassTiming::NUM_QUERY_FRAMES, pass.queries);
+		}
+	}
+
+	PassTiming& pass = passes[pass_name];
+	if (pass.nesting++ > 0) return;
+
+	pass.cpuTimer.start();
+
+	if (measureGPU && gpuTimerSupported && activeGpuPass.isEmpty() && !pass.gpuUsedThisFrame) {
+		int slot = frameIndex % PassTiming::NUM_QUERY_FRAMES;
+		glBeginQuery(GL_TIME_ELAPSED, pass.queries[slot]);
+		activeGpuPass = pass_name;
+		pass.gpuUsedThisFrame = true;
+	}
+}
+
+/**
+ * パスの計測を終了する。
+ */
+void PassTimer::end(const QString& pass_name) {
+	if (!enabled || !passes.contains(pass_name)) return;
+
+	PassTiming& pass = passes[pass_name];
+	if (pass.nesting == 0 || --pass.nesting > 0) return;
+
+	pass.cpuThisFrame += pass.cpuTimer.nsecsElapsed() * 1.0e-6;
+	pass.usedThisFrame = true;
+
+	if (activeGpuPass == pass_name) {
+		int slot = frameIndex % PassTiming::NUM_QUERY_FRAMES;
+		glEndQuery(GL_TIME_ELAPSED);
+		pass.queryIssued[slot] = true;
+		activeGpuPass.clear();
+	}
+}
+
+/**
+ * 各パスの直近の平均と最大の時間を、画面に表示する。
+ *
+ * @param painter		QPainter
+ * @param x				左上のx座標
+ * @param y				左上のy座標
+ */
+void PassTimer::drawOverlay(QPainter& painter, int x, int y) const {
+	QFont font("Courier New", 9);
+	painter.setFont(font);
+	int lineHeight = painter.fontMetrics().height();
+
+	painter.setOpacity(0.7);
+	painter.fillRect(x, y, 460, lineHeight * (passOrder.size() + 1) + 6, QColor(255, 255, 255));
+	painter.setOpacity(1.0);
+	painter.setPen(QPen(QColor(0, 0, 0)));
+
+	painter.drawText(x + 4, y + lineHeight, QString("%1 %2 %3").arg("pass", -14).arg("cpu avg/max [ms]", -20).arg(gpuTimerSupported ? "gpu avg/max [ms]" : "gpu n/a"));
+	for (int i = 0; i < passOrder.size(); ++i) {
+		const PassTiming& pass = passes[passOrder[i]];
+		QString cpuText = QString("%1 / %2").arg(pass.cpu.average(), 6, 'f', 2).arg(pass.cpu.maximum(), 6, 'f', 2);
+		QString gpuText = pass.gpu.size() > 0 ? QString("%1 / %2").arg(pass.gpu.average(), 6, 'f', 2).arg(pass.gpu.maximum(), 6, 'f', 2) : QString("-");
+		painter.drawText(x + 4, y + lineHeight * (i + 2), QString("%1 %2 %3").arg(pass.name, -14).arg(cpuText, -20).arg(gpuText));
+	}
+}
+
+/**
+ * 各パスの直近の計測値を、CSVファイルに保存する。
+ * 1行が1つの計測値で、GPU時間がないものは空欄とする。
+ *
+ * @param filename		ファイル名
+ * @return				保存できたらtrue
+ */
+bool PassTimer::saveCSV(const QString& filename) const {
+	QFile file(filename);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) return false;
+
+	QTextStream out(&file);
+	out << "pass,sample,cpu_ms,gpu_ms\n";
+	for (int i = 0; i < passOrder.size(); ++i) {
+		const PassTiming& pass = passes[passOrder[i]];
+		int num = (std::max)(pass.cpu.size(), pass.gpu.size());
+		for (int k = 0; k < num; ++k) {
+			out << pass.name << "," << k << ",";
+			if (k < pass.cpu.size()) out << pass.cpu.at(k);
+			out << ",";
+			if (k < pass.gpu.size()) out << pass.gpu.at(k);
+			out << "\n";
+		}
+	}
+
+	return true;
+}
+
+/**
+ * 結果が返ってきたクエリを回収する。
+ * これから使い回すスロットの結果がまだ返っていなければ、その計測値は捨てる。
+ */
+void PassTimer::collectQueries(PassTiming& pass, int reusedSlot) {
+	// 使い回すスロットが一番古いので、そこから発行順に調べる
+	for (int i = 0; i < PassTiming::NUM_QUERY_FRAMES; ++i) {
+		int slot = (reusedSlot + i) % PassTiming::NUM_QUERY_FRAMES;
+		if (!pass.queryIssued[slot]) continue;
+
+		GLint available = 0;
+		glGetQueryObjectiv(pass.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(pass.queries[slot], GL_QUERY_RESULT, &elapsed);
+			pass.gpu.push((float)(elapsed * 1.0e-6));
+			pass.queryIssued[slot] = false;
+		} else if (slot == reusedSlot) {
+			pass.queryIssued[slot] = false;
+		}
+	}
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "glew.h"
+#include <vector>
+#include <QMap>
+#include <QString>
+#include <QElapsedTimer>
+
+class QPainter;
+
+/**
+ * 直近HISTORY_SIZE個の計測値 [ms] を保持するリングバッファ。
+ */
+class TimingHistory {
+public:
+	static enum { HISTORY_SIZE = 120 };
+
+	std::vector<float> samples;
+	int next;
+
+public:
+	TimingHistory() : next(0) {}
+
+	void push(float value);
+	int size() const { return samples.size(); }
+	float at(int index) const;
+	float average() const;
+	float maximum() const;
+};
+
+/**
+ * 1つの描画パスの計測状態。
+ * GPU時間はGL_TIME_ELAPSEDのクエリで測り、結果は数フレーム後に回収する。
+ * 同じフレームで何度も呼ばれるパスは、CPU時間は合計し、GPU時間は最初の1回だけ測る。
+ */
+class PassTiming {
+public:
+	static enum { NUM_QUERY_FRAMES = 4 };
+
+	QString name;
+	GLuint queries[NUM_QUERY_FRAMES];
+	bool queryIssued[NUM_QUERY_FRAMES];
+	bool gpuUsedThisFrame;
+	bool usedThisFrame;
+	int nesting;
+	QElapsedTimer cpuTimer;
+	double cpuThisFrame;
+	TimingHistory cpu;
+	TimingHistory gpu;
+
+public:
+	PassTiming();
+};
+
+/**
+ * 描画パス毎のCPU/GPU時間を計測する。
+ * GL_TIME_ELAPSEDのクエリは入れ子にできないので、GPU時間を測っている最中に始まったパス
+ * (例えば、メインの描画中のVBOの転送) は、CPU時間だけを測る。
+ */
+class PassTimer {
+public:
+	bool enabled;
+	bool gpuTimerSupported;
+	int frameIndex;
+	QMap<QString, PassTiming> passes;
+	std::vector<QString> passOrder;
+
+private:
+	QString activeGpuPass;
+
+public:
+	PassTimer();
+
+	void init();
+	void beginFrame();
+	void begin(const QString& pass_name, bool measureGPU = true);
+	void end(const QString& pass_name);
+	void drawOverlay(QPainter& painter, int x, int y) const;
+	bool saveCSV(const QString& filename) const;
+
+private:
+	void collectQueries(PassTiming& pass, int reusedSlot);
+};
+
+/**
+ * スコープの間、指定されたパスを計測する。
+ */
+class PassTimerScope {
+public:
+	PassTimer& timer;
+	QString pass_name;
+
+public:
+	PassTimerScope(PassTimer& timer, const QString& pass_name, bool measureGPU = true) : timer(timer), pass_name(pass_name) {
+		timer.begin(pass_name, measureGPU);
+	}
+	~PassTimerScope() {
+		timer.end(pass_name);
+	}
+
+private:
+	PassTimerScope& operator=(const PassTimerScope&);
+};
+
@@ -0,0 +1,190 @@
+#include "Profiler.h"
+#include <fstream>
+#include <iomanip>
+#include <QElapsedTimer>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/thread/mutex.hpp>
+
+#ifdef _MSC_VER
+#define PROFILER_THREAD_LOCAL __declspec(thread)
+#else
+#define PROFILER_THREAD_LOCAL __thread
+#endif
+
+namespace profiler {
+
+namespace {
+
+volatile bool enabled_ = false;
+
+// スレッド毎のメモリ確保回数 (ProfilerAllocations.cppのoperator newで数える)
+PROFILER_THREAD_LOCAL unsigned int allocations_ = 0;
+
+// 全スレッドのバッファ
+boost::mutex buffersMutex;
+std::vector<boost::shared_ptr<ThreadBuffer> > buffers;
+
+// バッファは全体のリストが所有するので、スレッド終了時には削除しない
+void releaseBuffer(ThreadBuffer*) {}
+boost::thread_specific_ptr<ThreadBuffer> threadBuffer(releaseBuffer);
+
+class Clock {
+public:
+	QElapsedTimer timer;
+
+public:
+	Clock() { timer.start(); }
+	double now() const { return timer.nsecsElapsed() * 1.0e-3; }
+};
+Clock traceClock;
+
+ThreadBuffer* getThreadBuffer() {
+	ThreadBuffer* buffer = threadBuffer.get();
+	if (buffer == NULL) {
+		boost::shared_ptr<ThreadBuffer> newBuffer(new ThreadBuffer());
+
+		boost::mutex::scoped_lock lock(buffersMutex);
+		newBuffer->threadId = buffers.size() + 1;
+		buffers.push_back(newBuffer);
+		buffer = newBuffer.get();
+		threadBuffer.reset(buffer);
+	}
+	return buffer;
+}
+
+void writeEscaped(std::ostream& out, const std::string& str) {
+	for (int i = 0; i < str.size(); ++i) {
+		char c = str[i];
+		if (c == '"' || c == '\\') {
+			out << '\\' << c;
+		} else if ((unsigned char)c < 0x20) {
+			out << ' ';
+		} else {
+			out << c;
+		}
+	}
+}
+
+}
+
+Scope::Scope(const char* category, const char* name) : active(false), category(category) {
+	if (!enabled_) return;
+	this->name = name;
+	begin();
+}
+
+Scope::Scope(const char* category, const std::string& name) : active(false), category(category) {
+	if (!enabled_) return;
+	this->name = name;
+	begin();
+}
+
+void Scope::begin() {
+	active = true;
+	allocations = allocations_;
+	start = traceClock.now();
+}
+
+Scope::~Scope() {
+	if (!active) return;
+
+	double end = traceClock.now();
+	unsigned int allocated = allocations_ - allocations;
+
+	ThreadBuffer* buffer = getThreadBuffer();
+	boost::mutex::scoped_lock lock(buffer->mutex);
+	if (buffer->events.size() >= ThreadBuffer::MAX_EVENTS) {
+		buffer->dropped++;
+		return;
+	}
+
+	buffer->events.push_back(Event());
+	Event& event = buffer->events.back();
+	event.category = category;
+	event.name.swap(name);
+	event.start = start;
+	event.duration = end - start;
+	event.allocations = allocated;
+}
+
+/**
+ * 記録を開始/停止する。
+ */
+void setEnabled(bool enabled) {
+	enabled_ = enabled;
+}
+
+bool isEnabled() {
+	return enabled_;
+}
+
+/**
+ * 全スレッドの記録を消去する。
+ */
+void clear() {
+	boost::mutex::scoped_lock lock(buffersMutex);
+	for (int i = 0; i < buffers.size(); ++i) {
+		boost::mutex::scoped_lock bufferLock(buffers[i]->mutex);
+		buffers[i]->events.clear();
+		buffers[i]->dropped = 0;
+	}
+}
+
+/**
+ * このスレッドで、これまでにoperator newが呼ばれた回数を返す。
+ * 実行ファイルがProfilerAllocations.cppをリンクしていなければ、常に0である。
+ */
+unsigned int allocationCount() {
+	return allocations_;
+}
+
+/**
+ * メモリ確保を1回数える。ProfilerAllocations.cppのoperator newから呼び出す。
+ */
+void countAllocation() {
+	++allocations_;
+}
+
+/**
+ * 全スレッドの記録を、Chromeのtrace event形式のJSONで保存する。
+ * 書き出している間、そのスレッドのバッファへの記録は待たされる。
+ *
+ * @param filename		ファイル名
+ * @return				保存できたらtrue
+ */
+bool saveChromeTrace(const std::string& filename) {
+	std::ofstream out(filename.c_str());
+	if (!out.is_open()) return false;
+
+	out << std::fixed << std::setprecision(3);
+	out << "{\"traceEvents\":[" << std::endl;
+
+	boost::mutex::scoped_lock lock(buffersMutex);
+	bool first = true;
+	for (int i = 0; i < buffers.size(); ++i) {
+		ThreadBuffer& buffer = *buffers[i];
+		boost::mutex::scoped_lock bufferLock(buffer.mutex);
+		for (int k = 0; k < buffer.events.size(); ++k) {
+			const Event& event = buffer.events[k];
+			if (!first) out << "," << std::endl;
+			first = false;
+
+			out << "{\"name\":\"";
+			writeEscaped(out, event.name);
+			out << "\",\"cat\":\"" << event.category << "\",\"ph\":\"X\",\"ts\":" << event.start << ",\"dur\":" << event.duration;
+			out << ",\"pid\":1,\"tid\":" << buffer.threadId << ",\"args\":{\"allocations\":" << event.allocations << "}}";
+		}
+		if (buffer.dropped > 0) {
+			if (!first) out << "," << std::endl;
+			first = false;
+			out << "{\"name\":\"dropped events\",\"ph\":\"i\",\"s\":\"t\",\"ts\":0,\"pid\":1,\"tid\":" << buffer.threadId << ",\"args\":{\"count\":" << buffer.dropped << "}}";
+		}
+	}
+
+	out << std::endl << "],\"displayTimeUnit\":\"ms\"}" << std::endl;
+
+	return true;
+}
+
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+/**
+ * 軽量なCPUプロファイラ。
+ * PROFILE_SCOPEを置いたスコープの開始時刻、経過時間、その間のメモリ確保回数を、
+ * スレッド毎のバッファに記録し、Chromeのtrace event形式 (chrome://tracing) で保存する。
+ * 記録はsetEnabled(true)の間だけ行う。DISABLE_PROFILERを定義すると、マクロは空になる。
+ * メモリ確保回数は、ProfilerAllocations.cppをリンクした実行ファイルでのみ数える。
+ */
+namespace profiler {
+
+class Event {
+public:
+	const char* category;
+	std::string name;
+	double start;		// [us]
+	double duration;	// [us]
+	unsigned int allocations;
+
+public:
+	Event() : category(""), start(0), duration(0), allocations(0) {}
+};
+
+/**
+ * 1つのスレッドの記録。
+ * スレッドが終了しても保存できるよう、バッファは全体のリストが所有する。
+ * 記録中のスレッドがあってもclear()やsaveChromeTrace()を呼べるよう、eventsはmutexで保護する。
+ */
+class ThreadBuffer {
+public:
+	static enum { MAX_EVENTS = 1000000 };
+
+	unsigned int threadId;
+	std::vector<Event> events;
+	unsigned int dropped;
+	boost::mutex mutex;
+
+public:
+	ThreadBuffer() : threadId(0), dropped(0) {}
+};
+
+/**
+ * スコープの間の時間とメモリ確保回数を記録する。
+ */
+class Scope {
+private:
+	bool active;
+	const char* category;
+	std::string name;
+	double start;
+	unsigned int allocations;
+
+public:
+	Scope(const char* category, const char* name);
+	Scope(const char* category, const std::string& name);
+	~Scope();
+
+private:
+	void begin();
+	Scope(const Scope&);
+	Scope& operator=(const Scope&);
+};
+
+void setEnabled(bool enabled);
+bool isEnabled();
+void clear();
+unsigned int allocationCount();
+void countAllocation();
+bool saveChromeTrace(const std::string& filename);
+
+}
+
+#define PROFILER_CONCAT2(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT2(a, b)
+
+#ifndef DISABLE_PROFILER
+#define PROFILE_SCOPE(category, name) profiler::Scope PROFILER_CONCAT(profiler_scope_, __LINE__)(category, name)
+#else
+#define PROFILE_SCOPE(category, name)
+#endif
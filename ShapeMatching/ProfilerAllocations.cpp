@@ -0,0 +1,52 @@
+#include "Profiler.h"
+#include <cstdlib>
+#include <new>
+
+/**
+ * プロファイラでメモリ確保回数を数えるため、グローバルなoperator new/deleteを置き換える。
+ * 置き換えはプロセス全体に影響するので、cga_coreには含めず、
+ * 確保回数を記録したい実行ファイル (ShapeMatching) のプロジェクトにだけ、このファイルを追加する。
+ */
+#ifndef DISABLE_PROFILER
+
+void* operator new(size_t size) {
+	profiler::countAllocation();
+	void* p = malloc(size == 0 ? 1 : size);
+	if (p == NULL) throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size) {
+	profiler::countAllocation();
+	void* p = malloc(size == 0 ? 1 : size);
+	if (p == NULL) throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) throw() {
+	profiler::countAllocation();
+	return malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) throw() {
+	profiler::countAllocation();
+	return malloc(size == 0 ? 1 : size);
+}
+
+void operator delete(void* p) throw() {
+	free(p);
+}
+
+void operator delete[](void* p) throw() {
+	free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) throw() {
+	free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) throw() {
+	free(p);
+}
+
+#endif
@@ -0,0 +1,206 @@
+#include "ProposalWorker.h"
+#include "Profiler.h"
+
+ProposalWorker::ProposalWorker() {
+	stopping = false;
+	generation = 0;
+	receivedGeneration = 0;
+}
+
+ProposalWorker::~ProposalWorker() {
+	stop();
+}
+
+/**
+ * derivation用のスレッドを開始する。
+ */
+void ProposalWorker::start() {
+	stopping = false;
+	thread = boost::thread(boost::bind(&ProposalWorker::run, this));
+}
+
+/**
+ * derivation用のスレッドを停止する。実行中のderivationは中止し、未処理の要求と結果は破棄する。
+ */
+void ProposalWorker::stop() {
+	{
+		boost::lock_guard<boost::mutex> lock(mutex);
+		stopping = true;
+		pendingRequest.reset();
+	}
+	if (cancellationToken) {
+		cancellationToken->cancel();
+	}
+	condition.notify_all();
+	if (thread.joinable()) {
+		thread.join();
+	}
+
+	ProposalResult* result;
+	while (results.pop(result)) {
+		delete result;
+	}
+	receivedGeneration = generation;
+}
+
+/**
+ * 現在の提案のルールで、derivationを要求する。
+ * 実行中の古い提案のderivationは中止し、まだ開始していない古い要求は、この要求で置き換える。
+ *
+ * @param cga		提案のルール (proposedRuleSet) と、axiom、derivationの上限を使う
+ */
+void ProposalWorker::request(const cga::CGA& cga) {
+	if (cancellationToken) {
+		cancellationToken->cancel();
+	}
+	cancellationToken.reset(new cga::CancellationToken());
+
+	boost::shared_ptr<ProposalRequest> newRequest(new ProposalRequest());
+	newRequest->generation = ++generation;
+	newRequest->axiom = cga.axiom;
+	newRequest->lots = cga.lots;
+	newRequest->ruleSet = cga.proposedRuleSet;
+	newRequest->maxShapes = cga.maxShapes;
+	newRequest->maxDepth = cga.maxDepth;
+	newRequest->timeLimit = cga.timeLimit;
+	newRequest->cancellationToken = cancellationToken;
+
+	{
+		boost::lock_guard<boost::mutex> lock(mutex);
+		pendingRequest = newRequest;
+	}
+	condition.notify_all();
+}
+
+/**
+ * 要求済みの提案を全て取り消す。以降、それらの結果はpopResult()で返却しない。
+ * 提案を採用したり、モデルを消去したりした後に、古い提案が表示されないようにするために使う。
+ */
+void ProposalWorker::cancel() {
+	if (cancellationToken) {
+		cancellationToken->cancel();
+		cancellationToken.reset();
+	}
+	{
+		boost::lock_guard<boost::mutex> lock(mutex);
+		pendingRequest.reset();
+	}
+	condition.notify_all();
+	receivedGeneration = ++generation;
+}
+
+/**
+ * 最後に要求した提案の結果を、まだ受け取っていないか。
+ */
+bool ProposalWorker::hasPending() const {
+	return receivedGeneration != generation;
+}
+
+/**
+ * 最後に要求した提案の結果を取り出す。それより古い結果は破棄する。
+ *
+ * @return			結果 (呼び出し側でdeleteすること)。まだ結果が無ければNULL
+ */
+ProposalResult* ProposalWorker::popResult() {
+	ProposalResult* found = NULL;
+	bool popped = false;
+	ProposalResult* result;
+	while (found == NULL && results.pop(result)) {
+		popped = true;
+		if (result->generation == generation) {
+			receivedGeneration = generation;
+			found = result;
+		} else {
+			delete result;
+		}
+	}
+
+	// キューが空くのを待っているderivation用スレッドを起こす
+	// (mutexを取ってから通知するので、待ち始める直前に取り出しても、通知を取りこぼさない)
+	if (popped) {
+		{
+			boost::lock_guard<boost::mutex> lock(mutex);
+		}
+		condition.notify_all();
+	}
+
+	return found;
+}
+
+/**
+ * derivation用スレッドの本体。
+ * derivationの状態 (stackなど) を使い回すため、このスレッド専用のCGAを使う。
+ */
+void ProposalWorker::run() {
+	cga::CGA cga;
+
+	while (true) {
+		boost::shared_ptr<ProposalRequest> currentRequest;
+		{
+			boost::unique_lock<boost::mutex> lock(mutex);
+			while (!stopping && !pendingRequest) {
+				condition.wait(lock);
+			}
+			if (stopping) return;
+
+			currentRequest.swap(pendingRequest);
+		}
+
+		ProposalResult* result = derive(*currentRequest, cga);
+		if (result == NULL) continue;
+
+		// キューが一杯なら、GLのスレッドが取り出すまで待つ (その間に中止されたら捨てる)
+		{
+			boost::unique_lock<boost::mutex> lock(mutex);
+			while (!stopping && !currentRequest->cancellationToken->isCancelled() && results.write_available() == 0) {
+				condition.wait(lock);
+			}
+		}
+		if (currentRequest->cancellationToken->isCancelled() || !results.push(result)) {
+			delete result;
+		}
+	}
+}
+
+/**
+ * 要求された提案のderivationを行い、ジオメトリを作成する。
+ *
+ * @param request		要求
+ * @param cga			derivationに使うCGA
+ * @return				結果 (中止された場合はNULL)
+ */
+ProposalResult* ProposalWorker::derive(ProposalRequest& request, cga::CGA& cga) {
+	PROFILE_SCOPE("cga", "ProposalWorker::derive");
+
+	cga.axiom = request.axiom;
+	cga.lots = request.lots;
+	cga.proposedRuleSet = request.ruleSet;
+	cga.maxShapes = request.maxShapes;
+	cga.maxDepth = request.maxDepth;
+	cga.timeLimit = request.timeLimit;
+	cga.cancellationToken = request.cancellationToken;
+
+	ProposalResult* result = new ProposalResult();
+	result->generation = request.generation;
+	try {
+		cga.generateProposal();
+
+		if (!request.cancellationToken->isCancelled()) {
+			// ジオメトリもこのスレッドで作成し、GLのスレッドでは登録するだけにする
+			cga.renderProposal(&result->geometry, true);
+			result->truncationMessage = cga.truncationMessage;
+			result->shapes.swap(cga.proposedShapes);
+		}
+	} catch (const char* ex) {
+		result->errorMessage = ex;
+	} catch (const std::string& ex) {
+		result->errorMessage = ex;
+	}
+	cga.proposedShapes.clear();
+
+	if (request.cancellationToken->isCancelled()) {
+		delete result;
+		return NULL;
+	}
+	return result;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include "CGA.h"
+#include "GeometryBuffer.h"
+
+/**
+ * バックグラウンドで行う、提案のderivationの要求。
+ * 要求した時点のルールをコピーしておくので、その後GUI側でルールを変更しても影響しない。
+ */
+class ProposalRequest {
+public:
+	unsigned int generation;
+	boost::shared_ptr<cga::Shape> axiom;
+	std::vector<boost::shared_ptr<cga::Shape> > lots;
+	cga::RuleSet ruleSet;
+	int maxShapes;
+	int maxDepth;
+	int timeLimit;
+	boost::shared_ptr<cga::CancellationToken> cancellationToken;
+
+public:
+	ProposalRequest() : generation(0), maxShapes(0), maxDepth(0), timeLimit(0) {}
+};
+
+/**
+ * 提案のderivationの結果。
+ * shapesは、そのままCGA::proposedShapesとして使う。
+ */
+class ProposalResult {
+public:
+	unsigned int generation;
+	std::vector<boost::shared_ptr<cga::Shape> > shapes;
+	GeometryBuffer geometry;
+	std::string truncationMessage;
+	std::string errorMessage;
+
+public:
+	ProposalResult() : generation(0) {}
+};
+
+/**
+ * 提案のderivationとジオメトリの作成を、GLのスレッドとは別のスレッドで行う。
+ * 新しい提案を要求すると、実行中の古い提案のderivationは中止される。
+ * 結果は、lock-freeのsingle-producer/single-consumerのキューを通して、GLのスレッドでpopResult()により取り出す。
+ * request(), cancel(), popResult(), hasPending()は、GLのスレッドからのみ呼び出すこと。
+ */
+class ProposalWorker {
+public:
+	static enum { QUEUE_SIZE = 4 };
+
+public:
+	ProposalWorker();
+	~ProposalWorker();
+
+	void start();
+	void stop();
+	void request(const cga::CGA& cga);
+	void cancel();
+	bool hasPending() const;
+	ProposalResult* popResult();
+
+private:
+	void run();
+	ProposalResult* derive(ProposalRequest& request, cga::CGA& cga);
+
+private:
+	boost::thread thread;
+	boost::mutex mutex;
+	boost::condition_variable condition;				// 要求、中止、停止、キューが空いたことを通知する
+	boost::shared_ptr<ProposalRequest> pendingRequest;	// まだ開始していない最新の要求
+	bool stopping;
+
+	// 結果の所有権は、キューに入れた時点でGLのスレッドに移る
+	boost::lockfree::spsc_queue<ProposalResult*, boost::lockfree::capacity<QUEUE_SIZE> > results;
+
+	// 以下は、GLのスレッドだけが使う
+	unsigned int generation;							// 最後に要求 (または中止) した世代
+	unsigned int receivedGeneration;					// 結果を受け取った (または中止した) 世代
+	boost::shared_ptr<cga::CancellationToken> cancellationToken;	// 最後の要求の中止用
+};
@@ -6,12 +6,16 @@
 #include <boost/lexical_cast.hpp>
 #include "SplitOperator.h"
 #include "BoundingBox.h"
+#include <algorithm>
+#include <limits>
 
 namespace cga {
 
-Rectangle::Rectangle(const std::string& name, const glm::mat4& pivot, const glm::mat4& modelMat, float width, float height, const glm::vec3& color) {
+Rectangle::Rectangle(const std::string& name, const AffineTransform& pivot, const AffineTransform& modelMat, float width, float height, const glm::vec3& color) {
 	this->_name = name;
 	this->_removed = false;
+	this->_depth = 0;
+	this->_lodCut = 0;
 	this->_pivot = pivot;
 	this->_modelMat = modelMat;
 	this->_scope.x = width;
@@ -21,9 +25,11 @@ Rectangle::Rectangle(const std::string& name, const glm::mat4& pivot, const glm:
 	this->_textureEnabled = false;
 }
 
-Rectangle::Rectangle(const std::string& name, const glm::mat4& pivot, const glm::mat4& modelMat, float width, float height, const glm::vec3& color, const std::string& texture, float u1, float v1, float u2, float v2) {
+Rectangle::Rectangle(const std::string& name, const AffineTransform& pivot, const AffineTransform& modelMat, float width, float height, const glm::vec3& color, const std::string& texture, float u1, float v1, float u2, float v2) {
 	this->_name = name;
 	this->_removed = false;
+	this->_depth = 0;
+	this->_lodCut = 0;
 	this->_pivot = pivot;
 	this->_modelMat = modelMat;
 	this->_scope.x = width;
@@ -50,31 +56,31 @@ boost::shared_ptr<Shape> Rectangle::extrude(const std::string& name, float heigh
 	return boost::shared_ptr<Shape>(new Cuboid(name, _pivot, _modelMat, _scope.x, _scope.y, height, _color));
 }
 
-void Rectangle::split(int splitAxis, const std::vector<float>& sizes, const std::vector<std::string>& names, std::vector<boost::shared_ptr<Shape> >& objects) {
+void Rectangle::split(int splitAxis, const float* sizes, const int* name_ids, int num, const std::vector<std::string>& names, std::vector<boost::shared_ptr<Shape> >& objects) {
 	float offset = 0.0f;
 	
-	for (int i = 0; i < sizes.size(); ++i) {
+	for (int i = 0; i < num; ++i) {
 		if (splitAxis == DIRECTION_X) {
-			if (names[i] != "NIL") {
-				glm::mat4 mat = glm::translate(glm::mat4(), glm::vec3(offset, 0, 0));
+			if (names[name_ids[i]] != "NIL") {
+				AffineTransform mat = _modelMat.translated(glm::vec3(offset, 0, 0));
 				if (_texCoords.size() > 0) {
-					objects.push_back(boost::shared_ptr<Shape>(new Rectangle(names[i], _pivot, _modelMat * mat, sizes[i], _scope.y, _color, _texture,
+					objects.push_back(boost::shared_ptr<Shape>(new Rectangle(names[name_ids[i]], _pivot, mat, sizes[i], _scope.y, _color, _texture,
 						_texCoords[0].x + (_texCoords[1].x - _texCoords[0].x) * offset / _scope.x, _texCoords[0].y,
 						_texCoords[0].x + (_texCoords[1].x - _texCoords[0].x) * (offset + sizes[i]) / _scope.x, _texCoords[2].y)));
 				} else {
-					objects.push_back(boost::shared_ptr<Shape>(new Rectangle(names[i], _pivot, _modelMat * mat, sizes[i], _scope.y, _color)));
+					objects.push_back(boost::shared_ptr<Shape>(new Rectangle(names[name_ids[i]], _pivot, mat, sizes[i], _scope.y, _color)));
 				}
 			}
 			offset += sizes[i];
 		} else if (splitAxis == DIRECTION_Y) {
-			if (names[i] != "NIL") {
-				glm::mat4 mat = glm::translate(glm::mat4(), glm::vec3(0, offset, 0));
+			if (names[name_ids[i]] != "NIL") {
+				AffineTransform mat = _modelMat.translated(glm::vec3(0, offset, 0));
 				if (_texCoords.size() > 0) {
-					objects.push_back(boost::shared_ptr<Shape>(new Rectangle(names[i], _pivot, _modelMat * mat, _scope.x, sizes[i], _color, _texture,
+					objects.push_back(boost::shared_ptr<Shape>(new Rectangle(names[name_ids[i]], _pivot, mat, _scope.x, sizes[i], _color, _texture,
 						_texCoords[0].x, _texCoords[0].y + (_texCoords[2].y - _texCoords[0].y) * offset / _scope.y,
 						_texCoords[1].x, _texCoords[0].y + (_texCoords[2].y - _texCoords[0].y) * (offset + sizes[i]) / _scope.y)));
 				} else {
-					objects.push_back(boost::shared_ptr<Shape>(new Rectangle(names[i], _pivot, _modelMat * mat, _scope.x, sizes[i], _color)));
+					objects.push_back(boost::shared_ptr<Shape>(new Rectangle(names[name_ids[i]], _pivot, mat, _scope.x, sizes[i], _color)));
 				}
 			}
 			offset += sizes[i];
@@ -84,21 +90,18 @@ void Rectangle::split(int splitAxis, const std::vector<float>& sizes, const std:
 	}
 }
 
-void Rectangle::render(RenderManager* renderManager, const std::string& name, float opacity, bool showScopeCoordinateSystem) const {
+void Rectangle::render(GeometrySink* sink, const std::string& name, float opacity, bool showScopeCoordinateSystem) const {
 	if (_removed) return;
 
 	std::vector<Vertex> vertices;
 
 	vertices.resize(6);
 
-	glm::vec4 p1(0, 0, 0, 1);
-	p1 = _pivot * _modelMat * p1;
-	glm::vec4 p2(_scope.x, 0, 0, 1);
-	p2 = _pivot * _modelMat * p2;
-	glm::vec4 p3(_scope.x, _scope.y, 0, 1);
-	p3 = _pivot * _modelMat * p3;
-	glm::vec4 p4(0, _scope.y, 0, 1);
-	p4 = _pivot * _modelMat * p4;
+	AffineTransform mat = _pivot * _modelMat;
+	glm::vec3 p1 = mat.transformPoint(glm::vec3(0, 0, 0));
+	glm::vec3 p2 = mat.transformPoint(glm::vec3(_scope.x, 0, 0));
+	glm::vec3 p3 = mat.transformPoint(glm::vec3(_scope.x, _scope.y, 0));
+	glm::vec3 p4 = mat.transformPoint(glm::vec3(0, _scope.y, 0));
 
 	if (opacity < 1.0f) {
 		p1 *= explode_factor;
@@ -107,51 +110,47 @@ void Rectangle::render(RenderManager* renderManager, const std::string& name, fl
 		p4 *= explode_factor;
 	}
 
-	glm::vec4 normal(0, 0, 1, 0);
-	normal = _pivot * _modelMat * normal;
+	glm::vec3 normal = mat.transformVector(glm::vec3(0, 0, 1));
 
 	if (_textureEnabled) {
-		vertices[0] = Vertex(glm::vec3(p1), glm::vec3(normal), glm::vec4(_color, opacity), _texCoords[0]);
-		vertices[1] = Vertex(glm::vec3(p2), glm::vec3(normal), glm::vec4(_color, opacity), _texCoords[1], 1);
-		vertices[2] = Vertex(glm::vec3(p3), glm::vec3(normal), glm::vec4(_color, opacity), _texCoords[2]);
+		vertices[0] = Vertex(p1, normal, glm::vec4(_color, opacity), _texCoords[0]);
+		vertices[1] = Vertex(p2, normal, glm::vec4(_color, opacity), _texCoords[1], 1);
+		vertices[2] = Vertex(p3, normal, glm::vec4(_color, opacity), _texCoords[2]);
 
-		vertices[3] = Vertex(glm::vec3(p1), glm::vec3(normal), glm::vec4(_color, opacity), _texCoords[0]);
-		vertices[4] = Vertex(glm::vec3(p3), glm::vec3(normal), glm::vec4(_color, opacity), _texCoords[2]);
-		vertices[5] = Vertex(glm::vec3(p4), glm::vec3(normal), glm::vec4(_color, opacity), _texCoords[3], 1);
+		vertices[3] = Vertex(p1, normal, glm::vec4(_color, opacity), _texCoords[0]);
+		vertices[4] = Vertex(p3, normal, glm::vec4(_color, opacity), _texCoords[2]);
+		vertices[5] = Vertex(p4, normal, glm::vec4(_color, opacity), _texCoords[3], 1);
 
-		renderManager->addObject(name.c_str(), _texture.c_str(), vertices);
+		sink->addObject(name, _texture, vertices);
 	} else {
-		vertices[0] = Vertex(glm::vec3(p1), glm::vec3(normal), glm::vec4(_color, opacity));
-		vertices[1] = Vertex(glm::vec3(p2), glm::vec3(normal), glm::vec4(_color, opacity), 1);
-		vertices[2] = Vertex(glm::vec3(p3), glm::vec3(normal), glm::vec4(_color, opacity));
+		vertices[0] = Vertex(p1, normal, glm::vec4(_color, opacity));
+		vertices[1] = Vertex(p2, normal, glm::vec4(_color, opacity), 1);
+		vertices[2] = Vertex(p3, normal, glm::vec4(_color, opacity));
 
-		vertices[3] = Vertex(glm::vec3(p1), glm::vec3(normal), glm::vec4(_color, opacity));
-		vertices[4] = Vertex(glm::vec3(p3), glm::vec3(normal), glm::vec4(_color, opacity));
-		vertices[5] = Vertex(glm::vec3(p4), glm::vec3(normal), glm::vec4(_color, opacity), 1);
+		vertices[3] = Vertex(p1, normal, glm::vec4(_color, opacity));
+		vertices[4] = Vertex(p3, normal, glm::vec4(_color, opacity));
+		vertices[5] = Vertex(p4, normal, glm::vec4(_color, opacity), 1);
 
-		renderManager->addObject(name.c_str(), "", vertices);
+		sink->addObject(name, "", vertices);
 	}
 	
 	if (showScopeCoordinateSystem) {
 		vertices.resize(0);
-		glutils::drawAxes(0.1, 3, _pivot * _modelMat, vertices);
-		renderManager->addObject("axis", "", vertices);
+		glutils::drawAxes(0.1, 3, mat.toMat4(), vertices);
+		sink->addObject("axis", "", vertices);
 	}
 }
 
 bool Rectangle::hitFace(const glm::vec3& cameraPos, const glm::vec3& viewDir, Face& face, float& dist) {
 	std::vector<glm::vec3> points;
 
-	glm::vec4 p1(0, 0, 0, 1);
-	points.push_back(glm::vec3(_pivot * _modelMat * p1));
-	glm::vec4 p2(_scope.x, 0, 0, 1);
-	points.push_back(glm::vec3(_pivot * _modelMat * p2));
-	glm::vec4 p3(_scope.x, _scope.y, 0, 1);
-	points.push_back(glm::vec3(_pivot * _modelMat * p3));
-	glm::vec4 p4(0, _scope.y, 0, 1);
-	points.push_back(glm::vec3(_pivot * _modelMat * p4));
+	AffineTransform mat = _pivot * _modelMat;
+	points.push_back(mat.transformPoint(glm::vec3(0, 0, 0)));
+	points.push_back(mat.transformPoint(glm::vec3(_scope.x, 0, 0)));
+	points.push_back(mat.transformPoint(glm::vec3(_scope.x, _scope.y, 0)));
+	points.push_back(mat.transformPoint(glm::vec3(0, _scope.y, 0)));
 
-	glm::vec3 normal = glm::vec3(_pivot * _modelMat * glm::vec4(0, 0, 1, 0));
+	glm::vec3 normal = mat.transformVector(glm::vec3(0, 0, 1));
 
 	glm::vec3 intPt;
 	dist = (std::numeric_limits<float>::max)();
@@ -172,11 +171,10 @@ bool Rectangle::hitFace(const glm::vec3& cameraPos, const glm::vec3& viewDir, Fa
 }
 
 void Rectangle::findRule(const std::vector<Stroke>& strokes, int sketch_step, CGA* cga) {
-	// copy the entire ruleset to the proposed one
-	cga->proposedRuleSet = cga->ruleSet;
+	// the proposal shares the current ruleset as its base and only holds the changes
+	cga->beginProposal();
 
-	glm::mat4 mat = _pivot * _modelMat;
-	mat = glm::inverse(mat);
+	glm::mat4 mat = (_pivot * _modelMat).inverse().toMat4();
 
 	if (sketch_step == STEP_FLOOR) {
 		std::vector<float> floor_y;
@@ -199,23 +197,15 @@ void Rectangle::findRule(const std::vector<Stroke>& strokes, int sketch_step, CG
 
 		if (floor_heights.size() == 1) {
 			// pattern A*
-			RuleSet ruleSet = cga->ruleRepository["floors"][0];
-			Rule startRule = ruleSet.rules["Start"];
-			ruleSet.rules.erase("Start");
-			ruleSet.rules[_name] = startRule;
+			RuleSet& ruleSet = cga->proposedRuleSet;
+			ruleSet.merge(*cga->ruleRepository["floors"][0], "Start", _name);
 			ruleSet.attrs["floor_height"] = boost::lexical_cast<std::string>(floor_heights[0]);
-
-			cga->proposedRuleSet.merge(ruleSet);
 		} else {
 			// pattern { A | B* }
-			RuleSet ruleSet = cga->ruleRepository["floors"][1];
-			Rule startRule = ruleSet.rules["Start"];
-			ruleSet.rules.erase("Start");
-			ruleSet.rules[_name] = startRule;
+			RuleSet& ruleSet = cga->proposedRuleSet;
+			ruleSet.merge(*cga->ruleRepository["floors"][1], "Start", _name);
 			ruleSet.attrs["groundf_height"] = boost::lexical_cast<std::string>(floor_heights[0]);
 			ruleSet.attrs["floor_height"] = boost::lexical_cast<std::string>(floor_heights[1]);
-
-			cga->proposedRuleSet.merge(ruleSet);
 		}
 	} else if (sketch_step == STEP_WINDOW) {
 		std::vector<BoundingBox> bboxes;
@@ -230,32 +220,24 @@ void Rectangle::findRule(const std::vector<Stroke>& strokes, int sketch_step, CG
 
 		if (bboxes.size() == 1) {
 			// pattern A*
-			RuleSet ruleSet = cga->ruleRepository["windows"][0];
-			Rule startRule = ruleSet.rules["Start"];
-			ruleSet.rules.erase("Start");
-			ruleSet.rules[_name] = startRule;
+			RuleSet& ruleSet = cga->proposedRuleSet;
+			ruleSet.merge(*cga->ruleRepository["windows"][0], "Start", _name);
 			ruleSet.attrs["tile_width1"] = boost::lexical_cast<std::string>(bboxes[0].minPt.x * 2 + bboxes[0].sx());
 			ruleSet.attrs["tile_horizontal_margin"] = boost::lexical_cast<std::string>(bboxes[0].minPt.x);
 			ruleSet.attrs["tile_vertical_margin1"] = boost::lexical_cast<std::string>(bboxes[0].minPt.y);
 			ruleSet.attrs["tile_vertical_margin2"] = boost::lexical_cast<std::string>(_scope.y - bboxes[0].maxPt.y);
-
-			cga->proposedRuleSet.merge(ruleSet);
 		} else if (bboxes.size() == 2) {
 			// pattern { A | B }*
-			RuleSet ruleSet = cga->ruleRepository["windows"][1];
-			Rule startRule = ruleSet.rules["Start"];
-			ruleSet.rules.erase("Start");
-			ruleSet.rules[_name] = startRule;
+			RuleSet& ruleSet = cga->proposedRuleSet;
+			ruleSet.merge(*cga->ruleRepository["windows"][1], "Start", _name);
 
 			float tile_margin = (bboxes[1].minPt.x - bboxes[0].maxPt.x) * 0.5f;
-			ruleSet.attrs["floor_horizontal_margin"] = boost::lexical_cast<std::string>(max(0, bboxes[0].minPt.x - tile_margin));
+			ruleSet.attrs["floor_horizontal_margin"] = boost::lexical_cast<std::string>((std::max)(0.0f, bboxes[0].minPt.x - tile_margin));
 			ruleSet.attrs["tile_width1"] = boost::lexical_cast<std::string>(bboxes[0].sx() + tile_margin * 2.0f);
 			ruleSet.attrs["tile_width2"] = boost::lexical_cast<std::string>(bboxes[1].sx() + tile_margin * 2.0f);
 			ruleSet.attrs["tile_horizontal_margin"] = boost::lexical_cast<std::string>(tile_margin);
 			ruleSet.attrs["tile_vertical_margin1"] = boost::lexical_cast<std::string>((bboxes[0].minPt.y + bboxes[1].minPt.y) * 0.5f);
 			ruleSet.attrs["tile_vertical_margin2"] = boost::lexical_cast<std::string>(_scope.y - (bboxes[0].maxPt.y + bboxes[1].maxPt.y) * 0.5f);
-
-			cga->proposedRuleSet.merge(ruleSet);
 		}
 	}
 
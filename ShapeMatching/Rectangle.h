@@ -6,8 +6,6 @@
 #include <vector>
 #include "Shape.h"
 
-class RenderManager;
-
 namespace cga {
 
 class RuleSet;
@@ -15,13 +13,13 @@ class RuleSet;
 class Rectangle : public Shape {
 public:
 	Rectangle() {}
-	Rectangle(const std::string& name, const glm::mat4& pivot, const glm::mat4& modelMat, float width, float height, const glm::vec3& color);
-	Rectangle(const std::string& name, const glm::mat4& pivot, const glm::mat4& modelMat, float width, float height, const glm::vec3& color, const std::string& texture, float u1, float v1, float u2, float v2);
+	Rectangle(const std::string& name, const AffineTransform& pivot, const AffineTransform& modelMat, float width, float height, const glm::vec3& color);
+	Rectangle(const std::string& name, const AffineTransform& pivot, const AffineTransform& modelMat, float width, float height, const glm::vec3& color, const std::string& texture, float u1, float v1, float u2, float v2);
 	boost::shared_ptr<Shape> clone(const std::string& name) const;
 	boost::shared_ptr<Shape> extrude(const std::string& name, float height);
 	boost::shared_ptr<Shape> offset(const std::string& name, float offsetDistance, int offsetSelector);
-	void split(int splitAxis, const std::vector<float>& ratios, const std::vector<std::string>& names, std::vector<boost::shared_ptr<Shape> >& objects);
-	void render(RenderManager* renderManager, const std::string& name, float opacity, bool showScopeCoordinateSystem) const;
+	void split(int splitAxis, const float* sizes, const int* name_ids, int num, const std::vector<std::string>& names, std::vector<boost::shared_ptr<Shape> >& objects);
+	void render(GeometrySink* sink, const std::string& name, float opacity, bool showScopeCoordinateSystem) const;
 	bool hitFace(const glm::vec3& cameraPos, const glm::vec3& viewDir, Face& face, float& dist);
 	void findRule(const std::vector<Stroke>& strokes, int sketch_step, CGA* cga);
 };
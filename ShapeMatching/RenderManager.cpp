@@ -1,110 +1,313 @@
 ﻿#include "RenderManager.h"
 #include <iostream>
+#include <algorithm>
+#include <limits>
 #include "Shader.h"
 #include <QImage>
 #include <QGLWidget>
 
+/**
+ * 現在bindされているVAOに、Vertexのattributeを設定する。
+ */
+static void setupVertexAttributes() {
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, color));
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));	// texCoord, texLayer
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, drawEdge));
+	glEnableVertexAttribArray(5);
+	glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, edgeMask));
+}
+
 GeometryObject::GeometryObject() {
-	vaoCreated = false;
-	vaoOutdated = true;
+	minPt = glm::vec3((std::numeric_limits<float>::max)());
+	maxPt = -minPt;
+	batchFirst = -1;
+	batchCapacity = 0;
+	outdated = true;
 }
 
 GeometryObject::GeometryObject(const std::vector<Vertex>& vertices) {
 	this->vertices = vertices;
-	vaoCreated = false;
-	vaoOutdated = true;
+	minPt = glm::vec3((std::numeric_limits<float>::max)());
+	maxPt = -minPt;
+	updateBoundingBox(vertices);
+	batchFirst = -1;
+	batchCapacity = 0;
+	outdated = true;
 }
 
 void GeometryObject::addVertices(const std::vector<Vertex>& vertices) {
 	this->vertices.insert(this->vertices.end(), vertices.begin(), vertices.end());
-	vaoOutdated = true;
+	updateBoundingBox(vertices);
+	outdated = true;
 }
 
 /**
- * Create VAO according to the vertices.
+ * 三角形の3頂点のdrawEdgeを、各頂点のedgeMaskにまとめる。
+ * geometryシェーダを使わないパイプラインでは、vertexシェーダが、このマスクと頂点番号から
+ * 重心座標を作り、fragmentシェーダで辺までの距離を求める。
  */
-void GeometryObject::createVAO() {
-	// VAOが作成済みで、最新なら、何もしないで終了
-	if (vaoCreated && !vaoOutdated) return;
+void GeometryObject::updateEdgeMasks() {
+	for (int i = 0; i + 2 < vertices.size(); i += 3) {
+		float mask = 0.0f;
+		for (int k = 0; k < 3; ++k) {
+			if (vertices[i + k].drawEdge > 0.5f) mask += (float)(1 << k);
+		}
+		for (int k = 0; k < 3; ++k) {
+			vertices[i + k].edgeMask = mask;
+		}
+	}
+}
+
+void GeometryObject::updateBoundingBox(const std::vector<Vertex>& vertices) {
+	for (int i = 0; i < vertices.size(); ++i) {
+		minPt = glm::min(minPt, vertices[i].position);
+		maxPt = glm::max(maxPt, vertices[i].position);
+	}
+}
+
+TextureBatch::TextureBatch() {
+	capacity = 0;
+	used = 0;
+	created = false;
+	outdated = true;
+}
 
-	if (!vaoCreated) {
-		// create vao and bind it
+/**
+ * 変わったobjectの頂点だけを、バッチのバッファに転送する。
+ * 割り当て済みの範囲に収まるobjectはその場で上書きし、収まらないobjectは末尾に新しい範囲を割り当てる。
+ * バッファが足りない場合や、削除・移動で空いた範囲が半分を超えた場合だけ、全objectを詰めて転送し直す。
+ *
+ * @param objects		このテクスチャを使う全object
+ */
+void TextureBatch::update(const std::vector<GeometryObject*>& objects) {
+	if (!created) {
 		glGenVertexArrays(1, &vao);
 		glBindVertexArray(vao);
-
-		// create VBO and tranfer the vertices data to GPU buffer
 		glGenBuffers(1, &vbo);
 		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		setupVertexAttributes();
+		glBindVertexArray(0);
 
-		vaoCreated = true;
-	} else {
-		glBindVertexArray(vao);
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glGenBuffers(1, &indirectBuffer);
+		created = true;
 	}
 
-	glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+	// 今の範囲を使い続ける頂点数と、新しく割り当てる頂点数
+	GLsizei kept = 0;
+	GLsizei appended = 0;
+	for (int i = 0; i < objects.size(); ++i) {
+		if (objects[i]->batchFirst >= 0 && objects[i]->vertices.size() <= objects[i]->batchCapacity) {
+			kept += objects[i]->batchCapacity;
+		} else {
+			appended += objects[i]->vertices.size();
+		}
+	}
 
-	// configure the attributes in the vao
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, color));
-	glEnableVertexAttribArray(3);
-	glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
-	glEnableVertexAttribArray(4);
-	glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, drawEdge));
-		
-	// unbind the vao
-	glBindVertexArray(0); 
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	if (used + appended > capacity) {
+		rebuild(objects, (std::max)(kept + appended, capacity * 2));
+	} else if (used - kept > kept) {
+		rebuild(objects, capacity);
+	} else {
+		for (int i = 0; i < objects.size(); ++i) {
+			GeometryObject* object = objects[i];
+			if (object->batchFirst < 0 || object->vertices.size() > object->batchCapacity) {
+				object->batchFirst = used;
+				object->batchCapacity = object->vertices.size();
+				used += object->batchCapacity;
+				upload(object);
+			} else if (object->outdated) {
+				upload(object);
+			}
+		}
+	}
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	vaoOutdated = false;
+	outdated = false;
+}
+
+/**
+ * バッファを確保し直し、全objectの頂点を先頭から詰めて転送する。
+ *
+ * @param objects		このテクスチャを使う全object
+ * @param capacity		バッファの頂点数
+ */
+void TextureBatch::rebuild(const std::vector<GeometryObject*>& objects, GLsizei capacity) {
+	this->capacity = capacity;
+	glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * capacity, NULL, GL_STATIC_DRAW);
+
+	used = 0;
+	for (int i = 0; i < objects.size(); ++i) {
+		objects[i]->batchFirst = used;
+		objects[i]->batchCapacity = objects[i]->vertices.size();
+		used += objects[i]->batchCapacity;
+		upload(objects[i]);
+	}
+}
+
+/**
+ * objectの頂点を、割り当てられた範囲に転送する。
+ */
+void TextureBatch::upload(GeometryObject* object) {
+	if (!object->vertices.empty()) {
+		object->updateEdgeMasks();
+		glBufferSubData(GL_ARRAY_BUFFER, sizeof(Vertex) * object->batchFirst, sizeof(Vertex) * object->vertices.size(), object->vertices.data());
+	}
+	object->outdated = false;
+}
+
+/**
+ * バッチ内の指定された範囲を、1回のmulti drawで描画する。
+ * multi draw indirectが使える場合は、描画コマンドをバッファに格納して描画する。
+ *
+ * @param first		各範囲の開始位置
+ * @param count		各範囲の頂点数
+ */
+void TextureBatch::draw(const std::vector<GLint>& first, const std::vector<GLsizei>& count) {
+	if (first.empty()) return;
+
+	glBindVertexArray(vao);
+
+	if (GLEW_ARB_multi_draw_indirect) {
+		struct DrawArraysIndirectCommand {
+			GLuint count;
+			GLuint instanceCount;
+			GLuint first;
+			GLuint baseInstance;
+		};
+
+		std::vector<DrawArraysIndirectCommand> commands(first.size());
+		for (int i = 0; i < first.size(); ++i) {
+			commands[i].count = count[i];
+			commands[i].instanceCount = 1;
+			commands[i].first = first[i];
+			commands[i].baseInstance = 0;
+		}
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawArraysIndirectCommand) * commands.size(), commands.data(), GL_STREAM_DRAW);
+		glMultiDrawArraysIndirect(GL_TRIANGLES, 0, commands.size(), 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	} else {
+		glMultiDrawArrays(GL_TRIANGLES, first.data(), count.data(), first.size());
+	}
+
+	glBindVertexArray(0);
 }
 
 RenderManager::RenderManager() {
+	frameUBO = 0;
+	placeholderTexId = 0;
+
+	// 各LODを使用する、画面上の最小サイズ [pixel]
+	// (詳細, floor, facade, massの順。cga::LOD_*と対応する)
+	lodScreenSizes.push_back(150.0f);
+	lodScreenSizes.push_back(60.0f);
+	lodScreenSizes.push_back(20.0f);
+	lodScreenSizes.push_back(0.0f);
 }
 
-void RenderManager::init(const std::string& vertex_file, const std::string& geometry_file, const std::string& fragment_file, int shadowMapSize) {
+void RenderManager::init(const std::string& vertex_file, const std::string& geometry_file, const std::string& fragment_file, int shadowMapSize, GLenum shadowDepthFormat, int numShadowCascades, int atlasSize) {
 	// init glew
 	GLenum err = glewInit();
 	if (err != GLEW_OK) {
 		std::cout << "Error: " << glewGetErrorString(err) << std::endl;
 	}
+	timer.init();
 
 	// load shaders
-	Shader shader;
 	if (geometry_file.empty()) {
 		program = shader.createProgram(vertex_file, fragment_file);
 	} else {
 		program = shader.createProgram(vertex_file, geometry_file, fragment_file);
 	}
 	glUseProgram(program);
+	uniforms.resolve(shader);
+
+	// フレーム毎の行列と光源は、全プログラムで共有するUBO (FrameUniformsブロック) で渡す
+	// layout (std140): mat4 mvpMatrix, mat4 mvMatrix, mat4 light_mvpMatrix, vec3 lightDir
+	if (uniforms.frameBlockIndex == GL_INVALID_INDEX) {
+		std::cout << "Error: the shaders do not declare the FrameUniforms block." << std::endl;
+	} else {
+		glUniformBlockBinding(program, uniforms.frameBlockIndex, FRAME_UNIFORM_BINDING);
+	}
+	glGenBuffers(1, &frameUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(glm::mat4) * 3 + sizeof(glm::vec4), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, frameUBO);
+
+	// テクスチャユニットは固定なので、一度だけ設定する
+	glUniform1i(uniforms.tex0, 0);
+	glUniform1i(uniforms.atlasTex, TextureAtlas::TEXTURE_UNIT);
+
+	// geometryシェーダを使わない場合は、wireframeの辺までの距離を重心座標から求める
+	glUniform1i(uniforms.barycentricEdges, geometry_file.empty() ? 1 : 0);
 
 	// ダミーのtexture idを作成する。
 	// これにより、実際に使われるtexture idは1以上の値となる
 	GLuint texId;
 	glGenTextures(1, &texId);
 
-	shadow.init(program, shadowMapSize, shadowMapSize);
+	// ファサードのテクスチャをまとめるアトラス (ページは、画像が追加された時に確保する)
+	atlas.init(atlasSize, atlasSize);
+
+	// テクスチャのデコードが終わるまで代わりに使う、1x1のテクスチャ
+	unsigned char placeholder[] = { 200, 200, 200, 255 };
+	placeholderTexId = createTexture(1, 1, placeholder);
+
+	// テクスチャ画像は、バックグラウンドでデコードする
+	textureLoader.start(2);
+
+	shadow.init(program, &uniforms, shadowMapSize, shadowMapSize, shadowDepthFormat, numShadowCascades);
+
+	// 半透明の面は、同じディレクトリのOIT用のシェーダで描画する
+	std::string shader_dir = fragment_file.substr(0, fragment_file.find_last_of("/\\") + 1);
+	oit.init(vertex_file, geometry_file, shader_dir + "oit_fragment.glsl", shader_dir + "oit_composite_vertex.glsl", shader_dir + "oit_composite_fragment.glsl", FRAME_UNIFORM_BINDING);
+	glUseProgram(program);
 }
 
 void RenderManager::addObject(const QString& object_name, const QString& texture_file, const std::vector<Vertex>& vertices) {
-	GLuint texId;
-	
 	if (texture_file.length() > 0) {
-		// テクスチャファイルがまだ読み込まれていない場合は、ロードする
-		if (!textures.contains(texture_file)) {
-			texId = loadTexture(texture_file);
-			textures[texture_file] = texId;
+		// テクスチャ座標が[0, 1]の範囲なら、アトラスを使ってテクスチャの切り替えをなくす
+		// (範囲外の場合は、繰り返しが必要なので、個別のテクスチャを使う)
+		bool inUnitRange = true;
+		for (int i = 0; i < vertices.size() && inUnitRange; ++i) {
+			if (vertices[i].texCoord.x < 0.0f || vertices[i].texCoord.x > 1.0f || vertices[i].texCoord.y < 0.0f || vertices[i].texCoord.y > 1.0f) {
+				inUnitRange = false;
+			}
+		}
+
+		if (inUnitRange && atlas.contains(texture_file)) {
+			std::vector<Vertex> remapped_vertices = vertices;
+			for (int i = 0; i < remapped_vertices.size(); ++i) {
+				atlas.remap(texture_file, remapped_vertices[i]);
+			}
+			addObject(object_name, atlas.texId, remapped_vertices);
+		} else if (textures.contains(texture_file)) {
+			addObject(object_name, textures[texture_file], vertices);
 		} else {
-			texId = textures[texture_file];
+			// テクスチャがまだ読み込まれていない場合は、バックグラウンドでデコードし、
+			// それまではplaceholderのテクスチャで描画する
+			std::vector<Vertex>& pending = pendingVertices[texture_file][object_name];
+			pending.insert(pending.end(), vertices.begin(), vertices.end());
+			textureLoader.request(texture_file);
+
+			addObject(object_name, placeholderTexId, vertices);
 		}
 	} else {
-		texId = 0;
+		addObject(object_name, (GLuint)0, vertices);
 	}
+}
 
+void RenderManager::addObject(const QString& object_name, GLuint texId, const std::vector<Vertex>& vertices) {
 	if (objects.contains(object_name)) {
 		if (objects[object_name].contains(texId)) {
 			objects[object_name][texId].addVertices(vertices);
@@ -114,6 +317,11 @@ void RenderManager::addObject(const QString& object_name, const QString& texture
 	} else {
 		objects[object_name][texId] = GeometryObject(vertices);
 	}
+
+	batches[texId].outdated = true;
+
+	// 半透明のobjectは影を落とさないので、シャドウマップは作り直さない
+	if (!translucentObjects.contains(object_name)) shadow.invalidate();
 }
 
 void RenderManager::removeObjects() {
@@ -124,86 +332,392 @@ void RenderManager::removeObjects() {
 }
 
 void RenderManager::removeObject(const QString& object_name) {
+	// バッチのバッファ内の範囲は、次のupdate()で空きとして扱われる
 	for (auto it = objects[object_name].begin(); it != objects[object_name].end(); ++it) {
-		glDeleteBuffers(1, &it->vbo);
-		glDeleteVertexArrays(1, &it->vao);
+		batches[it.key()].outdated = true;
 	}
 
+	for (auto it = pendingVertices.begin(); it != pendingVertices.end(); ++it) {
+		it->remove(object_name);
+	}
+
+	if (!translucentObjects.contains(object_name)) shadow.invalidate();
+
 	objects[object_name].clear();
 }
 
 void RenderManager::renderAll(bool wireframe) {
 	for (auto it = objects.begin(); it != objects.end(); ++it) {
-		render(it.key(), wireframe);
+		if (lodHiddenObjects.contains(it.key())) continue;
+		if (translucentObjects.contains(it.key())) continue;
+
+		enqueue(it.key(), program, wireframe);
 	}
+	flushRenderQueue();
 }
 
 void RenderManager::renderAllExcept(const QString& object_name, bool wireframe) {
 	for (auto it = objects.begin(); it != objects.end(); ++it) {
 		if (it.key() == object_name) continue;
+		if (lodHiddenObjects.contains(it.key())) continue;
+		if (translucentObjects.contains(it.key())) continue;
 
-		render(it.key(), wireframe);
+		enqueue(it.key(), program, wireframe);
 	}
+	flushRenderQueue();
 }
 
 void RenderManager::render(const QString& object_name, bool wireframe) {
+	enqueue(object_name, program, wireframe);
+	flushRenderQueue();
+}
+
+/**
+ * 指定されたobjectを、半透明のレイヤとして登録/解除する。
+ * 半透明のobjectは、renderAll()では描画せず、renderTranslucent()で描画する。
+ */
+void RenderManager::setTranslucent(const QString& object_name, bool translucent) {
+	if (translucent) {
+		translucentObjects.insert(object_name);
+	} else {
+		translucentObjects.remove(object_name);
+	}
+}
+
+/**
+ * 半透明のobjectを、weighted blended OITで、不透明なシーンの上に描画する。
+ * 描画順に依存しないので、面のソートは不要。
+ * カメラの行列と光源は、setMatrices()/setLight()でUBOに設定済みのものを使う。
+ *
+ * @param wireframe		wireframeを描画するか
+ */
+void RenderManager::renderTranslucent(bool wireframe) {
+	for (auto it = translucentObjects.begin(); it != translucentObjects.end(); ++it) {
+		if (!objects.contains(*it)) continue;
+		if (lodHiddenObjects.contains(*it)) continue;
+
+		enqueue(*it, oit.program, wireframe);
+	}
+	if (renderQueue.items.empty()) return;
+
+	oit.begin();
+	flushRenderQueue();
+	oit.end();
+
+	glUseProgram(program);
+}
+
+/**
+ * 画面の大きさが変わった時に、画面と同じ大きさのバッファを確保し直す。
+ */
+void RenderManager::resize(int width, int height) {
+	// geometryシェーダで、wireframeの辺までの距離をピクセル単位にするためのスケール
+	glUseProgram(oit.program);
+	glUniform2f(oit.uniforms.viewportScale, width * 0.5f, height * 0.5f);
+	glUseProgram(program);
+	glUniform2f(uniforms.viewportScale, width * 0.5f, height * 0.5f);
+
+	oit.resize(width, height);
+}
+
+/**
+ * LODのグループを登録する。
+ * renderAll()では、グループ内のobjectのうち、updateLOD()で選択されたものだけが描画される。
+ *
+ * @param group_name	グループ名
+ * @param level_names	各LODのobject名 (詳細な順)
+ */
+void RenderManager::setLODGroup(const QString& group_name, const std::vector<QString>& level_names) {
+	lodGroups[group_name] = level_names;
+}
+
+/**
+ * 各LODグループの画面上のサイズを計算し、描画するLODを選択する。
+ * サイズは、最も詳細なLODのbounding boxを投影して求める。
+ *
+ * @param mvpMatrix		model view projection行列
+ * @param screenHeight	画面の高さ [pixel]
+ */
+void RenderManager::updateLOD(const glm::mat4& mvpMatrix, int screenHeight) {
+	QSet<QString> prevHiddenObjects = lodHiddenObjects;
+	lodHiddenObjects.clear();
+
+	for (auto it = lodGroups.begin(); it != lodGroups.end(); ++it) {
+		const std::vector<QString>& level_names = it.value();
+		if (level_names.empty()) continue;
+
+		glm::vec3 minPt((std::numeric_limits<float>::max)());
+		glm::vec3 maxPt = -minPt;
+		for (auto it2 = objects[level_names[0]].begin(); it2 != objects[level_names[0]].end(); ++it2) {
+			minPt = glm::min(minPt, it2->minPt);
+			maxPt = glm::max(maxPt, it2->maxPt);
+		}
+
+		// bounding boxの8頂点を投影し、画面上のサイズを求める
+		// (カメラの後ろに頂点がある場合は、十分大きいものとして扱う)
+		float screenSize = (std::numeric_limits<float>::max)();
+		if (minPt.x <= maxPt.x) {
+			glm::vec2 ndcMin((std::numeric_limits<float>::max)());
+			glm::vec2 ndcMax = -ndcMin;
+			bool behind = false;
+			for (int i = 0; i < 8; ++i) {
+				glm::vec4 p(i & 1 ? maxPt.x : minPt.x, i & 2 ? maxPt.y : minPt.y, i & 4 ? maxPt.z : minPt.z, 1);
+				p = mvpMatrix * p;
+				if (p.w <= 0.0f) {
+					behind = true;
+					break;
+				}
+				ndcMin = glm::min(ndcMin, glm::vec2(p) / p.w);
+				ndcMax = glm::max(ndcMax, glm::vec2(p) / p.w);
+			}
+			if (!behind) {
+				screenSize = (std::max)(ndcMax.x - ndcMin.x, ndcMax.y - ndcMin.y) * 0.5f * screenHeight;
+			}
+		}
+
+		// 画面上のサイズに応じてLODを選択する (空のLODは使用しない)
+		int selected = 0;
+		for (int k = 0; k < level_names.size() && k < lodScreenSizes.size(); ++k) {
+			if (objects.contains(level_names[k]) && !objects[level_names[k]].empty()) {
+				selected = k;
+			}
+			if (screenSize >= lodScreenSizes[k]) break;
+		}
+
+		for (int k = 0; k < level_names.size(); ++k) {
+			if (k != selected) lodHiddenObjects.insert(level_names[k]);
+		}
+	}
+
+	// 描画するLODが変わったら、シャドウマップも作り直す
+	if (lodHiddenObjects != prevHiddenObjects) {
+		shadow.invalidate();
+	}
+}
+
+/**
+ * カメラのmodel view projection行列とmodel view行列をシェーダに渡す。
+ */
+void RenderManager::setMatrices(const glm::mat4& mvpMatrix, const glm::mat4& mvMatrix) {
+	glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), &mvpMatrix[0][0]);
+	glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), &mvMatrix[0][0]);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+/**
+ * 光の進行方向と、シャドウマップ用のmodel view projection行列をシェーダに渡す。
+ */
+void RenderManager::setLight(const glm::vec3& light_dir, const glm::mat4& light_mvpMatrix) {
+	glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+	glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4) * 2, sizeof(glm::mat4), &light_mvpMatrix[0][0]);
+	glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4) * 3, sizeof(glm::vec3), &light_dir[0]);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+/**
+ * 描画モードをシェーダに渡す。
+ *
+ * @param depthComputation		シャドウマップ用のデプスを計算するか
+ * @param lineRendering			線画として描画するか
+ */
+void RenderManager::setDrawMode(bool depthComputation, bool lineRendering) {
+	glUniform1i(uniforms.depthComputation, depthComputation ? 1 : 0);
+	glUniform1i(uniforms.lineRendering, lineRendering ? 1 : 0);
+}
+
+bool RenderManager::updateShadowMap(GLWidget3D* glWidget3D, const glm::vec3& light_dir, const Camera& camera) {
+	PassTimerScope scope(timer, "shadow");
+	return shadow.update(glWidget3D, light_dir, camera);
+}
+
+/**
+ * 指定されたobjectの描画を、render queueに追加する。
+ */
+void RenderManager::enqueue(const QString& object_name, GLuint program, bool wireframe) {
 	for (auto it = objects[object_name].begin(); it != objects[object_name].end(); ++it) {
-		GLuint texId = it.key();
-		
-		// vaoを作成
-		it->createVAO();
+		if (it->vertices.empty()) continue;
 
-		if (texId > 0) {
+		renderQueue.push(DrawItem(program, it.key(), wireframe, object_name));
+	}
+}
+
+/**
+ * render queueをソートし、同じ状態の描画をまとめて描画する。
+ * シェーダ、テクスチャ、uniformは、状態が変わる時だけ設定する。
+ */
+void RenderManager::flushRenderQueue() {
+	renderQueue.sort();
+
+	GLuint currentProgram = 0;
+	GLuint currentTexId = 0;
+	int currentTextureEnabled = -1;
+	int currentWireframe = -1;
+
+	for (int i = 0; i < renderQueue.items.size(); ) {
+		int next = renderQueue.nextStateChange(i);
+		const DrawItem& item = renderQueue.items[i];
+
+		if (item.program != currentProgram) {
+			glUseProgram(item.program);
+			currentProgram = item.program;
+			currentTextureEnabled = -1;
+			currentWireframe = -1;
+		}
+		const ShaderUniforms& uniforms = item.program == oit.program ? oit.uniforms : this->uniforms;
+
+		if (item.texId == atlas.texId) {
+			// アトラスは、専用のテクスチャユニットにbind済み
+			if (currentTextureEnabled != 2) {
+				glUniform1i(uniforms.textureEnabled, 2);
+				currentTextureEnabled = 2;
+			}
+		} else if (item.texId > 0) {
 			// テクスチャなら、バインドする
-			glBindTexture(GL_TEXTURE_2D, texId);
-			glUniform1i(glGetUniformLocation(program, "textureEnabled"), 1);
-			glUniform1i(glGetUniformLocation(program, "tex0"), 0);
-		} else {
-			glUniform1i(glGetUniformLocation(program, "textureEnabled"), 0);
+			if (item.texId != currentTexId) {
+				glBindTexture(GL_TEXTURE_2D, item.texId);
+				currentTexId = item.texId;
+			}
+			if (currentTextureEnabled != 1) {
+				glUniform1i(uniforms.textureEnabled, 1);
+				currentTextureEnabled = 1;
+			}
+		} else if (currentTextureEnabled != 0) {
+			glUniform1i(uniforms.textureEnabled, 0);
+			currentTextureEnabled = 0;
 		}
 
-		if (wireframe) {
-			glUniform1i(glGetUniformLocation(program, "wireframeEnalbed"), 1);
-		} else {
-			glUniform1i(glGetUniformLocation(program, "wireframeEnalbed"), 0);
+		if ((int)item.wireframe != currentWireframe) {
+			glUniform1i(uniforms.wireframeEnabled, item.wireframe ? 1 : 0);
+			currentWireframe = item.wireframe;
+		}
+
+		// このテクスチャのバッチが古ければ、作り直す
+		TextureBatch& batch = batches[item.texId];
+		if (batch.outdated) {
+			std::vector<GeometryObject*> batch_objects;
+			for (auto it = objects.begin(); it != objects.end(); ++it) {
+				if (it->contains(item.texId)) {
+					batch_objects.push_back(&(*it)[item.texId]);
+				}
+			}
+			PassTimerScope scope(timer, "upload");
+			batch.update(batch_objects);
 		}
 
-		// 描画
-		glBindVertexArray(it->vao);
-		glDrawArrays(GL_TRIANGLES, 0, it->vertices.size());
+		// 同じ状態の描画を、1回のmulti drawにまとめる
+		std::vector<GLint> first;
+		std::vector<GLsizei> count;
+		for (int k = i; k < next; ++k) {
+			const GeometryObject& object = objects[renderQueue.items[k].object_name][item.texId];
+			first.push_back(object.batchFirst);
+			count.push_back(object.vertices.size());
+		}
+		batch.draw(first, count);
 
-		glBindVertexArray(0);
+		i = next;
 	}
+
+	renderQueue.clear();
 }
 
-void RenderManager::updateShadowMap(GLWidget3D* glWidget3D, const glm::vec3& light_dir, const glm::mat4& light_mvpMatrix) {
-	shadow.update(glWidget3D, light_dir, light_mvpMatrix);
+/**
+ * バックグラウンドでデコードが終わったテクスチャを、GPUに転送する。
+ * 1フレームあたりの転送数を制限して、UIが止まらないようにする。
+ *
+ * @param maxUploads	転送するテクスチャの最大数
+ * @return				まだデコード中のテクスチャがあればtrue
+ */
+bool RenderManager::processTextureUploads(int maxUploads) {
+	PassTimerScope scope(timer, "textures");
+
+	DecodedImage decoded;
+	for (int i = 0; i < maxUploads && textureLoader.popDecoded(decoded); ++i) {
+		resolvePendingTexture(decoded);
+	}
+
+	// アトラスのmipmapは、今回転送した分をまとめて1回だけ作り直す
+	atlas.updateMipmaps();
+
+	return textureLoader.hasPending();
+}
+
+/**
+ * デコードが終わったテクスチャを、アトラスまたは個別のテクスチャに転送し、
+ * placeholderで描画していた頂点を、そのテクスチャで描画するようにする。
+ */
+void RenderManager::resolvePendingTexture(const DecodedImage& decoded) {
+	QMap<QString, std::vector<Vertex> > pending = pendingVertices.take(decoded.filename);
+
+	bool inUnitRange = true;
+	for (auto it = pending.begin(); it != pending.end() && inUnitRange; ++it) {
+		for (int i = 0; i < it->size(); ++i) {
+			const glm::vec2& t = (*it)[i].texCoord;
+			if (t.x < 0.0f || t.x > 1.0f || t.y < 0.0f || t.y > 1.0f) {
+				inUnitRange = false;
+				break;
+			}
+		}
+	}
+
+	if (decoded.succeeded) {
+		// PBO経由で転送する
+		const void* pixels = textureLoader.stage(decoded.image);
+		if (!inUnitRange || atlas.contains(decoded.filename) || !atlas.add(decoded.filename, decoded.image.width(), decoded.image.height(), pixels)) {
+			textures[decoded.filename] = createTexture(decoded.image.width(), decoded.image.height(), pixels);
+		}
+		textureLoader.unstage();
+	} else {
+		// 読み込めなかったテクスチャは、テクスチャなしで描画する
+		textures[decoded.filename] = 0;
+	}
+
+	for (auto it = pending.begin(); it != pending.end(); ++it) {
+		updatePlaceholder(it.key());
+		addObject(it.key(), decoded.filename, it.value());
+	}
 }
 
-GLuint RenderManager::loadTexture(const QString& filename) {
-	QImage img;
-	if (!img.load(filename)) {
-		printf("ERROR: loading %s\n",filename.toUtf8().data());
-		return INT_MAX;
+/**
+ * 指定されたobjectのうち、placeholderで描画する頂点を、まだデコード中のものだけにする。
+ */
+void RenderManager::updatePlaceholder(const QString& object_name) {
+	if (!objects.contains(object_name) || !objects[object_name].contains(placeholderTexId)) return;
+
+	std::vector<Vertex> vertices;
+	for (auto it = pendingVertices.begin(); it != pendingVertices.end(); ++it) {
+		if (it->contains(object_name)) {
+			vertices.insert(vertices.end(), (*it)[object_name].begin(), (*it)[object_name].end());
+		}
 	}
 
-	QImage GL_formatted_image;
-	GL_formatted_image = QGLWidget::convertToGLFormat(img);
-	if (GL_formatted_image.isNull()) {
-		printf("ERROR: GL_formatted_image\n");
-		return INT_MAX;
+	if (vertices.empty()) {
+		objects[object_name].remove(placeholderTexId);
+	} else {
+		objects[object_name][placeholderTexId] = GeometryObject(vertices);
 	}
+	batches[placeholderTexId].outdated = true;
+}
+
+/**
+ * RGBAの画素から、mipmap付きのテクスチャを作成する。
+ *
+ * @param width		幅
+ * @param height	高さ
+ * @param pixels	RGBAの画素 (PBOがbindされている場合は、そのオフセット)
+ * @return			texture id
+ */
+GLuint RenderManager::createTexture(int width, int height, const void* pixels) {
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
 
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
 
-	GLuint texture;
-	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, GL_formatted_image.width(), GL_formatted_image.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, GL_formatted_image.bits());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 	glGenerateMipmap(GL_TEXTURE_2D);
 
 	return texture;
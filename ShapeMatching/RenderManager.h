@@ -3,45 +3,117 @@
 #include "glew.h"
 #include <vector>
 #include <QMap>
+#include <QSet>
 #include "Vertex.h"
 #include "ShadowMapping.h"
+#include "Shader.h"
+#include "RenderQueue.h"
+#include "TextureAtlas.h"
+#include "TextureLoader.h"
+#include "WeightedBlendedOIT.h"
+#include "PassTimer.h"
 
+/**
+ * 1つのobjectの、1つのテクスチャを使う頂点。
+ * GPU上の頂点は、同じテクスチャのTextureBatchのバッファ内の範囲にだけ置く。
+ */
 class GeometryObject {
 public:
-	GLuint vao;
-	GLuint vbo;
 	std::vector<Vertex> vertices;
-	bool vaoCreated;
-	bool vaoOutdated;
+	glm::vec3 minPt;
+	glm::vec3 maxPt;
+	GLint batchFirst;		// バッチのバッファ内の開始位置 (まだ範囲を割り当てていなければ-1)
+	GLsizei batchCapacity;	// バッチのバッファ内に割り当てた頂点数
+	bool outdated;			// 頂点が変わり、バッチのバッファへの転送が必要か
 
 public:
 	GeometryObject();
 	GeometryObject(const std::vector<Vertex>& vertices);
 	void addVertices(const std::vector<Vertex>& vertices);
-	void createVAO();
+	void updateEdgeMasks();
+
+private:
+	void updateBoundingBox(const std::vector<Vertex>& vertices);
+};
+
+/**
+ * 同じテクスチャを使う全objectの頂点を格納する、1つのバッファ。
+ * 各objectは、このバッファ内の範囲 (batchFirstから) に頂点を持ち、変わったobjectだけを転送する。
+ * 同じ状態の複数のobjectを、1回のmulti drawで描画するために使う。
+ */
+class TextureBatch {
+public:
+	GLuint vao;
+	GLuint vbo;
+	GLuint indirectBuffer;
+	GLsizei capacity;	// バッファの頂点数
+	GLsizei used;		// 割り当て済みの頂点数 (削除されたobjectの範囲も含む)
+	bool created;
+	bool outdated;
+
+public:
+	TextureBatch();
+	void update(const std::vector<GeometryObject*>& objects);
+	void draw(const std::vector<GLint>& first, const std::vector<GLsizei>& count);
+
+private:
+	void rebuild(const std::vector<GeometryObject*>& objects, GLsizei capacity);
+	void upload(GeometryObject* object);
 };
 
 class RenderManager {
+public:
+	static enum { FRAME_UNIFORM_BINDING = 0 };
+
 public:
 	GLuint program;
+	Shader shader;
+	ShaderUniforms uniforms;
+	GLuint frameUBO;
 	QMap<QString, QMap<GLuint, GeometryObject> > objects;
 	QMap<QString, GLuint> textures;
+	TextureAtlas atlas;
+	TextureLoader textureLoader;
+	GLuint placeholderTexId;
+	QMap<QString, QMap<QString, std::vector<Vertex> > > pendingVertices;
 	ShadowMapping shadow;
+	QMap<QString, std::vector<QString> > lodGroups;
+	std::vector<float> lodScreenSizes;
+	QSet<QString> lodHiddenObjects;
+	QSet<QString> translucentObjects;
+	WeightedBlendedOIT oit;
+	QMap<GLuint, TextureBatch> batches;
+	RenderQueue renderQueue;
+	PassTimer timer;
 
 public:
 	RenderManager();
 
-	void init(const std::string& vertex_file, const std::string& geometry_file, const std::string& fragment_file, int shadowMapSize);
+	void init(const std::string& vertex_file, const std::string& geometry_file, const std::string& fragment_file, int shadowMapSize, GLenum shadowDepthFormat = GL_DEPTH_COMPONENT24, int numShadowCascades = ShadowMapping::MAX_CASCADES, int atlasSize = 2048);
 	void addObject(const QString& object_name, const QString& texture_file, const std::vector<Vertex>& vertices);
+	void addObject(const QString& object_name, GLuint texId, const std::vector<Vertex>& vertices);
 	void removeObjects();
 	void removeObject(const QString& object_name);
 	void renderAll(bool wireframe = false);
 	void renderAllExcept(const QString& object_name, bool wireframe = false);
 	void render(const QString& object_name, bool wireframe = false);
-	void updateShadowMap(GLWidget3D* glWidget3D, const glm::vec3& light_dir, const glm::mat4& light_mvpMatrix);
+	void setTranslucent(const QString& object_name, bool translucent);
+	void renderTranslucent(bool wireframe = false);
+	void resize(int width, int height);
+	void setLODGroup(const QString& group_name, const std::vector<QString>& level_names);
+	void updateLOD(const glm::mat4& mvpMatrix, int screenHeight);
+	void setMatrices(const glm::mat4& mvpMatrix, const glm::mat4& mvMatrix);
+	void setLight(const glm::vec3& light_dir, const glm::mat4& light_mvpMatrix);
+	void setDrawMode(bool depthComputation, bool lineRendering);
+	bool processTextureUploads(int maxUploads = 4);
+	bool updateShadowMap(GLWidget3D* glWidget3D, const glm::vec3& light_dir, const Camera& camera);
 
 
 private:
-	GLuint loadTexture(const QString& filename);
+	void enqueue(const QString& object_name, GLuint program, bool wireframe);
+	void flushRenderQueue();
+	void resolvePendingTexture(const DecodedImage& decoded);
+	void updatePlaceholder(const QString& object_name);
+	GLuint createTexture(int width, int height, const void* pixels);
 };
 
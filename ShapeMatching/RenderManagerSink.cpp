@@ -0,0 +1,21 @@
+#include "RenderManagerSink.h"
+
+void RenderManagerSink::addObject(const std::string& object_name, const std::string& texture_file, const std::vector<Vertex>& vertices) {
+	renderManager->addObject(object_name.c_str(), texture_file.c_str(), vertices);
+}
+
+void RenderManagerSink::removeObject(const std::string& object_name) {
+	renderManager->removeObject(object_name.c_str());
+}
+
+void RenderManagerSink::setTranslucent(const std::string& object_name, bool translucent) {
+	renderManager->setTranslucent(object_name.c_str(), translucent);
+}
+
+void RenderManagerSink::setLODGroup(const std::string& group_name, const std::vector<std::string>& level_names) {
+	std::vector<QString> names;
+	for (int i = 0; i < level_names.size(); ++i) {
+		names.push_back(level_names[i].c_str());
+	}
+	renderManager->setLODGroup(group_name.c_str(), names);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "GeometrySink.h"
+#include "RenderManager.h"
+
+/**
+ * CGAが生成したジオメトリを、RenderManagerに登録するsink。
+ */
+class RenderManagerSink : public cga::GeometrySink {
+public:
+	RenderManager* renderManager;
+
+public:
+	RenderManagerSink() : renderManager(NULL) {}
+	RenderManagerSink(RenderManager* renderManager) : renderManager(renderManager) {}
+
+	void addObject(const std::string& object_name, const std::string& texture_file, const std::vector<Vertex>& vertices);
+	void removeObject(const std::string& object_name);
+	void setTranslucent(const std::string& object_name, bool translucent);
+	void setLODGroup(const std::string& group_name, const std::vector<std::string>& level_names);
+};
@@ -0,0 +1,39 @@
+#include "RenderQueue.h"
+#include <algorithm>
+
+bool DrawItem::sameState(const DrawItem& other) const {
+	return program == other.program && texId == other.texId && wireframe == other.wireframe;
+}
+
+bool DrawItem::operator<(const DrawItem& other) const {
+	if (program != other.program) return program < other.program;
+	if (texId != other.texId) return texId < other.texId;
+	if (wireframe != other.wireframe) return !wireframe;
+	return object_name < other.object_name;
+}
+
+void RenderQueue::clear() {
+	items.clear();
+}
+
+void RenderQueue::push(const DrawItem& item) {
+	items.push_back(item);
+}
+
+void RenderQueue::sort() {
+	std::sort(items.begin(), items.end());
+}
+
+/**
+ * 指定された描画から、状態が同じ描画が続く範囲の終わりを返却する。
+ *
+ * @param index		描画のindex
+ * @return			状態が変わる最初の描画のindex (最後まで同じなら、items.size())
+ */
+int RenderQueue::nextStateChange(int index) const {
+	int next = index + 1;
+	while (next < items.size() && items[next].sameState(items[index])) {
+		++next;
+	}
+	return next;
+}
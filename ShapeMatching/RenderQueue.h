@@ -0,0 +1,41 @@
+#pragma once
+
+#include "glew.h"
+#include <vector>
+#include <QString>
+
+/**
+ * 描画の単位。
+ * シェーダ、テクスチャ、wireframeの状態と、描画するobjectを保持する。
+ */
+class DrawItem {
+public:
+	GLuint program;
+	GLuint texId;
+	bool wireframe;
+	QString object_name;
+
+public:
+	DrawItem() {}
+	DrawItem(GLuint program, GLuint texId, bool wireframe, const QString& object_name) : program(program), texId(texId), wireframe(wireframe), object_name(object_name) {}
+
+	bool sameState(const DrawItem& other) const;
+	bool operator<(const DrawItem& other) const;
+};
+
+/**
+ * 1フレーム分の描画を集めて、シェーダ、テクスチャ、wireframeの順にソートする。
+ * 同じ状態の描画が連続するので、状態の変更を最小限にして、まとめて描画できる。
+ */
+class RenderQueue {
+public:
+	std::vector<DrawItem> items;
+
+public:
+	RenderQueue() {}
+
+	void clear();
+	void push(const DrawItem& item);
+	void sort();
+	int nextStateChange(int index) const;
+};
@@ -2,18 +2,83 @@
 #include "CGA.h"
 #include "Shape.h"
 #include "NumberEval.h"
+#include "Profiler.h"
 #include <sstream>
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cctype>
+#include <algorithm>
 
 namespace cga {
 
-float Value::getEstimateValue(float size, const RuleSet& ruleSet, const boost::shared_ptr<Shape>& shape) const {
-	if (type == Value::TYPE_ABSOLUTE) {
-		return ruleSet.evalFloat(value, shape);
-	} else if (type == Value::TYPE_RELATIVE) {
-		return ruleSet.evalFloat(value, shape) * size;
-	} else {
-		return ruleSet.evalFloat(value, shape);
+namespace {
+
+/**
+ * 式の評価器。
+ * 変数表を共有すると、複数のスレッドで同時にderivationした時に壊れるので、スレッド毎に持つ。
+ */
+class Evaluator {
+public:
+	myeval::variable_table variables;
+	myeval::calculator<std::string::const_iterator> calc;
+	unsigned int version;	// 変数表を作成した、compile()済みのRuleSetのバージョン (0なら毎回作り直す)
+	float* scope[3];		// 変数表の中の、scope.sx, scope.sy, scope.szの値
+
+public:
+	Evaluator() : calc(variables), version(0) {}
+};
+
+boost::thread_specific_ptr<Evaluator> evaluator;
+
+boost::mutex versionMutex;
+unsigned int lastVersion = 0;
+
+/**
+ * compile()毎に異なるバージョン番号を返す。
+ */
+unsigned int nextVersion() {
+	boost::mutex::scoped_lock lock(versionMutex);
+	if (++lastVersion == 0) ++lastVersion;
+	return lastVersion;
+}
+
+}
+
+/**
+ * 式に含まれる識別子 (attr名やscope.sxなど) を返す。
+ *
+ * @param expression		式
+ * @param names [OUT]		識別子
+ */
+void findIdentifiers(const std::string& expression, std::vector<std::string>& names) {
+	for (int i = 0; i < expression.size(); ) {
+		char c = expression[i];
+		if (isalpha((unsigned char)c) || c == '_') {
+			int begin = i;
+			while (i < expression.size() && (isalnum((unsigned char)expression[i]) || expression[i] == '_' || expression[i] == '.')) ++i;
+			names.push_back(expression.substr(begin, i - begin));
+		} else if (isdigit((unsigned char)c) || c == '.') {
+			// 1.5e3のような数値の中の文字を、識別子として扱わない
+			while (i < expression.size() && (isalnum((unsigned char)expression[i]) || expression[i] == '.')) ++i;
+		} else {
+			++i;
+		}
+	}
+}
+
+/**
+ * 同じルールの複数のshapeに、まとめて適用する。
+ * 各shapeに適用した結果でshapes[i]を置き換え、そのshapeの処理が終わった場合はNULLにする。
+ * 既定では、1つずつapply()する。まとめて計算できるオペレーションは、これを上書きする。
+ *
+ * @param shapes		shape
+ * @param ruleSet		全ルール
+ * @param stack			stack
+ */
+void Operator::applyBatch(std::vector<boost::shared_ptr<Shape> >& shapes, const RuleSet& ruleSet, std::list<boost::shared_ptr<Shape> >& stack) {
+	for (int i = 0; i < shapes.size(); ++i) {
+		shapes[i] = apply(shapes[i], ruleSet, stack);
 	}
 }
 
@@ -26,6 +91,8 @@ float Value::getEstimateValue(float size, const RuleSet& ruleSet, const boost::s
  * @param stack		stack
  */
 void Rule::apply(boost::shared_ptr<Shape>& shape, const RuleSet& ruleSet, std::list<boost::shared_ptr<Shape> >& stack) const {
+	PROFILE_SCOPE("rule", shape->_name);
+
 	for (int i = 0; i < operators.size(); ++i) {
 		shape = operators[i]->apply(shape, ruleSet, stack);
 		if (shape == NULL) break;
@@ -49,71 +116,372 @@ void Rule::apply(boost::shared_ptr<Shape>& shape, const RuleSet& ruleSet, std::l
 }
 
 /**
- * 指定されたsizeをsplitした後の、各断片のサイズを計算する。
+ * このルールを、このルールの名前を持つ複数のshapeに、まとめて適用する。
+ * オペレーション毎に全てのshapeへ適用するので、同じコードとデータを続けて使え、
+ * splitなどは、全てのshapeの分をまとめて計算できる。
+ *
+ * @param shapes	shape (適用後は空になる)
+ * @param ruleSet	全ルール
+ * @param stack		stack
+ */
+void Rule::applyBatch(std::vector<boost::shared_ptr<Shape> >& shapes, const RuleSet& ruleSet, std::list<boost::shared_ptr<Shape> >& stack) const {
+	if (shapes.empty()) return;
+
+	PROFILE_SCOPE("rule", shapes[0]->_name);
+
+	for (int i = 0; i < operators.size() && !shapes.empty(); ++i) {
+		operators[i]->applyBatch(shapes, ruleSet, stack);
+
+		// 処理が終わったshapeを除く
+		shapes.erase(std::remove(shapes.begin(), shapes.end(), boost::shared_ptr<Shape>()), shapes.end());
+	}
+
+	// apply()と同様に、copyで終わらない場合は、末尾に!を付加した名前にしてstackに格納する
+	if (operators.size() > 0 && operators.back()->name != "copy") {
+		for (int i = 0; i < shapes.size(); ++i) {
+			shapes[i]->_name += "!";
+			stack.push_back(shapes[i]);
+		}
+	}
+	shapes.clear();
+}
+
+/**
+ * 同じsplitを適用する複数のshapeについて、splitした後の各断片のサイズを計算する。
+ * 結果は、事前に確保した配列にまとめて書き込み、断片の名前はindexで返す。
+ * scope.*を参照しない式は、全てのshapeで同じ値なので、1回だけ評価する。
+ * repeatの断片の数は、MAX_REPEATまでとし、制限した場合はdecoded.clampedRepeatsに加算する。
  *
- * @param size							もとのsize
- * @param sizes							指定された、各断片のサイズ
- * @param output_names					指定された、各断片の名前
- * @param ruleSet						ルール (sizeなどで変数が使用されている場合、解決するため)
- * @param decoded_sizes	[OUT]			計算された、各断片のサイズ
- * @param decoded_output_names [OUT]	計算された、各断片の名前
+ * @param sizes				指定された、各断片のサイズ
+ * @param ruleSet			ルール (sizeなどで変数が使用されている場合、解決するため)
+ * @param shapes			shape [num_shapes]
+ * @param extents			各shapeの、split方向のsize [num_shapes]
+ * @param num_shapes		shapeの数
+ * @param decoded [OUT]		計算された、各断片のサイズと名前のindex
  */
-void Rule::decodeSplitSizes(float size, const std::vector<Value>& sizes, const std::vector<std::string>& output_names, const RuleSet& ruleSet, const boost::shared_ptr<Shape>& shape, std::vector<float>& decoded_sizes, std::vector<std::string>& decoded_output_names) {
-	float regular_sum = 0.0f;
-	float floating_sum = 0.0f;
-	int repeat_count = 0;
+void Rule::decodeSplitSizes(const std::vector<Value>& sizes, const RuleSet& ruleSet, const boost::shared_ptr<Shape>* shapes, const float* extents, int num_shapes, DecodedSplits& decoded) {
+	int num_values = sizes.size();
+	std::vector<float>& pieceSizes = decoded.pieceSizes;
+	std::vector<int>& pieceCounts = decoded.pieceCounts;
+	pieceSizes.resize(num_values * num_shapes);
+	pieceCounts.resize(num_values * num_shapes);
+	decoded.offsets.resize(num_shapes + 1);
+	decoded.offsets[0] = 0;
 
-	for (int i = 0; i < sizes.size(); ++i) {
-		if (sizes[i].repeat) {
-			repeat_count++;
+	// 指定されたサイズを評価する (pieceSizes[i * num_shapes + j]が、j番目のshapeでのi番目の値)
+	for (int i = 0; i < num_values; ++i) {
+		float* row = &pieceSizes[i * num_shapes];
+		if (num_shapes > 1 && RuleSet::classifyExpression(sizes[i].value) != RuleSet::EXPRESSION_SCOPE) {
+			std::fill(row, row + num_shapes, ruleSet.evalFloat(sizes[i].value, shapes[0]));
 		} else {
-			if (sizes[i].type == Value::TYPE_ABSOLUTE) {
-				regular_sum += ruleSet.evalFloat(sizes[i].value, shape);
-			} else if (sizes[i].type == Value::TYPE_RELATIVE) {
-				regular_sum += size * ruleSet.evalFloat(sizes[i].value, shape) * size;
-			} else if (sizes[i].type == Value::TYPE_FLOATING) {
-				floating_sum += ruleSet.evalFloat(sizes[i].value, shape);
+			for (int j = 0; j < num_shapes; ++j) {
+				row[j] = ruleSet.evalFloat(sizes[i].value, shapes[j]);
 			}
 		}
 	}
 
-	float floating_scale = 1.0f;
-	if (floating_sum > 0 && repeat_count == 0) {
-		floating_scale = (size - regular_sum) / floating_sum;
-	}
+	// shape毎に、断片のサイズと数を求める
+	for (int j = 0; j < num_shapes; ++j) {
+		float size = extents[j];
+		float regular_sum = 0.0f;
+		float floating_sum = 0.0f;
+		int repeat_count = 0;
 
-	for (int i = 0; i < sizes.size(); ++i) {
-		if (sizes[i].repeat) {
-			float s = sizes[i].getEstimateValue(size - regular_sum - floating_sum * floating_scale, ruleSet, shape);
-			int num = (size - regular_sum - floating_sum * floating_scale) / s;
-			s = (size - regular_sum - floating_sum * floating_scale) / num;
-			for (int k = 0; k < num; ++k) {
-				decoded_sizes.push_back(s);
-				decoded_output_names.push_back(output_names[i]);
-			}
-		} else {
-			if (sizes[i].type == Value::TYPE_ABSOLUTE) {
-				decoded_sizes.push_back(ruleSet.evalFloat(sizes[i].value, shape));
-				decoded_output_names.push_back(output_names[i]);
+		for (int i = 0; i < num_values; ++i) {
+			float value = pieceSizes[i * num_shapes + j];
+			if (sizes[i].repeat) {
+				repeat_count++;
+			} else if (sizes[i].type == Value::TYPE_ABSOLUTE) {
+				regular_sum += value;
 			} else if (sizes[i].type == Value::TYPE_RELATIVE) {
-				decoded_sizes.push_back(ruleSet.evalFloat(sizes[i].value, shape) * size);
-				decoded_output_names.push_back(output_names[i]);
+				regular_sum += size * value * size;
 			} else if (sizes[i].type == Value::TYPE_FLOATING) {
-				decoded_sizes.push_back(ruleSet.evalFloat(sizes[i].value, shape) * floating_scale);
-				decoded_output_names.push_back(output_names[i]);
+				floating_sum += value;
+			}
+		}
+
+		float floating_scale = 1.0f;
+		if (floating_sum > 0 && repeat_count == 0) {
+			floating_scale = (size - regular_sum) / floating_sum;
+		}
+		float remaining = size - regular_sum - floating_sum * floating_scale;
+
+		int total = 0;
+		for (int i = 0; i < num_values; ++i) {
+			int index = i * num_shapes + j;
+			if (sizes[i].repeat) {
+				// 0に近いサイズやNaNで、膨大な数の断片を作ったり、0で割ったりしないようにする
+				float s = sizes[i].type == Value::TYPE_RELATIVE ? pieceSizes[index] * remaining : pieceSizes[index];
+				int num = 0;
+				if (s > 0.0f && remaining / s >= 1.0f) {
+					num = (int)(std::min)(remaining / s, (float)MAX_REPEAT);
+					if (remaining / s >= MAX_REPEAT + 1) decoded.clampedRepeats++;
+				}
+				pieceSizes[index] = num > 0 ? remaining / num : 0.0f;
+				pieceCounts[index] = num;
+			} else {
+				if (sizes[i].type == Value::TYPE_RELATIVE) {
+					pieceSizes[index] *= size;
+				} else if (sizes[i].type == Value::TYPE_FLOATING) {
+					pieceSizes[index] *= floating_scale;
+				}
+				pieceCounts[index] = 1;
+			}
+			total += pieceCounts[index];
+		}
+		decoded.offsets[j + 1] = decoded.offsets[j] + total;
+	}
+
+	// 断片を書き出す
+	decoded.sizes.resize(decoded.offsets[num_shapes]);
+	decoded.names.resize(decoded.offsets[num_shapes]);
+	for (int j = 0; j < num_shapes; ++j) {
+		int n = decoded.offsets[j];
+		for (int i = 0; i < num_values; ++i) {
+			int index = i * num_shapes + j;
+			float s = pieceSizes[index];
+			for (int k = 0; k < pieceCounts[index]; ++k, ++n) {
+				decoded.sizes[n] = s;
+				decoded.names[n] = i;
 			}
 		}
 	}
 }
 
 void RuleSet::clear() {
+	base.reset();
 	attrs.clear();
 	rules.clear();
+	invalidate();
 }
 
 bool RuleSet::contain(const std::string& name) const {
-	if (rules.find(name) == rules.end()) return false;
-	else return true;
+	for (const RuleSet* layer = this; layer != NULL; layer = layer->base.get()) {
+		if (layer->rules.find(name) != layer->rules.end()) return true;
+	}
+	return false;
+}
+
+/**
+ * 指定された名前のルールを、上のレイヤから順に探して返す。
+ *
+ * @param name		ルール名
+ * @return			ルール
+ */
+const Rule& RuleSet::getRule(const std::string& name) const {
+	for (const RuleSet* layer = this; layer != NULL; layer = layer->base.get()) {
+		auto it = layer->rules.find(name);
+		if (it != layer->rules.end()) return it->second;
+	}
+	throw "No rule is found for " + name + ".";
+}
+
+/**
+ * 指定された名前のattrの値を、上のレイヤから順に探して返す。
+ *
+ * @param name		attr名
+ * @return			値 (なければNULL)
+ */
+const std::string* RuleSet::findAttr(const std::string& name) const {
+	for (const RuleSet* layer = this; layer != NULL; layer = layer->base.get()) {
+		auto it = layer->attrs.find(name);
+		if (it != layer->attrs.end()) return &it->second;
+	}
+	return NULL;
+}
+
+/**
+ * このレイヤの内容を、変更しない新たなbaseに移す。
+ * この後でこのRuleSetをコピーしても、baseは共有されるので、コピーの時間は上書きしたものの数だけに比例する。
+ * レイヤがMAX_LAYERSを超えたら、探索が遅くならないよう、1つにまとめる。
+ */
+void RuleSet::freeze() {
+	if (attrs.empty() && rules.empty()) return;
+
+	int num_layers = 1;
+	for (const RuleSet* layer = base.get(); layer != NULL; layer = layer->base.get()) {
+		num_layers++;
+	}
+	if (num_layers > MAX_LAYERS) {
+		flatten();
+	}
+
+	boost::shared_ptr<RuleSet> frozen(new RuleSet());
+	frozen->base = base;
+	frozen->attrs.swap(attrs);
+	frozen->rules.swap(rules);
+
+	// compile()の結果は、移したレイヤのものなので、そのまま共有する (なければ、ここで一度だけcompile()する)
+	if (compiled != NULL) {
+		frozen->compiled = compiled;
+	} else {
+		frozen->compile();
+	}
+
+	base = frozen;
+	invalidate();
+}
+
+/**
+ * 式を、定数 (EXPRESSION_CONSTANT)、attrだけを参照する式 (EXPRESSION_ATTR)、
+ * scope.*を参照する式 (EXPRESSION_SCOPE) に分類する。
+ */
+int RuleSet::classifyExpression(const std::string& expression) {
+	std::vector<std::string> names;
+	findIdentifiers(expression, names);
+
+	int type = EXPRESSION_CONSTANT;
+	for (int i = 0; i < names.size(); ++i) {
+		if (names[i].compare(0, 6, "scope.") == 0) return EXPRESSION_SCOPE;
+		type = EXPRESSION_ATTR;
+	}
+	return type;
+}
+
+/**
+ * 式を事前に評価する。
+ * 数値のattrの値と、このレイヤのルールの式のうち、scope.*を参照しないものの値を求めておく。
+ * 下のレイヤの式は、baseの結果を共有し、このレイヤで上書きしたattrを参照するものだけを評価し直す。
+ * (baseがcompile()されていなければ、全てのレイヤを、このレイヤで評価する)
+ * これにより、derivation中の評価は、scope.*を参照する式だけになる。
+ * compile()済みで、その後変更されていなければ、何もしない。
+ */
+void RuleSet::compile() {
+	if (compiled != NULL) return;
+
+	PROFILE_SCOPE("cga", "RuleSet::compile");
+
+	boost::shared_ptr<CompiledLayer> layer(new CompiledLayer());
+	layer->version = nextVersion();
+	layer->complete = base == NULL || base->compiled == NULL;
+
+	for (const RuleSet* l = this; l != NULL; l = l->base.get()) {
+		for (auto it = l->attrs.begin(); it != l->attrs.end(); ++it) {
+			// 上のレイヤで上書きされたattrは使わない
+			if (l != this && findAttr(it->first) != &it->second) continue;
+
+			float val;
+			if (sscanf(it->second.c_str(), "%f", &val) != EOF) {
+				layer->numericAttrs[it->first] = val;
+			}
+		}
+		if (!layer->complete) break;
+	}
+
+	// このレイヤのルールの式 (上のレイヤで上書きされたルールは使わない)
+	std::set<std::string> expressions;
+	std::set<std::string> visited;
+	for (const RuleSet* l = this; l != NULL; l = l->base.get()) {
+		for (auto it = l->rules.begin(); it != l->rules.end(); ++it) {
+			if (!visited.insert(it->first).second) continue;
+
+			std::vector<std::string> rule_expressions;
+			for (int i = 0; i < it->second.operators.size(); ++i) {
+				it->second.operators[i]->getExpressions(rule_expressions);
+			}
+			for (int i = 0; i < rule_expressions.size(); ++i) {
+				if (classifyExpression(rule_expressions[i]) == EXPRESSION_SCOPE) continue;
+				expressions.insert(rule_expressions[i]);
+			}
+		}
+		if (!layer->complete) break;
+	}
+
+	// 上のレイヤがattrを上書きした時に評価し直せるよう、attr毎に、それを参照する式を覚えておく
+	for (auto it = expressions.begin(); it != expressions.end(); ++it) {
+		std::vector<std::string> names;
+		findIdentifiers(*it, names);
+		for (int k = 0; k < names.size(); ++k) {
+			std::vector<std::string>& dependents = layer->dependents[names[k]];
+			if (dependents.empty() || dependents.back() != *it) dependents.push_back(*it);
+		}
+	}
+
+	// このレイヤで上書きしたattrを参照する、下のレイヤの式も評価し直す
+	if (!layer->complete) {
+		for (auto it = attrs.begin(); it != attrs.end(); ++it) {
+			for (const RuleSet* l = base.get(); l != NULL; l = l->base.get()) {
+				auto dependents = l->compiled->dependents.find(it->first);
+				if (dependents != l->compiled->dependents.end()) {
+					expressions.insert(dependents->second.begin(), dependents->second.end());
+				}
+				if (l->compiled->complete) break;
+			}
+		}
+	}
+
+	// 評価には、このレイヤの数値のattrを使うので、先にcompiledに設定する
+	compiled = layer;
+	for (auto it = expressions.begin(); it != expressions.end(); ++it) {
+		foldExpression(*it, layer.get());
+	}
+}
+
+/**
+ * 数値のattrの値を、上のレイヤから順に探して返す。compile()済みであること。
+ *
+ * @param name		attr名
+ * @return			値 (ない、または数値でない値で上書きされている場合はNULL)
+ */
+const float* RuleSet::findNumericAttr(const std::string& name) const {
+	for (const RuleSet* layer = this; layer != NULL; layer = layer->base.get()) {
+		auto it = layer->compiled->numericAttrs.find(name);
+		if (it != layer->compiled->numericAttrs.end()) return &it->second;
+		if (layer->compiled->complete || layer->attrs.find(name) != layer->attrs.end()) return NULL;
+	}
+	return NULL;
+}
+
+/**
+ * scope.*を参照しない式を評価し、compile()の結果に格納する。
+ * 未定義のattrを参照する式は、derivationの時にエラーを報告させるため、評価しない。
+ *
+ * @param expression	式
+ * @param layer			compile()の結果
+ */
+void RuleSet::foldExpression(const std::string& expression, CompiledLayer* layer) const {
+	std::vector<std::string> names;
+	findIdentifiers(expression, names);
+	for (int k = 0; k < names.size(); ++k) {
+		if (findNumericAttr(names[k]) == NULL) {
+			layer->unfolded.insert(expression);
+			return;
+		}
+	}
+
+	try {
+		layer->foldedValues[expression] = evaluate(expression, glm::vec3());
+	} catch (...) {
+		layer->unfolded.insert(expression);
+	}
+}
+
+/**
+ * compile()の結果を破棄する。baseの結果は共有しているので、そのまま使う。
+ */
+void RuleSet::invalidate() {
+	compiled.reset();
+}
+
+/**
+ * 全てのレイヤを、このレイヤにまとめる。baseは無くなる。
+ */
+void RuleSet::flatten() {
+	if (base == NULL) return;
+
+	RuleSet flat = *base;
+	flat.flatten();
+	for (auto it = attrs.begin(); it != attrs.end(); ++it) {
+		flat.attrs[it->first] = it->second;
+	}
+	for (auto it = rules.begin(); it != rules.end(); ++it) {
+		flat.rules[it->first] = it->second;
+	}
+
+	base.reset();
+	attrs.swap(flat.attrs);
+	rules.swap(flat.rules);
+	invalidate();
 }
 
 /**
@@ -124,6 +492,7 @@ bool RuleSet::contain(const std::string& name) const {
  */
 void RuleSet::addAttr(const std::string& name, const std::string& value) {
 	attrs[name] = value;
+	invalidate();
 }
 
 /**
@@ -133,6 +502,7 @@ void RuleSet::addAttr(const std::string& name, const std::string& value) {
  */
 void RuleSet::addRule(const std::string& name) {
 	rules[name].operators.clear();
+	invalidate();
 }
 
 /**
@@ -143,6 +513,7 @@ void RuleSet::addRule(const std::string& name) {
  */
 void RuleSet::addOperator(const std::string& name, const boost::shared_ptr<Operator>& op) {
 	rules[name].operators.push_back(op);
+	invalidate();
 }
 
 /**
@@ -153,24 +524,81 @@ void RuleSet::addOperator(const std::string& name, const boost::shared_ptr<Opera
  * @return				変換された数値
  */
 float RuleSet::evalFloat(const std::string& attr_name, const boost::shared_ptr<Shape>& shape) const {
-	myeval::calculator<std::string::const_iterator> calc;
+	PROFILE_SCOPE("evalFloat", attr_name);
 
-	myeval::variables.clear();
-	myeval::variables.add("scope.sx", shape->_scope.x);
-	myeval::variables.add("scope.sy", shape->_scope.y);
-	myeval::variables.add("scope.sz", shape->_scope.z);
+	// scope.*を参照しない式は、compile()で評価済み (上のレイヤから順に探す)
+	if (compiled != NULL) {
+		for (const RuleSet* layer = this; layer != NULL; layer = layer->base.get()) {
+			auto it = layer->compiled->foldedValues.find(attr_name);
+			if (it != layer->compiled->foldedValues.end()) return it->second;
+			if (layer->compiled->complete || layer->compiled->unfolded.find(attr_name) != layer->compiled->unfolded.end()) break;
+		}
+	}
 
-	for (auto it = attrs.begin(); it != attrs.end(); ++it) {
-		float val;
-		if (sscanf(it->second.c_str(), "%f", &val) != EOF) {
-			myeval::variables.add(it->first, val);
+	return evaluate(attr_name, shape->_scope);
+}
+
+/**
+ * 式を評価する。
+ * compile()済みなら、スレッド毎の変数表を使い回し、scope.*の値だけを更新する。
+ *
+ * @param attr_name	式
+ * @param scope			scope.sx, scope.sy, scope.szの値
+ * @return				評価した値
+ */
+float RuleSet::evaluate(const std::string& attr_name, const glm::vec3& scope) const {
+	if (evaluator.get() == NULL) {
+		evaluator.reset(new Evaluator());
+	}
+	myeval::variable_table& variables = evaluator->variables;
+
+	unsigned int version = compiled != NULL ? compiled->version : 0;
+	if (version == 0 || evaluator->version != version) {
+		variables.clear();
+		variables.add("scope.sx", 0.0f);
+		variables.add("scope.sy", 0.0f);
+		variables.add("scope.sz", 0.0f);
+
+		if (version != 0) {
+			// 上のレイヤで追加したattrを優先し、数値でない値で上書きされたattrは使わない
+			std::set<std::string> added;
+			for (const RuleSet* layer = this; layer != NULL; layer = layer->base.get()) {
+				for (auto it = layer->compiled->numericAttrs.begin(); it != layer->compiled->numericAttrs.end(); ++it) {
+					if (added.insert(it->first).second) variables.add(it->first, it->second);
+				}
+				if (layer->compiled->complete) break;
+				for (auto it = layer->attrs.begin(); it != layer->attrs.end(); ++it) {
+					added.insert(it->first);
+				}
+			}
+		} else {
+			for (const RuleSet* layer = this; layer != NULL; layer = layer->base.get()) {
+				for (auto it = layer->attrs.begin(); it != layer->attrs.end(); ++it) {
+					// 上のレイヤで上書きされたattrは使わない
+					if (layer != this && findAttr(it->first) != &it->second) continue;
+
+					float val;
+					if (sscanf(it->second.c_str(), "%f", &val) != EOF) {
+						variables.add(it->first, val);
+					}
+				}
+			}
 		}
+
+		evaluator->scope[0] = &variables.at("scope.sx");
+		evaluator->scope[1] = &variables.at("scope.sy");
+		evaluator->scope[2] = &variables.at("scope.sz");
+		evaluator->version = version;
 	}
 
+	*evaluator->scope[0] = scope.x;
+	*evaluator->scope[1] = scope.y;
+	*evaluator->scope[2] = scope.z;
+
 	float result;
 	std::string::const_iterator iter = attr_name.begin();
 	std::string::const_iterator end = attr_name.end();
-	bool r = phrase_parse(iter, end, calc, boost::spirit::ascii::space, result);
+	bool r = phrase_parse(iter, end, evaluator->calc, boost::spirit::ascii::space, result);
 	if (r && iter == end) {
 		return result;
 	} else {
@@ -189,14 +617,27 @@ float RuleSet::evalFloat(const std::string& attr_name, const boost::shared_ptr<S
  * @return				変換された文字列
  */
 std::string RuleSet::evalString(const std::string& attr_name, const boost::shared_ptr<Shape>& shape) const {
-	if (attrs.find(attr_name) == attrs.end()) {
+	const std::string* value = findAttr(attr_name);
+	if (value == NULL) {
 		return attr_name;
 	} else {
-		return attrs.at(attr_name);
+		return *value;
 	}
 }
 
+/**
+ * 指定されたルールを、このレイヤにマージする。
+ */
 void RuleSet::merge(const RuleSet& ruleSet) {
+	if (ruleSet.base != NULL) {
+		RuleSet flat = ruleSet;
+		flat.flatten();
+		merge(flat);
+		return;
+	}
+
+	invalidate();
+
 	for (auto it = ruleSet.attrs.begin(); it != ruleSet.attrs.end(); ++it) {
 		this->attrs[it->first] = it->second;
 	}
@@ -205,4 +646,34 @@ void RuleSet::merge(const RuleSet& ruleSet) {
 	}
 }
 
+/**
+ * 指定されたルールを、開始ルールの名前を置き換えてマージする。
+ * 共有しているRuleSetをコピーせずに、別のnonterminalから始まるルールとして取り込むために使う。
+ *
+ * @param ruleSet			マージするルール
+ * @param start_name		ruleSetの開始ルールの名前
+ * @param new_start_name	マージ後の開始ルールの名前
+ */
+void RuleSet::merge(const RuleSet& ruleSet, const std::string& start_name, const std::string& new_start_name) {
+	if (ruleSet.base != NULL) {
+		RuleSet flat = ruleSet;
+		flat.flatten();
+		merge(flat, start_name, new_start_name);
+		return;
+	}
+
+	invalidate();
+
+	for (auto it = ruleSet.attrs.begin(); it != ruleSet.attrs.end(); ++it) {
+		this->attrs[it->first] = it->second;
+	}
+	for (auto it = ruleSet.rules.begin(); it != ruleSet.rules.end(); ++it) {
+		if (it->first == start_name) {
+			this->rules[new_start_name] = it->second;
+		} else {
+			this->rules[it->first] = it->second;
+		}
+	}
+}
+
 }
@@ -3,7 +3,9 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
 #include <list>
+#include <iosfwd>
 #include <boost/shared_ptr.hpp>
 #include "Shape.h"
 
@@ -23,8 +25,6 @@ public:
 public:
 	Value() : type(TYPE_ABSOLUTE), value(""), repeat(false) {}
 	Value(int type, const std::string& value, bool repeat = false) : type(type), value(value), repeat(repeat) {}
-	
-	float getEstimateValue(float size, const RuleSet& ruleSet, const boost::shared_ptr<Shape>& shape) const;
 };
 
 class Operator {
@@ -35,9 +35,45 @@ public:
 	Operator() {}
 
 	virtual boost::shared_ptr<Shape> apply(boost::shared_ptr<Shape>& shape, const RuleSet& ruleSet, std::list<boost::shared_ptr<Shape> >& stack) = 0;
+	virtual void applyBatch(std::vector<boost::shared_ptr<Shape> >& shapes, const RuleSet& ruleSet, std::list<boost::shared_ptr<Shape> >& stack);
+	virtual void save(std::ostream& out) const = 0;
+
+	/**
+	 * 適用後にstackへ格納するshapeの名前を追加する (ルールの呼び出しグラフを作るため)。
+	 */
+	virtual void getOutputNames(std::vector<std::string>& names) const {}
+
+	/**
+	 * 適用時に評価する式を追加する (参照するattrを調べるため)。
+	 */
+	virtual void getExpressions(std::vector<std::string>& expressions) const {}
+};
+
+/**
+ * Rule::decodeSplitSizes()で、同じsplitを複数のshapeにまとめて適用した結果。
+ * i番目のshapeの断片は、sizesとnamesの[offsets[i], offsets[i + 1])に格納する。
+ * 断片の名前は、splitで指定された名前のindexで表す。
+ * 使い回せば、2回目以降はメモリを確保し直さない。
+ */
+class DecodedSplits {
+public:
+	std::vector<int> offsets;
+	std::vector<float> sizes;
+	std::vector<int> names;
+
+	std::vector<float> pieceSizes;		// 作業領域 (指定されたサイズ毎、shape毎の断片のサイズ)
+	std::vector<int> pieceCounts;		// 作業領域 (指定されたサイズ毎、shape毎の断片の数)
+
+	int clampedRepeats;					// 断片の数をMAX_REPEATに制限したrepeatの数 (呼び出し毎に加算する)
+
+public:
+	DecodedSplits() : clampedRepeats(0) {}
 };
 
 class Rule {
+public:
+	static enum { MAX_REPEAT = 1000 };
+
 public:
 	std::vector<boost::shared_ptr<Operator> > operators;
 
@@ -45,21 +81,64 @@ public:
 	Rule() {}
 
 	void apply(boost::shared_ptr<Shape>& shape, const RuleSet& ruleSet, std::list<boost::shared_ptr<Shape> >& stack) const;
-	static void decodeSplitSizes(float size, const std::vector<Value>& sizes, const std::vector<std::string>& output_names, const RuleSet& ruleSet, const boost::shared_ptr<Shape>& shape, std::vector<float>& decoded_sizes, std::vector<std::string>& decoded_output_names);
+	void applyBatch(std::vector<boost::shared_ptr<Shape> >& shapes, const RuleSet& ruleSet, std::list<boost::shared_ptr<Shape> >& stack) const;
+	static void decodeSplitSizes(const std::vector<Value>& sizes, const RuleSet& ruleSet, const boost::shared_ptr<Shape>* shapes, const float* extents, int num_shapes, DecodedSplits& decoded);
 };
 
+void findIdentifiers(const std::string& expression, std::vector<std::string>& names);
+
+/**
+ * 1つのレイヤをcompile()した結果。下のレイヤの結果と合わせて使う。
+ * 作成後は変更しないので、RuleSetのコピーや、freeze()したbaseとの間で共有する。
+ */
+class CompiledLayer {
+public:
+	unsigned int version;										// compile()毎に異なるバージョン (式の評価器の変数表を作り直すために使う)
+	bool complete;												// 下のレイヤの結果を使わず、このレイヤだけで全体を表すか
+	std::map<std::string, float> numericAttrs;					// このレイヤのattrのうち、数値として評価できるもの
+	std::map<std::string, float> foldedValues;					// このレイヤで評価した、scope.*を参照しない式 -> 値
+	std::set<std::string> unfolded;								// 下のレイヤで評価済みだが、このレイヤのattrでは評価できない式
+	std::map<std::string, std::vector<std::string> > dependents;	// attr名 -> このレイヤのルールの、そのattrを参照する式
+
+public:
+	CompiledLayer() : version(0), complete(false) {}
+};
+
+/**
+ * ルールとattrの集合。
+ * 変更しないbaseの上に、このRuleSetで追加/上書きしたattrとルールを重ねたものとして表す。
+ * 提案のように、大きな文法の一部だけを変えたものを、文法全体をコピーせずに作るために使う。
+ * attrsとrulesは、このレイヤの分だけを持つので、全体を参照する場合はfindAttr()やgetRule()を使うこと。
+ *
+ * compile()すると、scope.*を参照しない式を事前に評価し、evalFloat()はその値を返す。
+ * compile()の結果はレイヤ毎に持ち、baseの結果は共有するので、compile()はこのレイヤと、
+ * このレイヤで上書きしたattrを参照する式だけを評価する。
+ * attrsやrulesを直接書き換えた場合は、invalidate()してからcompile()すること。
+ */
 class RuleSet {
 public:
+	static enum { MAX_LAYERS = 8 };
+	static enum { EXPRESSION_CONSTANT = 0, EXPRESSION_ATTR, EXPRESSION_SCOPE };
+
+	boost::shared_ptr<const RuleSet> base;
 	std::map<std::string, std::string> attrs;
 	std::map<std::string, cga::Rule> rules;
 
+	boost::shared_ptr<const CompiledLayer> compiled;	// このレイヤをcompile()した結果 (NULLならcompile()されていない)
+
 public:
 	RuleSet() {}
 
 	void clear();
 	bool contain(const std::string& name) const;
-	Rule getRule(const std::string& name) const { return rules.at(name); }
-	Rule& getRule(const std::string& name) { return rules[name]; }
+	const Rule& getRule(const std::string& name) const;
+	Rule& getRule(const std::string& name) { invalidate(); return rules[name]; }
+	const std::string* findAttr(const std::string& name) const;
+	void freeze();
+	void flatten();
+	void compile();
+	void invalidate();
+	static int classifyExpression(const std::string& expression);
 	void addAttr(const std::string& name, const std::string& value);
 	void addRule(const std::string& name);
 	void addOperator(const std::string& name, const boost::shared_ptr<Operator>& op);
@@ -67,6 +146,12 @@ public:
 	std::string evalString(const std::string& attr_name, const boost::shared_ptr<Shape>& shape) const;
 
 	void merge(const RuleSet& ruleSet);
+	void merge(const RuleSet& ruleSet, const std::string& start_name, const std::string& new_start_name);
+
+private:
+	const float* findNumericAttr(const std::string& name) const;
+	void foldExpression(const std::string& expression, CompiledLayer* layer) const;
+	float evaluate(const std::string& attr_name, const glm::vec3& scope) const;
 };
 
 }
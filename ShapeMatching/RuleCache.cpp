@@ -0,0 +1,256 @@
+#include "RuleCache.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include "RuleParser.h"
+#include "CompOperator.h"
+#include "CopyOperator.h"
+#include "ExtrudeOperator.h"
+#include "SplitOperator.h"
+#include "RuleGraph.h"
+#include "Profiler.h"
+
+namespace cga {
+
+namespace {
+
+const char CACHE_MAGIC[4] = { 'C', 'G', 'A', 'R' };
+
+// 壊れたキャッシュで巨大な領域を確保しないよう、文字列の長さに上限を設ける
+const int MAX_STRING_LENGTH = 1 << 20;
+
+}
+
+/**
+ * ルールを読み込む。
+ * 同じ内容のファイルを読み込み済みならそれを返し、ディスクにキャッシュがあればそれを読み込む。
+ * どちらもなければXMLをパースし、結果をキャッシュに保存する。
+ * 返却したRuleSetは他と共有しているので、変更する場合はコピーすること。
+ * axiom_nameが指定された場合は、RuleGraphで解析し、axiomから到達できないルールを除いて、再帰しているルールを警告する。
+ * ディスクのキャッシュには、除く前のルールを保存するので、同じファイルを別のaxiomで読み込んでもよい。
+ *
+ * @param filename		XMLファイル
+ * @param axiom_name	axiomのshape名 (空なら解析しない)
+ * @return				ルール
+ */
+boost::shared_ptr<const RuleSet> RuleCache::load(const std::string& filename, const std::string& axiom_name) {
+	PROFILE_SCOPE("cga", "RuleCache::load");
+
+	std::string hash = hashFile(filename);
+	if (hash.empty()) {
+		throw "Cannot open " + filename;
+	}
+
+	boost::mutex::scoped_lock lock(mutex);
+
+	// 解析の有無とaxiomで、除かれるルールが異なるので、別々にキャッシュする
+	std::string key = hash + "/" + axiom_name;
+	auto it = ruleSets.find(key);
+	if (it != ruleSets.end()) return it->second;
+
+	boost::shared_ptr<RuleSet> ruleSet(new RuleSet());
+	std::string cache_file;
+	if (!cache_dir.empty()) {
+		cache_file = (boost::filesystem::path(cache_dir) / (hash + ".bin")).string();
+	}
+
+	if (cache_file.empty() || !loadBinary(cache_file, *ruleSet)) {
+		parseRules(filename, *ruleSet);
+
+		if (!cache_file.empty()) {
+			boost::system::error_code ec;
+			boost::filesystem::create_directories(cache_dir, ec);
+			saveBinary(cache_file, *ruleSet);
+		}
+	}
+
+	if (!axiom_name.empty()) {
+		RuleGraph graph;
+		graph.check(*ruleSet, axiom_name, filename, std::cout);
+	}
+
+	// 共有するRuleSetは変更しないので、ここで一度だけcompile()し、その上に重ねたRuleSetは結果を使い回す
+	ruleSet->compile();
+
+	ruleSets[key] = ruleSet;
+	return ruleSet;
+}
+
+/**
+ * メモリ上のキャッシュを消去する。ディスクのキャッシュは残す。
+ */
+void RuleCache::clear() {
+	boost::mutex::scoped_lock lock(mutex);
+	ruleSets.clear();
+}
+
+/**
+ * ファイルの内容のハッシュ値 (64bit FNV-1a) を、16進数の文字列で返す。
+ * キャッシュの形式が変わった時に古いキャッシュを使わないよう、FORMAT_VERSIONも混ぜる。
+ *
+ * @param filename		ファイル名
+ * @return				ハッシュ値 (ファイルが開けなければ空文字列)
+ */
+std::string RuleCache::hashFile(const std::string& filename) {
+	std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!in.is_open()) return "";
+
+	unsigned long long hash = 14695981039346656037ULL;
+	hash = (hash ^ FORMAT_VERSION) * 1099511628211ULL;
+
+	char buffer[4096];
+	while (in) {
+		in.read(buffer, sizeof(buffer));
+		for (int i = 0; i < in.gcount(); ++i) {
+			hash = (hash ^ (unsigned char)buffer[i]) * 1099511628211ULL;
+		}
+	}
+
+	std::stringstream ss;
+	ss << std::hex << std::setw(16) << std::setfill('0') << hash;
+	return ss.str();
+}
+
+/**
+ * ルールをバイナリ形式で保存する。
+ *
+ * @param filename		ファイル名
+ * @param ruleSet		ルール
+ * @return				保存できたらtrue
+ */
+bool RuleCache::saveBinary(const std::string& filename, const RuleSet& ruleSet) {
+	if (ruleSet.base != NULL) {
+		RuleSet flat = ruleSet;
+		flat.flatten();
+		return saveBinary(filename, flat);
+	}
+
+	// 書き込み途中のファイルを他のプロセスが読まないよう、一時ファイルに書いてから名前を変える
+	std::string tmp_filename = filename + ".tmp";
+	{
+		std::ofstream out(tmp_filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) return false;
+
+		out.write(CACHE_MAGIC, 4);
+		writeInt(out, FORMAT_VERSION);
+
+		writeInt(out, ruleSet.attrs.size());
+		for (auto it = ruleSet.attrs.begin(); it != ruleSet.attrs.end(); ++it) {
+			writeString(out, it->first);
+			writeString(out, it->second);
+		}
+
+		writeInt(out, ruleSet.rules.size());
+		for (auto it = ruleSet.rules.begin(); it != ruleSet.rules.end(); ++it) {
+			writeString(out, it->first);
+			writeInt(out, it->second.operators.size());
+			for (int i = 0; i < it->second.operators.size(); ++i) {
+				writeString(out, it->second.operators[i]->name);
+				it->second.operators[i]->save(out);
+			}
+		}
+
+		if (out.fail()) return false;
+	}
+
+	boost::system::error_code ec;
+	boost::filesystem::rename(tmp_filename, filename, ec);
+	if (ec) {
+		boost::filesystem::remove(tmp_filename, ec);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * バイナリ形式のルールを読み込む。
+ *
+ * @param filename			ファイル名
+ * @param ruleSet [OUT]		ルール
+ * @return					読み込めたらtrue (ファイルがない、壊れている、形式が古い場合はfalse)
+ */
+bool RuleCache::loadBinary(const std::string& filename, RuleSet& ruleSet) {
+	ruleSet.clear();
+
+	std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!in.is_open()) return false;
+
+	try {
+		char magic[4];
+		in.read(magic, 4);
+		if (!in || !std::equal(magic, magic + 4, CACHE_MAGIC)) return false;
+		if (readInt(in) != FORMAT_VERSION) return false;
+
+		int numAttrs = readInt(in);
+		for (int i = 0; i < numAttrs; ++i) {
+			std::string name = readString(in);
+			ruleSet.addAttr(name, readString(in));
+		}
+
+		int numRules = readInt(in);
+		for (int i = 0; i < numRules; ++i) {
+			std::string name = readString(in);
+			ruleSet.addRule(name);
+
+			int numOperators = readInt(in);
+			for (int k = 0; k < numOperators; ++k) {
+				std::string operator_name = readString(in);
+				if (operator_name == "comp") {
+					ruleSet.addOperator(name, CompOperator::load(in));
+				} else if (operator_name == "copy") {
+					ruleSet.addOperator(name, CopyOperator::load(in));
+				} else if (operator_name == "extrude") {
+					ruleSet.addOperator(name, ExtrudeOperator::load(in));
+				} else if (operator_name == "split") {
+					ruleSet.addOperator(name, SplitOperator::load(in));
+				} else {
+					throw "Unknown operator in the rule cache: " + operator_name;
+				}
+			}
+		}
+	} catch (const char* ex) {
+		std::cout << "Ignoring the rule cache " << filename << ": " << ex << std::endl;
+		ruleSet.clear();
+		return false;
+	} catch (const std::string& ex) {
+		std::cout << "Ignoring the rule cache " << filename << ": " << ex << std::endl;
+		ruleSet.clear();
+		return false;
+	}
+
+	return true;
+}
+
+void writeInt(std::ostream& out, int value) {
+	out.write((const char*)&value, sizeof(int));
+}
+
+int readInt(std::istream& in) {
+	int value;
+	in.read((char*)&value, sizeof(int));
+	if (!in) throw "Unexpected end of the rule cache.";
+	return value;
+}
+
+void writeString(std::ostream& out, const std::string& str) {
+	writeInt(out, str.size());
+	out.write(str.data(), str.size());
+}
+
+std::string readString(std::istream& in) {
+	int length = readInt(in);
+	if (length < 0 || length > MAX_STRING_LENGTH) throw "Invalid string in the rule cache.";
+
+	std::string str(length, '\0');
+	if (length > 0) {
+		in.read(&str[0], length);
+		if (!in) throw "Unexpected end of the rule cache.";
+	}
+	return str;
+}
+
+}
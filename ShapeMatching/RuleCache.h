@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <iosfwd>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include "Rule.h"
+
+namespace cga {
+
+/**
+ * XMLファイルから読み込んだルールのキャッシュ。
+ * 読み込んだRuleSetは変更しない前提で共有し、同じ内容のファイルは2度読み込まない。
+ * また、パース結果をバイナリ形式でcache_dirに保存し、次回からはXMLのパースを省略する。
+ * キャッシュのキーはファイルの内容のハッシュ値なので、XMLを編集すれば自動的に読み直す。
+ */
+class RuleCache {
+public:
+	static enum { FORMAT_VERSION = 1 };
+
+	std::string cache_dir;	// 空なら、ディスクには保存しない
+
+private:
+	boost::mutex mutex;
+	std::map<std::string, boost::shared_ptr<const RuleSet> > ruleSets;
+
+public:
+	RuleCache() {}
+
+	boost::shared_ptr<const RuleSet> load(const std::string& filename, const std::string& axiom_name = "");
+	void clear();
+
+	static std::string hashFile(const std::string& filename);
+	static bool saveBinary(const std::string& filename, const RuleSet& ruleSet);
+	static bool loadBinary(const std::string& filename, RuleSet& ruleSet);
+
+private:
+	RuleCache(const RuleCache&);
+	RuleCache& operator=(const RuleCache&);
+};
+
+void writeInt(std::ostream& out, int value);
+int readInt(std::istream& in);
+void writeString(std::ostream& out, const std::string& str);
+std::string readString(std::istream& in);
+
+}
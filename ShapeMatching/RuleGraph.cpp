@@ -0,0 +1,290 @@
+#include "RuleGraph.h"
+#include <list>
+#include <algorithm>
+#include <ostream>
+#include "Profiler.h"
+
+namespace cga {
+
+namespace {
+
+/**
+ * 式に含まれる識別子のうち、attrであるものを返す。
+ *
+ * @param expression		式
+ * @param ruleSet			ルール
+ * @param attrs [OUT]		参照しているattr
+ */
+void findAttrs(const std::string& expression, const RuleSet& ruleSet, std::set<std::string>& attrs) {
+	std::vector<std::string> names;
+	findIdentifiers(expression, names);
+	for (int i = 0; i < names.size(); ++i) {
+		if (ruleSet.findAttr(names[i]) != NULL) {
+			attrs.insert(names[i]);
+		}
+	}
+}
+
+}
+
+void RuleGraph::clear() {
+	axiom_name.clear();
+	calls.clear();
+	directAttrs.clear();
+	attrDependencies.clear();
+	reachable.clear();
+	cycles.clear();
+}
+
+/**
+ * ルールを解析する。
+ *
+ * @param ruleSet			ルール
+ * @param axiom_name		axiomのshape名
+ */
+void RuleGraph::analyze(const RuleSet& ruleSet, const std::string& axiom_name) {
+	PROFILE_SCOPE("cga", "RuleGraph::analyze");
+
+	clear();
+	this->axiom_name = axiom_name;
+
+	// 上のレイヤから順に、有効なルールを集める
+	std::map<std::string, const Rule*> rules;
+	for (const RuleSet* layer = &ruleSet; layer != NULL; layer = layer->base.get()) {
+		for (auto it = layer->rules.begin(); it != layer->rules.end(); ++it) {
+			if (rules.find(it->first) == rules.end()) {
+				rules[it->first] = &it->second;
+			}
+		}
+	}
+
+	std::vector<std::string> names;
+	std::map<std::string, int> indices;
+	for (auto it = rules.begin(); it != rules.end(); ++it) {
+		indices[it->first] = names.size();
+		names.push_back(it->first);
+	}
+
+	std::vector<std::vector<int> > edges(names.size());
+	for (auto it = rules.begin(); it != rules.end(); ++it) {
+		const Rule& rule = *it->second;
+
+		std::vector<std::string> outputs;
+		std::vector<std::string> expressions;
+		for (int i = 0; i < rule.operators.size(); ++i) {
+			rule.operators[i]->getOutputNames(outputs);
+			rule.operators[i]->getExpressions(expressions);
+		}
+
+		// copyで終わらないルールは、適用後のshapeを"名前!"としてstackに戻す (Rule::apply)
+		if (!rule.operators.empty() && rule.operators.back()->name != "copy") {
+			outputs.push_back(it->first + "!");
+		}
+
+		std::vector<std::string>& callees = calls[it->first];
+		std::vector<int>& out_edges = edges[indices[it->first]];
+		for (int i = 0; i < outputs.size(); ++i) {
+			auto callee = indices.find(outputs[i]);
+			if (callee == indices.end()) continue;	// terminal
+			if (std::find(out_edges.begin(), out_edges.end(), callee->second) != out_edges.end()) continue;
+
+			out_edges.push_back(callee->second);
+			callees.push_back(outputs[i]);
+		}
+
+		std::set<std::string>& attrs = directAttrs[it->first];
+		for (int i = 0; i < expressions.size(); ++i) {
+			findAttrs(expressions[i], ruleSet, attrs);
+		}
+	}
+
+	// axiomから到達できるルール
+	if (indices.find(axiom_name) != indices.end()) {
+		std::list<std::string> queue;
+		queue.push_back(axiom_name);
+		reachable.insert(axiom_name);
+		while (!queue.empty()) {
+			const std::vector<std::string>& callees = calls[queue.front()];
+			queue.pop_front();
+			for (int i = 0; i < callees.size(); ++i) {
+				if (reachable.insert(callees[i]).second) {
+					queue.push_back(callees[i]);
+				}
+			}
+		}
+	}
+
+	findComponents(names, edges);
+}
+
+/**
+ * axiomから到達できないルールを削除する。
+ * ルールが複数のレイヤからなる場合は、1つのレイヤにまとめてから削除する。
+ *
+ * @param ruleSet		analyze()したルール
+ * @return				削除したルールの数
+ */
+int RuleGraph::prune(RuleSet& ruleSet) const {
+	ruleSet.flatten();
+
+	int removed = 0;
+	for (auto it = ruleSet.rules.begin(); it != ruleSet.rules.end(); ) {
+		if (reachable.find(it->first) == reachable.end()) {
+			ruleSet.rules.erase(it++);
+			removed++;
+		} else {
+			++it;
+		}
+	}
+	if (removed > 0) ruleSet.invalidate();
+
+	return removed;
+}
+
+/**
+ * 読み込んだ直後のルールを解析し、axiomから到達できないルールを削除して、再帰しているルールを警告する。
+ * ルールを読み込む箇所 (RuleCache::load()など) で、derivationの前に一度だけ呼び出す。
+ *
+ * @param ruleSet		ルール
+ * @param axiom_name	axiomのshape名
+ * @param source		警告に表示するルールの出所 (ファイル名など)
+ * @param log			警告の出力先
+ * @return				削除したルールの数 (axiomのルールが無ければ0)
+ */
+int RuleGraph::check(RuleSet& ruleSet, const std::string& axiom_name, const std::string& source, std::ostream& log) {
+	analyze(ruleSet, axiom_name);
+
+	// axiomのルールが無い場合は、全て削除してしまわないよう、何もしない
+	if (reachable.empty()) return 0;
+
+	warnCycles(source, log);
+	return prune(ruleSet);
+}
+
+/**
+ * axiomから到達できる、再帰しているルールの組を警告する。
+ *
+ * @param source		警告に表示するルールの出所 (ファイル名など)
+ * @param log			警告の出力先
+ */
+void RuleGraph::warnCycles(const std::string& source, std::ostream& log) const {
+	for (int i = 0; i < cycles.size(); ++i) {
+		if (reachable.find(cycles[i][0]) == reachable.end()) continue;
+
+		log << "Warning: recursive rules in " << source << ":";
+		for (int k = 0; k < cycles[i].size(); ++k) {
+			log << " " << cycles[i][k];
+		}
+		log << std::endl;
+	}
+}
+
+/**
+ * 指定されたルールが、自分自身を (間接的に) 呼び出すか返す。
+ * このようなルールは、splitの繰り返し回数が0になるなどしない限り、derivationが終わらない。
+ */
+bool RuleGraph::isRecursive(const std::string& rule_name) const {
+	for (int i = 0; i < cycles.size(); ++i) {
+		if (std::find(cycles[i].begin(), cycles[i].end(), rule_name) != cycles[i].end()) return true;
+	}
+	return false;
+}
+
+/**
+ * 指定されたルール以下のderivationが、指定されたattrを参照するか返す。
+ */
+bool RuleGraph::dependsOn(const std::string& rule_name, const std::string& attr_name) const {
+	auto it = attrDependencies.find(rule_name);
+	if (it == attrDependencies.end()) return false;
+	return it->second.find(attr_name) != it->second.end();
+}
+
+/**
+ * 強連結成分を求め (Tarjanのアルゴリズム)、再帰しているルールと、attrの依存関係を計算する。
+ * 大きな文法でもスタックが溢れないよう、再帰呼び出しを使わずに実装する。
+ * 強連結成分は、呼び出される側から順に見つかるので、その順に依存関係を伝播させればよい。
+ */
+void RuleGraph::findComponents(const std::vector<std::string>& names, const std::vector<std::vector<int> >& edges) {
+	int n = names.size();
+	std::vector<int> index(n, -1);
+	std::vector<int> lowlink(n, 0);
+	std::vector<int> component(n, -1);
+	std::vector<bool> onStack(n, false);
+	std::vector<int> stack;
+	std::vector<std::pair<int, int> > callStack;
+	int counter = 0;
+	int numComponents = 0;
+
+	for (int s = 0; s < n; ++s) {
+		if (index[s] >= 0) continue;
+
+		index[s] = lowlink[s] = counter++;
+		stack.push_back(s);
+		onStack[s] = true;
+		callStack.push_back(std::make_pair(s, 0));
+
+		while (!callStack.empty()) {
+			int v = callStack.back().first;
+			if (callStack.back().second < edges[v].size()) {
+				int w = edges[v][callStack.back().second++];
+				if (index[w] < 0) {
+					index[w] = lowlink[w] = counter++;
+					stack.push_back(w);
+					onStack[w] = true;
+					callStack.push_back(std::make_pair(w, 0));
+				} else if (onStack[w]) {
+					lowlink[v] = (std::min)(lowlink[v], index[w]);
+				}
+				continue;
+			}
+
+			callStack.pop_back();
+			if (!callStack.empty()) {
+				int u = callStack.back().first;
+				lowlink[u] = (std::min)(lowlink[u], lowlink[v]);
+			}
+			if (lowlink[v] != index[v]) continue;
+
+			// vを根とする強連結成分を取り出す
+			std::vector<int> members;
+			int w;
+			do {
+				w = stack.back();
+				stack.pop_back();
+				onStack[w] = false;
+				component[w] = numComponents;
+				members.push_back(w);
+			} while (w != v);
+
+			std::set<std::string> deps;
+			bool recursive = members.size() > 1;
+			for (int i = 0; i < members.size(); ++i) {
+				int m = members[i];
+				const std::set<std::string>& attrs = directAttrs[names[m]];
+				deps.insert(attrs.begin(), attrs.end());
+				for (int k = 0; k < edges[m].size(); ++k) {
+					int callee = edges[m][k];
+					if (callee == m) recursive = true;
+					if (component[callee] != numComponents) {
+						const std::set<std::string>& callee_deps = attrDependencies[names[callee]];
+						deps.insert(callee_deps.begin(), callee_deps.end());
+					}
+				}
+			}
+
+			std::vector<std::string> member_names;
+			for (int i = 0; i < members.size(); ++i) {
+				attrDependencies[names[members[i]]] = deps;
+				member_names.push_back(names[members[i]]);
+			}
+			if (recursive) {
+				std::reverse(member_names.begin(), member_names.end());
+				cycles.push_back(member_names);
+			}
+
+			numComponents++;
+		}
+	}
+}
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <iosfwd>
+#include "Rule.h"
+
+namespace cga {
+
+/**
+ * ルールの静的解析。
+ * 各オペレーションの出力するshape名から、ルールの呼び出しグラフを作り、
+ * axiomから到達できるルール、再帰しているルール、各ルールが参照するattrを求める。
+ * attrの依存関係は、そのルール以下のderivationで参照する全てのattrなので、
+ * attrを変更した時に、どのルールから下を再derivationすればよいかが分かる。
+ */
+class RuleGraph {
+public:
+	std::string axiom_name;
+	std::map<std::string, std::vector<std::string> > calls;						// ルール -> 呼び出すルール
+	std::map<std::string, std::set<std::string> > directAttrs;				// ルール -> そのルールの式で参照するattr
+	std::map<std::string, std::set<std::string> > attrDependencies;			// ルール -> そのルール以下で参照するattr
+	std::set<std::string> reachable;										// axiomから到達できるルール
+	std::vector<std::vector<std::string> > cycles;							// 互いに呼び出しあうルールの組
+
+public:
+	RuleGraph() {}
+
+	void clear();
+	void analyze(const RuleSet& ruleSet, const std::string& axiom_name);
+	int prune(RuleSet& ruleSet) const;
+	int check(RuleSet& ruleSet, const std::string& axiom_name, const std::string& source, std::ostream& log);
+	void warnCycles(const std::string& source, std::ostream& log) const;
+	bool isRecursive(const std::string& rule_name) const;
+	bool dependsOn(const std::string& rule_name, const std::string& attr_name) const;
+
+private:
+	void findComponents(const std::vector<std::string>& names, const std::vector<std::vector<int> >& edges);
+};
+
+}
@@ -5,205 +5,203 @@
 #include "SplitOperator.h"
 #include "CGA.h"
 #include <iostream>
+#include <sstream>
+#include <QFile>
 
 namespace cga {
 
-void parseRules(const std::string& filename, RuleSet& ruleSet) {
-	ruleSet.clear();
+namespace {
 
-	QFile file(filename.c_str());
+std::string toStdString(const QStringRef& str) {
+	QByteArray utf8 = str.toString().toUtf8();
+	return std::string(utf8.constData(), utf8.size());
+}
 
-	QDomDocument doc;
-	doc.setContent(&file, true);
-	QDomElement root = doc.documentElement();
+/**
+ * 現在の行と列を付けて、エラーを投げる。
+ */
+void raiseError(const QXmlStreamReader& xml, const std::string& message) {
+	std::stringstream ss;
+	ss << xml.lineNumber() << ":" << xml.columnNumber() << ": " << message;
+	throw ss.str();
+}
 
-	QDomNode child_node = root.firstChild();
-	while (!child_node.isNull()) {
-		if (child_node.toElement().tagName() == "attr") {
-			if (!child_node.toElement().hasAttribute("name")) {
-				std::cout << "<attr> tag must contain name attribute." << std::endl;
-				throw "<attr> tag must contain name attribute.";
-			}
-			std::string name = child_node.toElement().attribute("name").toUtf8().constData();
+/**
+ * XMLの構文エラーがあれば、エラーを投げる。
+ */
+void checkError(const QXmlStreamReader& xml) {
+	if (xml.hasError()) {
+		raiseError(xml, xml.errorString().toUtf8().constData());
+	}
+}
 
-			if (!child_node.toElement().hasAttribute("value")) {
-				std::cout << "<attr> tag must contain value attribute." << std::endl;
-				throw "<attr> tag must contain value attribute.";
-			}
-			std::string value = child_node.toElement().attribute("value").toUtf8().constData();
+/**
+ * 現在の要素の、必須の属性の値を返す。
+ */
+std::string requiredAttribute(const QXmlStreamReader& xml, const char* name) {
+	QStringRef value = xml.attributes().value(QLatin1String(name));
+	if (value.isNull()) {
+		raiseError(xml, "<" + toStdString(xml.name()) + "> tag must contain " + name + " attribute.");
+	}
+	return toStdString(value);
+}
 
-			ruleSet.addAttr(name, value);
-		} else if (child_node.toElement().tagName() == "rule") {
-			if (!child_node.toElement().hasAttribute("name")) {
-				std::cout << "<rule> tag must contain name attribute." << std::endl;
-				throw "<rule> tag must contain name attribute.";
-			}
-			std::string name = child_node.toElement().attribute("name").toUtf8().constData();
+}
 
-			ruleSet.addRule(name);
-			parseRuleNode(child_node.toElement(), ruleSet.rules[name]);
-		}
+/**
+ * ルールのXMLファイルを読み込む。
+ * DOMを作らずにQXmlStreamReaderで先頭から順に読み、オペレーションを直接作成する。
+ * エラーの場合は、"ファイル名:行:列: メッセージ"の文字列を投げる。
+ *
+ * @param filename			ファイル名
+ * @param ruleSet [OUT]		ルール
+ */
+void parseRules(const std::string& filename, RuleSet& ruleSet) {
+	ruleSet.clear();
 
-		child_node = child_node.nextSibling();
+	QFile file(QString::fromUtf8(filename.c_str()));
+	if (!file.open(QIODevice::ReadOnly)) {
+		throw "Cannot open " + filename;
 	}
-}
-
-void parseRule(const std::string& filename, std::vector<Rule>& rules) {
-	QFile file(filename.c_str());
 
-	QDomDocument doc;
-	doc.setContent(&file, true);
-	QDomElement root = doc.documentElement();
+	QXmlStreamReader xml(&file);
+	try {
+		parseRules(xml, ruleSet);
+	} catch (const std::string& ex) {
+		std::cout << filename << ":" << ex << std::endl;
+		throw filename + ":" + ex;
+	}
+}
 
-	QDomNode child_node = root.firstChild();
-	while (!child_node.isNull()) {
-		if (child_node.toElement().tagName() == "rule") {
-			Rule rule;
-			parseRuleNode(root, rule);
+/**
+ * ルートの要素の直下にある<attr>と<rule>を読み込む。それ以外の要素は無視する。
+ *
+ * @param xml				XML
+ * @param ruleSet [OUT]		ルール
+ */
+void parseRules(QXmlStreamReader& xml, RuleSet& ruleSet) {
+	if (!xml.readNextStartElement()) {
+		checkError(xml);
+		raiseError(xml, "No root element.");
+	}
 
-			rules.push_back(rule);
+	while (xml.readNextStartElement()) {
+		if (xml.name() == QLatin1String("attr")) {
+			std::string name = requiredAttribute(xml, "name");
+			std::string value = requiredAttribute(xml, "value");
+			ruleSet.addAttr(name, value);
+			xml.skipCurrentElement();
+		} else if (xml.name() == QLatin1String("rule")) {
+			std::string name = requiredAttribute(xml, "name");
+			ruleSet.addRule(name);
+			parseRuleNode(xml, ruleSet.rules[name]);
+		} else {
+			xml.skipCurrentElement();
 		}
-
-		child_node = child_node.nextSibling();
 	}
+
+	checkError(xml);
 }
 
-void parseRuleNode(const QDomElement& rule_node, Rule& rule) {
+/**
+ * <rule>の中のオペレーションを読み込む。</rule>の後まで読み進める。
+ *
+ * @param xml				<rule>を読んだ直後のXML
+ * @param rule [OUT]		ルール
+ */
+void parseRuleNode(QXmlStreamReader& xml, Rule& rule) {
 	rule.operators.clear();
 
-	QDomNode operator_node = rule_node.firstChild();
-	while (!operator_node.isNull()) {
-		std::string operator_name = operator_node.toElement().tagName().toUtf8().constData();
-
-		if (operator_name == "comp") {
-			rule.operators.push_back(parseCompOperator(operator_node));
-		} else if (operator_name == "copy") {
-			rule.operators.push_back(parseCopyOperator(operator_node));
-		} else if (operator_name == "extrude") {
-			rule.operators.push_back(parseExtrudeOperator(operator_node));
-		} else if (operator_name == "split") {
-			rule.operators.push_back(parseSplitOperator(operator_node));
+	while (xml.readNextStartElement()) {
+		if (xml.name() == QLatin1String("comp")) {
+			rule.operators.push_back(parseCompOperator(xml));
+		} else if (xml.name() == QLatin1String("copy")) {
+			rule.operators.push_back(parseCopyOperator(xml));
+		} else if (xml.name() == QLatin1String("extrude")) {
+			rule.operators.push_back(parseExtrudeOperator(xml));
+		} else if (xml.name() == QLatin1String("split")) {
+			rule.operators.push_back(parseSplitOperator(xml));
+		} else {
+			xml.skipCurrentElement();
 		}
-
-		operator_node = operator_node.nextSibling();
 	}
+
+	checkError(xml);
 }
 
-boost::shared_ptr<Operator> parseCompOperator(const QDomNode& node) {
-	std::string front_name;
-	std::string side_name;
-	std::string top_name;
-	std::string bottom_name;
-	std::string inside_name;
-	std::string border_name;
-	std::string vertical_name;
+boost::shared_ptr<Operator> parseCompOperator(QXmlStreamReader& xml) {
+	static const char* face_names[] = { "front", "right", "left", "back", "side", "top", "bottom", "inside", "border", "vertical" };
+
 	std::map<std::string, std::string> name_map;
 
-	QDomNode child = node.firstChild();
-	while (!child.isNull()) {
-		if (child.toElement().tagName() == "param") {
-			QString name = child.toElement().attribute("name");
-			std::string value = child.toElement().attribute("value").toUtf8().constData();
-
-			if (name == "front") {
-				name_map["front"] = value;
-			} else if (name == "right") {
-				name_map["right"] = value;
-			} else if (name == "left") {
-				name_map["left"] = value;
-			} else if (name == "back") {
-				name_map["back"] = value;
-			} else if (name == "side") {
-				name_map["side"] = value;
-			} else if (name == "top") {
-				name_map["top"] = value;
-			} else if (name == "bottom") {
-				name_map["bottom"] = value;
-			} else if (name == "inside") {
-				name_map["inside"] = value;
-			} else if (name == "border") {
-				name_map["border"] = value;
-			} else if (name == "vertical") {
-				name_map["vertical"] = value;
+	while (xml.readNextStartElement()) {
+		if (xml.name() == QLatin1String("param")) {
+			QStringRef name = xml.attributes().value(QLatin1String("name"));
+			for (int i = 0; i < sizeof(face_names) / sizeof(face_names[0]); ++i) {
+				if (name == QLatin1String(face_names[i])) {
+					name_map[face_names[i]] = toStdString(xml.attributes().value(QLatin1String("value")));
+					break;
+				}
 			}
 		}
-
-		child = child.nextSibling();
+		xml.skipCurrentElement();
 	}
 
+	checkError(xml);
+
 	return boost::shared_ptr<Operator>(new CompOperator(name_map));
 }
 
-boost::shared_ptr<Operator> parseCopyOperator(const QDomNode& node) {
-	if (!node.toElement().hasAttribute("name")) {
-		throw "copy node has to have name attribute.";
-	}
-
-	std::string copy_name = node.toElement().attribute("name").toUtf8().constData();
+boost::shared_ptr<Operator> parseCopyOperator(QXmlStreamReader& xml) {
+	std::string copy_name = requiredAttribute(xml, "name");
+	xml.skipCurrentElement();
 
 	return boost::shared_ptr<Operator>(new CopyOperator(copy_name));
 }
 
-boost::shared_ptr<Operator> parseExtrudeOperator(const QDomNode& node) {
-	if (!node.toElement().hasAttribute("height")) {
-		throw "extrude node has to have height attribute.";
-	}
-
-	std::string height = node.toElement().attribute("height").toUtf8().constData();
+boost::shared_ptr<Operator> parseExtrudeOperator(QXmlStreamReader& xml) {
+	std::string height = requiredAttribute(xml, "height");
+	xml.skipCurrentElement();
 
 	return boost::shared_ptr<Operator>(new ExtrudeOperator(height));
 }
 
-boost::shared_ptr<Operator> parseSplitOperator(const QDomNode& node) {
+boost::shared_ptr<Operator> parseSplitOperator(QXmlStreamReader& xml) {
 	int splitAxis;
 	std::vector<Value> sizes;
 	std::vector<std::string> names;
 
-	if (!node.toElement().hasAttribute("splitAxis")) {
-		throw "split node has to have splitAxis attribute.";
-	}
-	if (node.toElement().attribute("splitAxis") == "x") {
+	std::string axis = requiredAttribute(xml, "splitAxis");
+	if (axis == "x") {
 		splitAxis = DIRECTION_X;
-	} else if (node.toElement().attribute("splitAxis") == "y") {
+	} else if (axis == "y") {
 		splitAxis = DIRECTION_Y;
 	} else {
 		splitAxis = DIRECTION_Z;
 	}
 
-	QDomNode child = node.firstChild();
-	while (!child.isNull()) {
-		if (child.toElement().tagName() == "param") {
-			QString type = child.toElement().attribute("type");
-			std::string value = child.toElement().attribute("value").toUtf8().constData();
-			bool repeat = false;
-			if (child.toElement().hasAttribute("repeat")) {
-				repeat = true;
-			}
-
-			if (repeat) {
-				if (type == "absolute") {
-					sizes.push_back(Value(Value::TYPE_ABSOLUTE, value, true));
-				} else if (type == "relative") {
-					sizes.push_back(Value(Value::TYPE_RELATIVE, value, true));
-				} else {
-					sizes.push_back(Value(Value::TYPE_FLOATING, value, true));
-				}
+	while (xml.readNextStartElement()) {
+		if (xml.name() == QLatin1String("param")) {
+			QXmlStreamAttributes attributes = xml.attributes();
+			QStringRef type = attributes.value(QLatin1String("type"));
+			std::string value = toStdString(attributes.value(QLatin1String("value")));
+			bool repeat = attributes.hasAttribute(QLatin1String("repeat"));
+
+			if (type == QLatin1String("absolute")) {
+				sizes.push_back(Value(Value::TYPE_ABSOLUTE, value, repeat));
+			} else if (type == QLatin1String("relative")) {
+				sizes.push_back(Value(Value::TYPE_RELATIVE, value, repeat));
 			} else {
-				if (type == "absolute") {
-					sizes.push_back(Value(Value::TYPE_ABSOLUTE, value));
-				} else if (type == "relative") {
-					sizes.push_back(Value(Value::TYPE_RELATIVE, value));
-				} else {
-					sizes.push_back(Value(Value::TYPE_FLOATING, value));
-				}
+				sizes.push_back(Value(Value::TYPE_FLOATING, value, repeat));
 			}
 
-			names.push_back(child.toElement().attribute("name").toUtf8().constData());
+			names.push_back(toStdString(attributes.value(QLatin1String("name"))));
 		}
-
-		child = child.nextSibling();
+		xml.skipCurrentElement();
 	}
 
+	checkError(xml);
+
 	return boost::shared_ptr<Operator>(new SplitOperator(splitAxis, sizes, names));
 }
 
@@ -2,18 +2,16 @@
 
 #include <map>
 #include "Rule.h"
-#include <QFile>
-#include <QDomDocument>
-#include <QDomNode>
+#include <QXmlStreamReader>
 
 namespace cga {
 
 void parseRules(const std::string& filename, RuleSet& ruleSet);
-//void parseRule(const std::string& filename, std::vector<Rule>& rules);
-void parseRuleNode(const QDomElement& rule_node, Rule& rule);
-boost::shared_ptr<Operator> parseCompOperator(const QDomNode& node);
-boost::shared_ptr<Operator> parseCopyOperator(const QDomNode& node);
-boost::shared_ptr<Operator> parseExtrudeOperator(const QDomNode& node);
-boost::shared_ptr<Operator> parseSplitOperator(const QDomNode& node);
+void parseRules(QXmlStreamReader& xml, RuleSet& ruleSet);
+void parseRuleNode(QXmlStreamReader& xml, Rule& rule);
+boost::shared_ptr<Operator> parseCompOperator(QXmlStreamReader& xml);
+boost::shared_ptr<Operator> parseCopyOperator(QXmlStreamReader& xml);
+boost::shared_ptr<Operator> parseExtrudeOperator(QXmlStreamReader& xml);
+boost::shared_ptr<Operator> parseSplitOperator(QXmlStreamReader& xml);
 
-}
\ No newline at end of file
+}
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <vector>
 #include <QFile>
 #include <QTextStream>
 
@@ -47,6 +48,8 @@ uint Shader::createProgram(const string& vertex_file, const string& fragment_fil
 		throw runtime_error(ss.str());
 	}
 
+	resolveUniforms();
+
 	return program;
 }
 
@@ -86,9 +89,72 @@ uint Shader::createProgram(const string& vertex_file, const string& geometry_fil
 		throw runtime_error(ss.str());
 	}
 
+	resolveUniforms();
+
 	return program;
 }
 
+/**
+ * 指定されたuniform変数のlocationを返却する。
+ * locationはリンク時に取得済みなので、GLの呼び出しは発生しない。
+ *
+ * @param name		uniform変数名
+ * @return			location (存在しない場合は-1)
+ */
+GLint Shader::uniformLocation(const string& name) const {
+	auto it = uniformLocations.find(name);
+	if (it == uniformLocations.end()) return -1;
+	else return it->second;
+}
+
+/**
+ * 指定されたuniform blockのindexを返却する。
+ *
+ * @param name		uniform block名
+ * @return			index (存在しない場合はGL_INVALID_INDEX)
+ */
+GLuint Shader::uniformBlockIndex(const string& name) const {
+	auto it = uniformBlockIndices.find(name);
+	if (it == uniformBlockIndices.end()) return GL_INVALID_INDEX;
+	else return it->second;
+}
+
+/**
+ * リンクしたプログラムの、全てのactiveなuniform変数とuniform blockを取得する。
+ */
+void Shader::resolveUniforms() {
+	uniformLocations.clear();
+	uniformBlockIndices.clear();
+
+	GLint numUniforms;
+	GLint maxLength;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &numUniforms);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::vector<char> name(maxLength + 1);
+	for (int i = 0; i < numUniforms; ++i) {
+		GLint size;
+		GLenum type;
+		glGetActiveUniform(program, i, name.size(), NULL, &size, &type, name.data());
+
+		// 配列の場合は、"name[0]"として返ってくるので、"[0]"を取り除く
+		string uniform_name(name.data());
+		if (uniform_name.size() > 3 && uniform_name.compare(uniform_name.size() - 3, 3, "[0]") == 0) {
+			uniform_name.resize(uniform_name.size() - 3);
+		}
+		uniformLocations[uniform_name] = glGetUniformLocation(program, name.data());
+	}
+
+	GLint numBlocks;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &numBlocks);
+	for (int i = 0; i < numBlocks; ++i) {
+		GLint length;
+		glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_NAME_LENGTH, &length);
+		std::vector<char> block_name(length + 1);
+		glGetActiveUniformBlockName(program, i, block_name.size(), NULL, block_name.data());
+		uniformBlockIndices[block_name.data()] = i;
+	}
+}
+
 /**
  * Load a text from a file.
  *
@@ -170,3 +236,40 @@ GLuint Shader::compileShader(const string& source, GLuint mode) {
 
 	return shader;
 }
+
+ShaderUniforms::ShaderUniforms() {
+	shadowMap = -1;
+	tex0 = -1;
+	atlasTex = -1;
+	textureEnabled = -1;
+	wireframeEnabled = -1;
+	depthComputation = -1;
+	lineRendering = -1;
+	light_mvpMatrices = -1;
+	cascadeSplits = -1;
+	shadowMaps = -1;
+	numCascades = -1;
+	viewportScale = -1;
+	barycentricEdges = -1;
+	frameBlockIndex = GL_INVALID_INDEX;
+}
+
+/**
+ * リンク済みのシェーダから、uniform変数のlocationを取得する。
+ */
+void ShaderUniforms::resolve(const Shader& shader) {
+	shadowMap = shader.uniformLocation("shadowMap");
+	tex0 = shader.uniformLocation("tex0");
+	atlasTex = shader.uniformLocation("atlasTex");
+	textureEnabled = shader.uniformLocation("textureEnabled");
+	wireframeEnabled = shader.uniformLocation("wireframeEnalbed");
+	depthComputation = shader.uniformLocation("depthComputation");
+	lineRendering = shader.uniformLocation("lineRendering");
+	light_mvpMatrices = shader.uniformLocation("light_mvpMatrices");
+	cascadeSplits = shader.uniformLocation("cascadeSplits");
+	shadowMaps = shader.uniformLocation("shadowMaps");
+	numCascades = shader.uniformLocation("numCascades");
+	viewportScale = shader.uniformLocation("viewportScale");
+	barycentricEdges = shader.uniformLocation("barycentricEdges");
+	frameBlockIndex = shader.uniformBlockIndex("FrameUniforms");
+}
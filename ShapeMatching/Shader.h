@@ -1,6 +1,7 @@
 #pragma once
 
 #include <QString>
+#include <map>
 
 class Shader
 {
@@ -9,15 +10,47 @@ public:
 
 	uint createProgram(const std::string& vertex_file, const std::string& fragment_file);
 	uint createProgram(const std::string& vertex_file, const std::string& geometry_file, const std::string& fragment_file);
+	GLint uniformLocation(const std::string& name) const;
+	GLuint uniformBlockIndex(const std::string& name) const;
 
 private:
 	void loadTextFile(const std::string& filename, std::string& str);
 	GLuint compileShader(const std::string& source, GLuint mode);
+	void resolveUniforms();
 
 private:
 	GLuint program;
 	GLuint vertex_shader;
 	GLuint geometry_shader;
 	GLuint fragment_shader;
+	std::map<std::string, GLint> uniformLocations;
+	std::map<std::string, GLuint> uniformBlockIndices;
 };
 
+/**
+ * シェーダのuniform変数のlocation。
+ * プログラムのリンク時に一度だけ解決し、描画毎に文字列で検索しないようにする。
+ */
+class ShaderUniforms {
+public:
+	GLint shadowMap;
+	GLint tex0;
+	GLint atlasTex;
+	GLint textureEnabled;
+	GLint wireframeEnabled;
+	GLint depthComputation;
+	GLint lineRendering;
+	GLint light_mvpMatrices;
+	GLint cascadeSplits;
+	GLint shadowMaps;
+	GLint numCascades;
+	GLint viewportScale;
+	GLint barycentricEdges;
+
+	// フレーム毎の行列と光源をまとめたuniform block (mvpMatrix, mvMatrix, light_mvpMatrix, lightDir)
+	GLuint frameBlockIndex;
+
+public:
+	ShaderUniforms();
+	void resolve(const Shader& shader);
+};
@@ -1,104 +1,269 @@
 ﻿#include "ShadowMapping.h"
 #include "GLWidget3D.h"
+#include "Camera.h"
+#include "Shader.h"
 #include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
 
 #ifndef M_PI
 #define M_PI	3.1415926535
 #endif
 
 ShadowMapping::ShadowMapping() {
+	uniforms = NULL;
+	numCascades = 0;
+	shadowDistance = 300.0f;
+	splitLambda = 0.5f;
+	dirty = true;
 }
 
 /**
  * シャドウマッピングの初期化。
  * 本関数は、GLWidget3D::initializeGL()内で呼び出すこと。
+ * シェーダがlight_mvpMatrices[]を宣言していない場合は、カスケードは1枚だけとし、
+ * light_mvpMatrix/shadowMapを使って描画する。
  *
  * @param programId		シェイダーのprogram id
- * @param width			シャドウマッピングの幅
- * @param height		シャドウマッピングの高さ
+ * @param uniforms		シェイダーのuniform変数のlocation
+ * @param width			1枚のシャドウマップの幅
+ * @param height		1枚のシャドウマップの高さ
+ * @param depthFormat	デプスバッファの形式 (GL_DEPTH_COMPONENT16/24/32)
+ * @param numCascades	カスケードの数 (1～MAX_CASCADES)
  */
-void ShadowMapping::init(int programId, int width, int height) {
+void ShadowMapping::init(int programId, const ShaderUniforms* uniforms, int width, int height, GLenum depthFormat, int numCascades) {
 	this->programId = programId;
+	this->uniforms = uniforms;
 	this->width = width;
 	this->height = height;
-			
-	// FBO作成
-	glGenFramebuffers(1, &fboDepth);
-	glBindFramebuffer(GL_FRAMEBUFFER, fboDepth);
-		
-	// 影のデプスバッファを保存するための2Dテクスチャを作成
-	glGenTextures(1, &textureDepth);
-
-	// GL_TEXTURE6に、このデプスバッファをbindすることで、
-	// シェーダからは6番でアクセスできる
-	glActiveTexture(GL_TEXTURE6);
-	glBindTexture(GL_TEXTURE_2D, textureDepth);
+	this->depthFormat = depthFormat;
 
-	// テクスチャパラメータの設定
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);	// テクスチャの外側、つまり、光源の外側は、影ってことにする(?)
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);	// ただ、そもそも光源の外にならないよう、projection行列を設定すべき！
-		
-    // テクスチャ領域の確保(GL_DEPTH_COMPONENTを用いる)
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+	if (uniforms->light_mvpMatrices < 0) numCascades = 1;
+	this->numCascades = (std::max)(1, (std::min)(numCascades, (int)MAX_CASCADES));
+	dirty = true;
+
+	fboDepths.resize(this->numCascades);
+	textureDepths.resize(this->numCascades);
+	light_mvpMatrices.resize(this->numCascades);
+	last_light_mvpMatrices.resize(this->numCascades);
+	cascadeSplits.resize(this->numCascades);
+
+	std::vector<GLint> units(this->numCascades);
+	for (int i = 0; i < this->numCascades; ++i) {
+		// FBO作成
+		glGenFramebuffers(1, &fboDepths[i]);
+		glBindFramebuffer(GL_FRAMEBUFFER, fboDepths[i]);
+
+		// 影のデプスバッファを保存するための2Dテクスチャを作成
+		// GL_TEXTURE6+iに、このデプスバッファをbindすることで、
+		// シェーダからは6+i番でアクセスできる
+		glGenTextures(1, &textureDepths[i]);
+		allocateDepthTexture(i);
 
-	// 生成した2Dテクスチャを、デプスバッファとしてfboに括り付ける。
-	// 以後、このfboに対するレンダリングを実施すると、デプスバッファのデータは
-	// この2Dテクスチャに自動的に保存される。
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textureDepth, 0);
+		// 生成した2Dテクスチャを、デプスバッファとしてfboに括り付ける。
+		// 以後、このfboに対するレンダリングを実施すると、デプスバッファのデータは
+		// この2Dテクスチャに自動的に保存される。
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textureDepths[i], 0);
+
+		units[i] = FIRST_TEXTURE_UNIT + i;
+	}
 
 	glActiveTexture(GL_TEXTURE0);
-		
-	// シェーダに、GL_TEXTURE6がシャドウマッピング用のデプスバッファであることを伝える
-	glUniform1i(glGetUniformLocation(programId, "shadowMap"), 6);
+
+	// シェーダに、GL_TEXTURE6以降がシャドウマッピング用のデプスバッファであることを伝える
+	glUniform1i(uniforms->shadowMap, FIRST_TEXTURE_UNIT);
+	if (uniforms->shadowMaps >= 0) {
+		glUniform1iv(uniforms->shadowMaps, this->numCascades, &units[0]);
+	}
+	if (uniforms->numCascades >= 0) {
+		glUniform1i(uniforms->numCascades, this->numCascades);
+	}
 
 	glBindFramebuffer(GL_FRAMEBUFFER,0);
 }
 
 /**
- * シャドウマップを作成し、GL_TEXTURE6にテクスチャとして保存する。
+ * シャドウマップの解像度とデプスバッファの形式を変更する。
+ * シャドウマップは、次のupdate()で作り直される。
+ *
+ * @param width			1枚のシャドウマップの幅
+ * @param height		1枚のシャドウマップの高さ
+ * @param depthFormat	デプスバッファの形式 (GL_DEPTH_COMPONENT16/24/32)
+ */
+void ShadowMapping::resize(int width, int height, GLenum depthFormat) {
+	this->width = width;
+	this->height = height;
+	this->depthFormat = depthFormat;
+
+	for (int i = 0; i < numCascades; ++i) {
+		allocateDepthTexture(i);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	dirty = true;
+}
+
+/**
+ * カメラの視錐台に合わせてカスケード毎のシャドウマップを作成し、GL_TEXTURE6以降にテクスチャとして保存する。
+ * 光源行列が前回から変わらず、シーンも変わっていないカスケードは作り直さない。
+ * また、メインの描画用に、カスケードの光源行列と分割距離をシェーダに渡す。
  *
  * @param glWidget3D		GLWidget3Dクラス。このクラスのdrawScene(1)を呼び出してシーンを描画し、シャドウマップを生成する。
  * @param light_dir			光の進行方向
+ * @param camera			カメラ (この視錐台にカスケードを合わせる)
+ * @return					シャドウマップを1枚でも作り直したらtrue
  */
-void ShadowMapping::update(GLWidget3D* glWidget3D, const glm::vec3& light_dir, const glm::mat4& light_mvpMatrix) {
+bool ShadowMapping::update(GLWidget3D* glWidget3D, const glm::vec3& light_dir, const Camera& camera) {
+	computeSplits(0.1f);
+
+	float nearDist = 0.1f;
+	for (int i = 0; i < numCascades; ++i) {
+		light_mvpMatrices[i] = fitCascade(camera, light_dir, nearDist, cascadeSplits[i]);
+		nearDist = cascadeSplits[i];
+	}
+
+	bool updated = false;
 	int origWidth = glWidget3D->width();
 	int origHeigh = glWidget3D->height();
-				
-	// レンダリング結果をFBOに保存するようにする
-	// この結果、デプスバッファはtextureDepthに保存される。
-    glBindFramebuffer(GL_FRAMEBUFFER, fboDepth);
-    glEnable(GL_TEXTURE_2D);
-
-	// ビューポートをシャドウマップの大きさに変更
-	glViewport(0, 0, width, height);
-
-	glEnable(GL_POLYGON_OFFSET_FILL);
-	glPolygonOffset(1.1f, 4.0f);
-
-	// シャドウマップ用のmodel/view/projection行列を設定
-	glUniformMatrix4fv(glGetUniformLocation(programId, "light_mvpMatrix"), 1, GL_FALSE, &light_mvpMatrix[0][0]);
-
-	// 光の方向を設定
-	glUniform3f(glGetUniformLocation(programId, "lightDir"), light_dir.x, light_dir.y, light_dir.z);
-
-	// 色バッファには描画しない
-	glDrawBuffer(GL_NONE);
-
-	// デプスバッファをクリア
-	glClear(GL_DEPTH_BUFFER_BIT);
-	
-	//RENDER
-	glWidget3D->drawScene(1);
-	
-	// この時点で、textureDepthにデプス情報が格納されている
-	
-	glBindFramebuffer(GL_FRAMEBUFFER,0);
-	glDisable(GL_TEXTURE_2D);
-	glDisable(GL_POLYGON_OFFSET_FILL);
-	glDrawBuffer(GL_BACK);
 
-	// ビューポートを戻す
-	glViewport(0, 0, origWidth, origHeigh);
+	for (int i = 0; i < numCascades; ++i) {
+		if (!dirty && light_dir == last_light_dir && light_mvpMatrices[i] == last_light_mvpMatrices[i]) continue;
+
+		if (!updated) {
+			glEnable(GL_TEXTURE_2D);
+
+			// ビューポートをシャドウマップの大きさに変更
+			glViewport(0, 0, width, height);
+
+			glEnable(GL_POLYGON_OFFSET_FILL);
+			glPolygonOffset(1.1f, 4.0f);
+		}
+
+		// レンダリング結果をFBOに保存するようにする
+		// この結果、デプスバッファはtextureDepths[i]に保存される。
+		glBindFramebuffer(GL_FRAMEBUFFER, fboDepths[i]);
+
+		// シャドウマップ用のmodel/view/projection行列と、光の方向を設定
+		glWidget3D->renderManager.setLight(light_dir, light_mvpMatrices[i]);
+
+		// 色バッファには描画しない
+		glDrawBuffer(GL_NONE);
+
+		// デプスバッファをクリア
+		glClear(GL_DEPTH_BUFFER_BIT);
+
+		//RENDER
+		glWidget3D->drawScene(1);
+
+		last_light_mvpMatrices[i] = light_mvpMatrices[i];
+		updated = true;
+	}
+
+	if (updated) {
+		glBindFramebuffer(GL_FRAMEBUFFER,0);
+		glDisable(GL_TEXTURE_2D);
+		glDisable(GL_POLYGON_OFFSET_FILL);
+		glDrawBuffer(GL_BACK);
+
+		// ビューポートを戻す
+		glViewport(0, 0, origWidth, origHeigh);
+	}
+
+	dirty = false;
+	last_light_dir = light_dir;
+
+	// メインの描画用に、カスケードの光源行列と分割距離を渡す
+	// (カスケードに対応していないシェーダは、一番手前のカスケードだけを使う)
+	glWidget3D->renderManager.setLight(light_dir, light_mvpMatrices[0]);
+	if (uniforms->light_mvpMatrices >= 0) {
+		glUniformMatrix4fv(uniforms->light_mvpMatrices, numCascades, GL_FALSE, &light_mvpMatrices[0][0][0]);
+	}
+	if (uniforms->cascadeSplits >= 0) {
+		glUniform1fv(uniforms->cascadeSplits, numCascades, &cascadeSplits[0]);
+	}
+
+	return updated;
+}
+
+/**
+ * カスケードの分割距離を計算する。
+ * 対数分割と均等分割をsplitLambdaで混ぜる (practical split scheme)。
+ *
+ * @param znear			カメラのnear面までの距離
+ */
+void ShadowMapping::computeSplits(float znear) {
+	for (int i = 0; i < numCascades; ++i) {
+		float t = (float)(i + 1) / numCascades;
+		float logSplit = znear * powf(shadowDistance / znear, t);
+		float uniformSplit = znear + (shadowDistance - znear) * t;
+		cascadeSplits[i] = splitLambda * logSplit + (1.0f - splitLambda) * uniformSplit;
+	}
+}
+
+/**
+ * 視錐台の[nearDist, farDist]の区間を囲む、光源のmodel/view/projection行列を返す。
+ * 区間の外接球に合わせるので、カメラが回転してもシャドウマップの大きさは変わらない。
+ * さらに、テクセル単位で位置を丸めることで、カメラの移動による影のちらつきを防ぐ。
+ *
+ * @param camera			カメラ
+ * @param light_dir			光の進行方向
+ * @param nearDist			区間の手前の距離
+ * @param farDist			区間の奥の距離
+ * @return					光源のmodel/view/projection行列
+ */
+glm::mat4 ShadowMapping::fitCascade(const Camera& camera, const glm::vec3& light_dir, float nearDist, float farDist) {
+	// 区間の8頂点をワールド座標系で求める
+	glm::mat4 invMvMatrix = glm::inverse(camera.mvMatrix);
+	glm::vec3 corners[8];
+	float dists[2] = { nearDist, farDist };
+	for (int k = 0; k < 2; ++k) {
+		float h = dists[k] / camera._f;
+		float w = h * camera._aspect;
+		corners[k * 4 + 0] = glm::vec3(invMvMatrix * glm::vec4(-w, -h, -dists[k], 1));
+		corners[k * 4 + 1] = glm::vec3(invMvMatrix * glm::vec4( w, -h, -dists[k], 1));
+		corners[k * 4 + 2] = glm::vec3(invMvMatrix * glm::vec4( w,  h, -dists[k], 1));
+		corners[k * 4 + 3] = glm::vec3(invMvMatrix * glm::vec4(-w,  h, -dists[k], 1));
+	}
+
+	// 外接球
+	glm::vec3 center;
+	for (int k = 0; k < 8; ++k) center += corners[k];
+	center /= 8.0f;
+	float radius = 0.0f;
+	for (int k = 0; k < 8; ++k) {
+		radius = (std::max)(radius, glm::length(corners[k] - center));
+	}
+	radius = ceilf(radius * 16.0f) / 16.0f;
+
+	// 光源のview行列は、向きだけ決めて原点に置く
+	glm::vec3 up = fabs(light_dir.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+	glm::mat4 light_mvMatrix = glm::lookAt(glm::vec3(0, 0, 0), light_dir, up);
+
+	// 中心をテクセル単位に丸める
+	glm::vec3 c = glm::vec3(light_mvMatrix * glm::vec4(center, 1));
+	float texelSize = radius * 2.0f / width;
+	c.x = floorf(c.x / texelSize) * texelSize;
+	c.y = floorf(c.y / texelSize) * texelSize;
+
+	// 区間より光源側にある建物も影を落とすので、手前側に余裕を持たせる
+	float margin = 200.0f;
+	glm::mat4 light_pMatrix = glm::ortho<float>(c.x - radius, c.x + radius, c.y - radius, c.y + radius, -c.z - radius - margin, -c.z + radius);
+
+	return light_pMatrix * light_mvMatrix;
+}
+
+/**
+ * i番目のカスケードのデプステクスチャを確保する。
+ */
+void ShadowMapping::allocateDepthTexture(int cascade) {
+	glActiveTexture(GL_TEXTURE0 + FIRST_TEXTURE_UNIT + cascade);
+	glBindTexture(GL_TEXTURE_2D, textureDepths[cascade]);
+
+	// テクスチャパラメータの設定
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);	// テクスチャの外側、つまり、光源の外側は、影ってことにする(?)
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    // テクスチャ領域の確保(GL_DEPTH_COMPONENTを用いる)
+	glTexImage2D(GL_TEXTURE_2D, 0, depthFormat, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
 }
@@ -3,24 +3,51 @@
 #include <glew.h>
 #include <QGLWidget>
 #include <glm/glm.hpp>
+#include <vector>
 
 class GLWidget3D;
+class Camera;
+class ShaderUniforms;
 
 class ShadowMapping {
 public:
+	static enum { MAX_CASCADES = 4, FIRST_TEXTURE_UNIT = 6 };
+
 	int width;
 	int height;
+	GLenum depthFormat;
 
 	int programId;
+	const ShaderUniforms* uniforms;
+
+	// カスケード毎のFBOとデプステクスチャ (i番目はGL_TEXTURE6+iにbindする)
+	int numCascades;
+	std::vector<uint> fboDepths;
+	std::vector<uint> textureDepths;
+	std::vector<glm::mat4> light_mvpMatrices;
+	std::vector<float> cascadeSplits;
 
-	uint fboDepth;
-	uint textureDepth;
+	// 影を計算するカメラからの最大距離と、対数分割と均等分割の混合比
+	float shadowDistance;
+	float splitLambda;
+
+	// シャドウマップを作り直す必要があるか (シーンか光源が変わった時だけ作り直す)
+	bool dirty;
+	glm::vec3 last_light_dir;
+	std::vector<glm::mat4> last_light_mvpMatrices;
 
 public:
 	ShadowMapping();
 
-	void init(int programId, int width, int height);
-	void update(GLWidget3D* glWidget3D, const glm::vec3& light_dir, const glm::mat4& light_mvpMatrix);
+	void init(int programId, const ShaderUniforms* uniforms, int width, int height, GLenum depthFormat = GL_DEPTH_COMPONENT24, int numCascades = MAX_CASCADES);
+	void resize(int width, int height, GLenum depthFormat);
+	void invalidate() { dirty = true; }
+	bool update(GLWidget3D* glWidget3D, const glm::vec3& light_dir, const Camera& camera);
+
+private:
+	void computeSplits(float znear);
+	glm::mat4 fitCascade(const Camera& camera, const glm::vec3& light_dir, float nearDist, float farDist);
+	void allocateDepthTexture(int cascade);
 };
 
 
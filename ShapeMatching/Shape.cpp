@@ -25,11 +25,21 @@ void Shape::nil() {
 	_removed = true;
 }
 
-void Shape::split(int splitAxis, const std::vector<float>& sizes, const std::vector<std::string>& names, std::vector<boost::shared_ptr<Shape> >& objects) {
+/**
+ * 指定されたサイズの断片に分割する。
+ *
+ * @param splitAxis			分割する方向
+ * @param sizes				各断片のサイズ [num]
+ * @param name_ids			各断片の名前の、namesの中のindex [num]
+ * @param num				断片の数
+ * @param names				断片の名前
+ * @param objects [OUT]		分割後のshape ("NIL"の断片は含まない)
+ */
+void Shape::split(int splitAxis, const float* sizes, const int* name_ids, int num, const std::vector<std::string>& names, std::vector<boost::shared_ptr<Shape> >& objects) {
 	throw "split() is not supported.";
 }
 
-void Shape::render(RenderManager* renderManager, const std::string& name, float opacity, bool showScopeCoordinateSystem) const {
+void Shape::render(GeometrySink* sink, const std::string& name, float opacity, bool showScopeCoordinateSystem) const {
 	throw "render() is not supported.";
 }
 
@@ -41,10 +51,10 @@ void Shape::findRule(const std::vector<Stroke>& strokes, int sketch_step, CGA* c
 	throw "findRule() is not supported.";
 }
 
-void Shape::drawAxes(RenderManager* renderManager, const glm::mat4& modelMat) const {
+void Shape::drawAxes(GeometrySink* sink, const glm::mat4& modelMat) const {
 	std::vector<Vertex> vertices;
 	glutils::drawAxes(0.1, 3, modelMat, vertices);
-	renderManager->addObject("axis", "", vertices);
+	sink->addObject("axis", "", vertices);
 }
 
 }
\ No newline at end of file
@@ -1,2 +1,58 @@
 #include "ShapeFeature.h"
+#include "CVUtils.h"
+#include <limits>
 
+/**
+ * スケッチを、shape featureの画像と比較できる形に変換する。
+ * ぼかして二値化した後、描かれている部分を切り出して縮小する。
+ *
+ * @param sketch		グレースケールのスケッチ画像 (背景は白)
+ * @return				変換後の画像
+ */
+cv::Mat normalizeSketch(const cv::Mat& sketch) {
+	cv::Mat mat;
+
+	// blur the sketch
+	cv::GaussianBlur(sketch, mat, cv::Size(11, 11), 11, 11);
+
+	// conver the sketch to mono color
+	cv::threshold(mat, mat, 253, 255, 0);
+
+	// rectangle
+	cv::Rect roi = cvutils::computeBoundingBoxFromImage(mat);
+	cv::Mat result;
+	mat(roi).copyTo(result);
+
+	cv::resize(result, result, cv::Size(result.cols * 0.2, result.rows * 0.2));
+
+	return result;
+}
+
+/**
+ * スケッチに最も近いshape featureを探す。
+ *
+ * @param sketch			normalizeSketch()で変換したスケッチ
+ * @param features			shape featureのリスト
+ * @param min_diff [OUT]	最も近いshape featureとの差
+ * @return					最も近いshape featureのindex (featuresが空なら-1)
+ */
+int findClosestShapeFeature(const cv::Mat& sketch, const std::vector<ShapeFeature>& features, float& min_diff) {
+	min_diff = (std::numeric_limits<float>::max)();
+	int min_index = -1;
+
+	for (int i = 0; i < features.size(); ++i) {
+		cv::Mat shapeMat2;
+		cv::resize(features[i].image, shapeMat2, sketch.size());
+
+		cv::Mat matDiff;
+		cv::absdiff(shapeMat2, sketch, matDiff);
+		float diff = cvutils::mat_sum(matDiff);// / cvutils::mat_sum(shapeMat2);
+
+		if (diff < min_diff) {
+			min_diff = diff;
+			min_index = i;
+		}
+	}
+
+	return min_index;
+}
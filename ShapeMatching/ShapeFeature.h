@@ -3,6 +3,7 @@
 #include <opencv/cv.h>
 #include <opencv/highgui.h>
 #include <map>
+#include <vector>
 #include <string>
 
 class ShapeFeature {
@@ -18,3 +19,5 @@ public:
 	ShapeFeature(float pitch_angle, float yaw_angle, const cv::Mat& image, const std::string& cga_filename, const std::map<std::string, std::string>& attrs) : pitch_angle(pitch_angle), yaw_angle(yaw_angle), image(image), cga_filename(cga_filename), attrs(attrs) {}
 };
 
+cv::Mat normalizeSketch(const cv::Mat& sketch);
+int findClosestShapeFeature(const cv::Mat& sketch, const std::vector<ShapeFeature>& features, float& min_diff);
\ No newline at end of file
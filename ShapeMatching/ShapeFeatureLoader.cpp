@@ -1,8 +1,11 @@
 #include "ShapeFeatureLoader.h"
 #include <QFile>
 #include <QDomDocument>
+#include "Profiler.h"
 
 void loadShapeFeatures(const std::string& filename, std::vector<ShapeFeature>& features) {
+	PROFILE_SCOPE("matching", "loadShapeFeatures");
+
 	features.clear();
 
 	QFile file(filename.c_str());
@@ -1,9 +1,26 @@
 #include "SplitOperator.h"
 #include "CGA.h"
 #include "Shape.h"
+#include "Profiler.h"
+#include "RuleCache.h"
+#include <boost/thread/tss.hpp>
 
 namespace cga {
 
+namespace {
+
+// 複数のスレッドで同時にderivationするので、作業領域はスレッド毎に持つ
+boost::thread_specific_ptr<DecodedSplits> decodedSplits;
+
+DecodedSplits& getDecodedSplits() {
+	if (decodedSplits.get() == NULL) {
+		decodedSplits.reset(new DecodedSplits());
+	}
+	return *decodedSplits;
+}
+
+}
+
 SplitOperator::SplitOperator(int splitAxis, const std::vector<Value>& sizes, const std::vector<std::string>& output_names) {
 	this->name = "split";
 	this->splitAxis = splitAxis;
@@ -11,20 +28,35 @@ SplitOperator::SplitOperator(int splitAxis, const std::vector<Value>& sizes, con
 	this->output_names = output_names;
 }
 
+/**
+ * このスレッドで、前回の呼び出し以降に断片の数をMAX_REPEATに制限したrepeatの数を返却し、0に戻す。
+ * 制限すると各断片のサイズが指定と変わるので、CGAはderivation毎にこれを確認して警告する。
+ */
+int SplitOperator::takeClampedRepeats() {
+	DecodedSplits& decoded = getDecodedSplits();
+	int clamped = decoded.clampedRepeats;
+	decoded.clampedRepeats = 0;
+	return clamped;
+}
+
 boost::shared_ptr<Shape> SplitOperator::apply(boost::shared_ptr<Shape>& shape, const RuleSet& ruleSet, std::list<boost::shared_ptr<Shape> >& stack) {
+	PROFILE_SCOPE("operator", name);
+
 	std::vector<boost::shared_ptr<Shape> > floors;
 
-	std::vector<float> decoded_sizes;
-	std::vector<std::string> decoded_output_names;
+	DecodedSplits& decoded = getDecodedSplits();
+	decoded.sizes.clear();
+	decoded.names.clear();
+
 	if (splitAxis == DIRECTION_X) {
-		Rule::decodeSplitSizes(shape->_scope.x, sizes, output_names, ruleSet, shape, decoded_sizes, decoded_output_names);
+		Rule::decodeSplitSizes(sizes, ruleSet, &shape, &shape->_scope.x, 1, decoded);
 	} else if (splitAxis == DIRECTION_Y) {
-		Rule::decodeSplitSizes(shape->_scope.y, sizes, output_names, ruleSet, shape, decoded_sizes, decoded_output_names);
+		Rule::decodeSplitSizes(sizes, ruleSet, &shape, &shape->_scope.y, 1, decoded);
 	} else if (splitAxis == DIRECTION_Z) {
-		Rule::decodeSplitSizes(shape->_scope.z, sizes, output_names, ruleSet, shape, decoded_sizes, decoded_output_names);
+		Rule::decodeSplitSizes(sizes, ruleSet, &shape, &shape->_scope.z, 1, decoded);
 	}
 
-	shape->split(splitAxis, decoded_sizes, decoded_output_names, floors);
+	shape->split(splitAxis, decoded.sizes.data(), decoded.names.data(), decoded.sizes.size(), output_names, floors);
 	stack.insert(stack.end(), floors.begin(), floors.end());
 
 	//delete shape;
@@ -32,4 +64,71 @@ boost::shared_ptr<Shape> SplitOperator::apply(boost::shared_ptr<Shape>& shape, c
 	return boost::shared_ptr<Shape>();
 }
 
+/**
+ * 複数のshapeを、まとめてsplitする。
+ * 全てのshapeの断片のサイズを1回で計算してから、各shapeを分割する。
+ */
+void SplitOperator::applyBatch(std::vector<boost::shared_ptr<Shape> >& shapes, const RuleSet& ruleSet, std::list<boost::shared_ptr<Shape> >& stack) {
+	if (splitAxis != DIRECTION_X && splitAxis != DIRECTION_Y && splitAxis != DIRECTION_Z) {
+		Operator::applyBatch(shapes, ruleSet, stack);
+		return;
+	}
+
+	PROFILE_SCOPE("operator", name);
+
+	std::vector<float> extents(shapes.size());
+	for (int i = 0; i < shapes.size(); ++i) {
+		extents[i] = shapes[i]->_scope[splitAxis];
+	}
+
+	DecodedSplits& decoded = getDecodedSplits();
+	Rule::decodeSplitSizes(sizes, ruleSet, shapes.data(), extents.data(), shapes.size(), decoded);
+
+	std::vector<boost::shared_ptr<Shape> > floors;
+	for (int i = 0; i < shapes.size(); ++i) {
+		int first = decoded.offsets[i];
+		shapes[i]->split(splitAxis, decoded.sizes.data() + first, decoded.names.data() + first, decoded.offsets[i + 1] - first, output_names, floors);
+		shapes[i] = boost::shared_ptr<Shape>();
+	}
+	stack.insert(stack.end(), floors.begin(), floors.end());
+}
+
+void SplitOperator::save(std::ostream& out) const {
+	writeInt(out, splitAxis);
+	writeInt(out, sizes.size());
+	for (int i = 0; i < sizes.size(); ++i) {
+		writeInt(out, sizes[i].type);
+		writeString(out, sizes[i].value);
+		writeInt(out, sizes[i].repeat ? 1 : 0);
+		writeString(out, output_names[i]);
+	}
+}
+
+boost::shared_ptr<Operator> SplitOperator::load(std::istream& in) {
+	int splitAxis = readInt(in);
+	std::vector<Value> sizes;
+	std::vector<std::string> output_names;
+
+	int num = readInt(in);
+	for (int i = 0; i < num; ++i) {
+		int type = readInt(in);
+		std::string value = readString(in);
+		bool repeat = readInt(in) != 0;
+		sizes.push_back(Value(type, value, repeat));
+		output_names.push_back(readString(in));
+	}
+
+	return boost::shared_ptr<Operator>(new SplitOperator(splitAxis, sizes, output_names));
+}
+
+void SplitOperator::getOutputNames(std::vector<std::string>& names) const {
+	names.insert(names.end(), output_names.begin(), output_names.end());
+}
+
+void SplitOperator::getExpressions(std::vector<std::string>& expressions) const {
+	for (int i = 0; i < sizes.size(); ++i) {
+		expressions.push_back(sizes[i].value);
+	}
+}
+
 }
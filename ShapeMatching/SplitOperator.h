@@ -13,6 +13,12 @@ private:
 public:
 	SplitOperator(int splitAxis, const std::vector<Value>& sizes, const std::vector<std::string>& output_names);
 	boost::shared_ptr<Shape> apply(boost::shared_ptr<Shape>& shape, const RuleSet& ruleSet, std::list<boost::shared_ptr<Shape> >& stack);
+	void applyBatch(std::vector<boost::shared_ptr<Shape> >& shapes, const RuleSet& ruleSet, std::list<boost::shared_ptr<Shape> >& stack);
+	void save(std::ostream& out) const;
+	void getOutputNames(std::vector<std::string>& names) const;
+	void getExpressions(std::vector<std::string>& expressions) const;
+	static boost::shared_ptr<Operator> load(std::istream& in);
+	static int takeClampedRepeats();
 };
 
 }
@@ -0,0 +1,185 @@
+#include "TextureAtlas.h"
+#include <algorithm>
+
+TextureAtlas::TextureAtlas() {
+	width = 0;
+	height = 0;
+	padding = 0;
+	numLayers = 0;
+	maxLayers = 0;
+	texId = 0;
+	shelfLayer = 0;
+	shelfX = 0;
+	shelfY = 0;
+	shelfHeight = 0;
+	mipmapsOutdated = false;
+}
+
+/**
+ * アトラス用のテクスチャ配列を作成する。
+ * 画素の領域は、最初の画像が追加されるまで確保しない。
+ *
+ * @param width		各ページの幅
+ * @param height	各ページの高さ
+ * @param padding	各画像の間の隙間 [pixel] (mipmapで隣の画像が滲まないようにする)
+ */
+void TextureAtlas::init(int width, int height, int padding) {
+	this->width = width;
+	this->height = height;
+	this->padding = padding;
+	numLayers = 0;
+	shelfLayer = 0;
+	shelfX = 0;
+	shelfY = 0;
+	shelfHeight = 0;
+	mipmapsOutdated = false;
+	regions.clear();
+
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+	glGenTextures(1, &texId);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texId);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// 隙間の幅を超えるmipmapレベルでは、隣の画像が混ざるので使わない
+	int maxLevel = 0;
+	while ((2 << maxLevel) <= padding) maxLevel++;
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, maxLevel);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	// アトラスは、TEXTURE_UNITにbindしたままにする (確保し直してもtexture idは変わらない)
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texId);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+/**
+ * 画像をアトラスに追加する。
+ * 転送するのはレベル0だけなので、まとめて追加した後にupdateMipmaps()を呼ぶこと。
+ *
+ * @param name			画像の名前 (テクスチャファイル名)
+ * @param imageWidth	画像の幅
+ * @param imageHeight	画像の高さ
+ * @param pixels		RGBAの画素 (PBOがbindされている場合は、そのオフセット)
+ * @return				追加できたらtrue (ページより大きい場合や、レイヤの上限に達した場合はfalse)
+ */
+bool TextureAtlas::add(const QString& name, int imageWidth, int imageHeight, const void* pixels) {
+	if (texId == 0) return false;
+	if (regions.contains(name)) return true;
+
+	int w = imageWidth + padding * 2;
+	int h = imageHeight + padding * 2;
+	if (w > width || h > height) return false;
+
+	// 現在の棚に入らなければ、次の棚に移る
+	int layer = shelfLayer;
+	int sx = shelfX;
+	int sy = shelfY;
+	int sh = shelfHeight;
+	if (sx + w > width) {
+		sy += sh;
+		sx = 0;
+		sh = 0;
+	}
+
+	// ページに入らなければ、次のページに移る
+	if (sy + h > height) {
+		layer++;
+		sx = 0;
+		sy = 0;
+		sh = 0;
+	}
+	if (layer >= maxLayers) return false;
+	if (layer >= numLayers) allocateLayers(layer + 1);
+
+	int x = sx + padding;
+	int y = sy + padding;
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texId);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x, y, layer, imageWidth, imageHeight, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	mipmapsOutdated = true;
+
+	regions[name] = AtlasRegion(glm::vec4((float)x / width, (float)y / height, (float)(x + imageWidth) / width, (float)(y + imageHeight) / height), layer);
+
+	shelfLayer = layer;
+	shelfX = sx + w;
+	shelfY = sy;
+	shelfHeight = (std::max)(sh, h);
+
+	return true;
+}
+
+/**
+ * 追加した画像のmipmapを作り直す。
+ * add()毎ではなく、一連の追加の後に1回だけ呼ぶ。
+ */
+void TextureAtlas::updateMipmaps() {
+	if (!mipmapsOutdated) return;
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texId);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	mipmapsOutdated = false;
+}
+
+/**
+ * 元の画像のテクスチャ座標を、アトラス上のテクスチャ座標とレイヤに変換する。
+ * 元のテクスチャ座標は、[0, 1]の範囲であること。
+ */
+void TextureAtlas::remap(const QString& name, Vertex& vertex) const {
+	AtlasRegion region = regions[name];
+	vertex.texCoord = glm::vec2(region.rect.x + (region.rect.z - region.rect.x) * vertex.texCoord.x, region.rect.y + (region.rect.w - region.rect.y) * vertex.texCoord.y);
+	vertex.texLayer = (float)region.layer;
+}
+
+/**
+ * テクスチャ配列のレイヤ数を増やす。
+ * texture idは変えずに確保し直すので、既存のページは一旦別のテクスチャに退避してから書き戻す。
+ * (mipmapは、次のupdateMipmaps()で作り直す)
+ *
+ * @param layers	新しいレイヤ数
+ */
+void TextureAtlas::allocateLayers(int layers) {
+	// 画素の転送中でも、確保はPBOからではなくNULLで行う
+	GLint unpackBuffer;
+	glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &unpackBuffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	GLint readFramebuffer;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+	GLuint fbo;
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+
+	GLuint backup = 0;
+	if (numLayers > 0) {
+		glGenTextures(1, &backup);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, backup);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, numLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		for (int i = 0; i < numLayers; ++i) {
+			glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texId, 0, i);
+			glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, 0, 0, width, height);
+		}
+	}
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texId);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	for (int i = 0; i < numLayers; ++i) {
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, backup, 0, i);
+		glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, 0, 0, width, height);
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+	glDeleteFramebuffers(1, &fbo);
+	if (backup != 0) glDeleteTextures(1, &backup);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuffer);
+
+	numLayers = layers;
+	mipmapsOutdated = true;
+}
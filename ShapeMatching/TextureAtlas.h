@@ -0,0 +1,57 @@
+#pragma once
+
+#include "glew.h"
+#include <QMap>
+#include <QString>
+#include <glm/glm.hpp>
+#include "Vertex.h"
+
+/**
+ * アトラス上の1枚の画像の位置。
+ */
+struct AtlasRegion {
+	glm::vec4 rect;	// テクスチャ座標の範囲 (xmin, ymin, xmax, ymax)
+	int layer;		// テクスチャ配列のレイヤ
+
+	AtlasRegion() : layer(0) {}
+	AtlasRegion(const glm::vec4& rect, int layer) : rect(rect), layer(layer) {}
+};
+
+/**
+ * 複数のテクスチャ画像を、GL_TEXTURE_2D_ARRAYの各レイヤ(ページ)に詰め込んだもの。
+ * 各画像は、ページ内で棚(shelf)単位で左から右へ、下から上へ配置し、ページが一杯になったら次のレイヤに移る。
+ * ページは、画像が追加された時に必要な分だけ確保する。レイヤを増やしても、既存の画像のテクスチャ座標は変わらない。
+ * 同じアトラスを使う面は、テクスチャを切り替えずにまとめて描画できる (レイヤは頂点のtexLayerで指定する)。
+ */
+class TextureAtlas {
+public:
+	static enum { TEXTURE_UNIT = 1 };
+
+public:
+	int width;
+	int height;
+	int padding;
+	int numLayers;
+	int maxLayers;
+	GLuint texId;
+	QMap<QString, AtlasRegion> regions;
+
+private:
+	int shelfLayer;
+	int shelfX;
+	int shelfY;
+	int shelfHeight;
+	bool mipmapsOutdated;
+
+public:
+	TextureAtlas();
+
+	void init(int width, int height, int padding = 8);
+	bool add(const QString& name, int imageWidth, int imageHeight, const void* pixels);
+	void updateMipmaps();
+	bool contains(const QString& name) const { return regions.contains(name); }
+	void remap(const QString& name, Vertex& vertex) const;
+
+private:
+	void allocateLayers(int layers);
+};
@@ -0,0 +1,143 @@
+#include "TextureLoader.h"
+#include <QGLWidget>
+#include <iostream>
+
+TextureLoader::TextureLoader() {
+	stopping = false;
+	pbo = 0;
+}
+
+TextureLoader::~TextureLoader() {
+	stop();
+}
+
+/**
+ * デコード用のスレッドを開始する。
+ * pixel buffer objectを作成するので、GLのコンテキストがcurrentの状態で呼び出すこと。
+ *
+ * @param numThreads	スレッド数
+ */
+void TextureLoader::start(int numThreads) {
+	stopping = false;
+	for (int i = 0; i < numThreads; ++i) {
+		threads.create_thread(boost::bind(&TextureLoader::run, this));
+	}
+
+	if (GLEW_ARB_pixel_buffer_object) {
+		glGenBuffers(1, &pbo);
+	}
+}
+
+/**
+ * デコード用のスレッドを停止する。未処理の要求は破棄される。
+ */
+void TextureLoader::stop() {
+	{
+		boost::lock_guard<boost::mutex> lock(mutex);
+		stopping = true;
+		requests.clear();
+	}
+	condition.notify_all();
+	threads.join_all();
+}
+
+/**
+ * 画像のデコードを要求する。既に要求済みで、まだ取り出されていない場合は何もしない。
+ */
+void TextureLoader::request(const QString& filename) {
+	{
+		boost::lock_guard<boost::mutex> lock(mutex);
+		if (requested.contains(filename)) return;
+
+		requested.insert(filename);
+		requests.push_back(filename);
+	}
+	condition.notify_one();
+}
+
+/**
+ * 要求済みで、まだ取り出されていない画像があるか。
+ */
+bool TextureLoader::hasPending() const {
+	boost::lock_guard<boost::mutex> lock(mutex);
+	return !requested.isEmpty();
+}
+
+/**
+ * デコード済みの画像を1つ取り出す。
+ *
+ * @param decoded [OUT]		デコード済みの画像
+ * @return					取り出せたらtrue
+ */
+bool TextureLoader::popDecoded(DecodedImage& decoded) {
+	boost::lock_guard<boost::mutex> lock(mutex);
+	if (decodedImages.empty()) return false;
+
+	decoded = decodedImages.front();
+	decodedImages.pop_front();
+	requested.remove(decoded.filename);
+
+	return true;
+}
+
+/**
+ * 画像をpixel buffer objectに転送し、GL_PIXEL_UNPACK_BUFFERにbindしたままにする。
+ * 返却されたポインタをglTexImage2D/glTexSubImage2Dに渡し、その後unstage()を呼び出すこと。
+ *
+ * @param image		OpenGLの形式に変換済みの画像
+ * @return			glTexImage2D等に渡すポインタ (PBOが使えない場合は、画像のデータそのもの)
+ */
+const void* TextureLoader::stage(const QImage& image) {
+	if (pbo == 0) return image.bits();
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, image.byteCount(), NULL, GL_STREAM_DRAW);
+	void* ptr = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+	if (ptr == NULL) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return image.bits();
+	}
+	memcpy(ptr, image.bits(), image.byteCount());
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	return 0;
+}
+
+void TextureLoader::unstage() {
+	if (pbo != 0) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+}
+
+/**
+ * デコード用スレッドの本体。
+ */
+void TextureLoader::run() {
+	while (true) {
+		QString filename;
+		{
+			boost::unique_lock<boost::mutex> lock(mutex);
+			while (!stopping && requests.empty()) {
+				condition.wait(lock);
+			}
+			if (stopping) return;
+
+			filename = requests.front();
+			requests.pop_front();
+		}
+
+		DecodedImage decoded;
+		decoded.filename = filename;
+
+		QImage img;
+		if (!img.load(filename)) {
+			std::cout << "ERROR: loading " << filename.toUtf8().constData() << std::endl;
+		} else {
+			decoded.image = QGLWidget::convertToGLFormat(img);
+			decoded.succeeded = !decoded.image.isNull();
+		}
+
+		boost::lock_guard<boost::mutex> lock(mutex);
+		decodedImages.push_back(decoded);
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "glew.h"
+#include <deque>
+#include <QString>
+#include <QImage>
+#include <QSet>
+#include <boost/thread.hpp>
+
+/**
+ * バックグラウンドでデコードされたテクスチャ画像。
+ */
+class DecodedImage {
+public:
+	QString filename;
+	QImage image;
+	bool succeeded;
+
+public:
+	DecodedImage() : succeeded(false) {}
+};
+
+/**
+ * テクスチャ画像の読み込みとデコードを、GLのスレッドとは別のスレッドで行う。
+ * デコード済みの画像は、GLのスレッドでpopDecoded()により取り出し、
+ * stage()でpixel buffer objectに転送してからテクスチャに書き込む。
+ */
+class TextureLoader {
+public:
+	TextureLoader();
+	~TextureLoader();
+
+	void start(int numThreads);
+	void stop();
+	void request(const QString& filename);
+	bool hasPending() const;
+	bool popDecoded(DecodedImage& decoded);
+	const void* stage(const QImage& image);
+	void unstage();
+
+private:
+	void run();
+
+private:
+	boost::thread_group threads;
+	mutable boost::mutex mutex;
+	boost::condition_variable condition;
+	std::deque<QString> requests;
+	std::deque<DecodedImage> decodedImages;
+	QSet<QString> requested;
+	bool stopping;
+	GLuint pbo;
+};
@@ -10,13 +10,16 @@ struct Vertex {
 	glm::vec3 normal;
 	glm::vec4 color;
 	glm::vec2 texCoord;
+	float texLayer;	// layer of the texture array when the texture is in the atlas (set when uploaded)
 	float drawEdge;	// 0 -- exclude / 1 -- draw edge
+	float edgeMask;	// bit k -- the edge opposite to the k-th vertex of the triangle is excluded (computed when uploaded)
 
-	Vertex() {}
+	Vertex() : texLayer(0.0f) {}
 
 	Vertex(const glm::vec3& pos, const glm::vec3& n, float drawEdge = 0.0f) {
 		position = pos;
 		normal = n;
+		texLayer = 0.0f;
 		this->drawEdge = drawEdge;
 	}
 
@@ -24,6 +27,7 @@ struct Vertex {
 		position = pos;
 		normal = n;
 		color = c;
+		texLayer = 0.0f;
 		this->drawEdge = drawEdge;
 	}
 
@@ -32,6 +36,7 @@ struct Vertex {
 		normal = n;
 		color = c;
 		texCoord = tex;
+		texLayer = 0.0f;
 		this->drawEdge = drawEdge;
 	}
 };
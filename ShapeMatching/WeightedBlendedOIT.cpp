@@ -0,0 +1,146 @@
+#include "WeightedBlendedOIT.h"
+#include "TextureAtlas.h"
+
+WeightedBlendedOIT::WeightedBlendedOIT() {
+	width = 0;
+	height = 0;
+	program = 0;
+	compositeProgram = 0;
+	fbo = 0;
+	accumTexture = 0;
+	weightTexture = 0;
+	depthBuffer = 0;
+	emptyVAO = 0;
+}
+
+/**
+ * シェーダとFBOを作成する。
+ * バッファの大きさは、resize()で画面の大きさに合わせること。
+ *
+ * @param vertex_file				累積用のvertexシェーダ
+ * @param geometry_file				累積用のgeometryシェーダ (空なら使わない)
+ * @param fragment_file				累積用のfragmentシェーダ
+ * @param composite_vertex_file		合成用のvertexシェーダ
+ * @param composite_fragment_file	合成用のfragmentシェーダ
+ * @param frameUniformBinding		フレーム毎の行列と光源のUBO (FrameUniformsブロック) のbinding point
+ */
+void WeightedBlendedOIT::init(const std::string& vertex_file, const std::string& geometry_file, const std::string& fragment_file, const std::string& composite_vertex_file, const std::string& composite_fragment_file, GLuint frameUniformBinding) {
+	if (geometry_file.empty()) {
+		program = shader.createProgram(vertex_file, fragment_file);
+	} else {
+		program = shader.createProgram(vertex_file, geometry_file, fragment_file);
+	}
+	uniforms.resolve(shader);
+	glUseProgram(program);
+	glUniform1i(uniforms.tex0, 0);
+	glUniform1i(uniforms.atlasTex, TextureAtlas::TEXTURE_UNIT);
+	glUniform1i(uniforms.barycentricEdges, geometry_file.empty() ? 1 : 0);
+	if (uniforms.frameBlockIndex != GL_INVALID_INDEX) {
+		glUniformBlockBinding(program, uniforms.frameBlockIndex, frameUniformBinding);
+	}
+
+	compositeProgram = compositeShader.createProgram(composite_vertex_file, composite_fragment_file);
+	glUseProgram(compositeProgram);
+	glUniform1i(compositeShader.uniformLocation("accumColorTex"), ACCUM_TEXTURE_UNIT);
+	glUniform1i(compositeShader.uniformLocation("accumWeightTex"), WEIGHT_TEXTURE_UNIT);
+
+	// 合成は、頂点属性なしで画面全体を覆う三角形を描くだけ
+	glGenVertexArrays(1, &emptyVAO);
+
+	glGenFramebuffers(1, &fbo);
+	glGenTextures(1, &accumTexture);
+	glGenTextures(1, &weightTexture);
+	glGenRenderbuffers(1, &depthBuffer);
+
+	resize(1, 1);
+}
+
+/**
+ * 累積バッファを、画面の大きさで確保し直す。
+ */
+void WeightedBlendedOIT::resize(int width, int height) {
+	if (fbo == 0) return;
+
+	this->width = width;
+	this->height = height;
+
+	// 色と重みは、足し込むので浮動小数点のテクスチャにする
+	glActiveTexture(GL_TEXTURE0 + ACCUM_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, accumTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, 0);
+
+	glActiveTexture(GL_TEXTURE0 + WEIGHT_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, weightTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, width, height, 0, GL_RED, GL_FLOAT, 0);
+
+	glActiveTexture(GL_TEXTURE0);
+
+	// 不透明なシーンのデプスをコピーするので、デフォルトのフレームバッファと同じ形式にする
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, weightTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+/**
+ * 半透明の面の累積を開始する。
+ * 不透明なシーンを描画した後に呼び出し、その後、累積用のシェーダで半透明の面を描画すること。
+ * カメラの行列と光源は、RenderManagerと共有するUBOから読む。
+ */
+void WeightedBlendedOIT::begin() {
+	glUseProgram(program);
+
+	// 不透明なシーンに隠れる面を除くため、デプスをコピーする
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+	GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+
+	// 色の和は0、透過率の積は1から始める
+	float clearAccum[] = { 0, 0, 0, 1 };
+	float clearWeight[] = { 0, 0, 0, 0 };
+	glClearBufferfv(GL_COLOR, 0, clearAccum);
+	glClearBufferfv(GL_COLOR, 1, clearWeight);
+
+	// デプステストはするが、デプスは書き込まない
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+
+	// rgbは足し込み、alphaは(1 - alpha)を掛け合わせる
+	glEnable(GL_BLEND);
+	glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+/**
+ * 累積した半透明の面を、不透明なシーンの上に合成する。
+ */
+void WeightedBlendedOIT::end() {
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDrawBuffer(GL_BACK);
+	glDepthMask(GL_TRUE);
+	glDisable(GL_DEPTH_TEST);
+
+	// 結果の色 = 平均の色 * (1 - 透過率) + 背景 * 透過率
+	glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+
+	glUseProgram(compositeProgram);
+	glBindVertexArray(emptyVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+
+	// 描画の設定を元に戻す
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glEnable(GL_DEPTH_TEST);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "glew.h"
+#include <string>
+#include <glm/glm.hpp>
+#include "Shader.h"
+
+/**
+ * Weighted blended order-independent transparency。
+ * 半透明の面を、ソートせずに重み付きで累積バッファに足し込み、最後に不透明なシーンの上に合成する。
+ * 描画順に依存しないので、大きな半透明のshapeでも、CPU側で面をソートする必要がない。
+ */
+class WeightedBlendedOIT {
+public:
+	static enum { ACCUM_TEXTURE_UNIT = 10, WEIGHT_TEXTURE_UNIT = 11 };
+
+	int width;
+	int height;
+
+	// 累積用のシェーダ (vertex/geometryシェーダは不透明な面と共通)
+	GLuint program;
+	Shader shader;
+	ShaderUniforms uniforms;
+
+	// 合成用のシェーダ
+	GLuint compositeProgram;
+	Shader compositeShader;
+
+	GLuint fbo;
+	GLuint accumTexture;
+	GLuint weightTexture;
+	GLuint depthBuffer;
+	GLuint emptyVAO;
+
+public:
+	WeightedBlendedOIT();
+
+	void init(const std::string& vertex_file, const std::string& geometry_file, const std::string& fragment_file, const std::string& composite_vertex_file, const std::string& composite_fragment_file, GLuint frameUniformBinding);
+	void resize(int width, int height);
+	void begin();
+	void end();
+};
+
@@ -0,0 +1,377 @@
+/**
+ * GUIを使わずに、多数の敷地に対してderivationを行い、結果をOBJファイルに書き出すツール。
+ *
+ * 使い方:
+ *   cga_batch --rules FILE --lots FILE [--output DIR] [--format obj|glb] [--threads N]
+ *             [--max-shapes N] [--max-depth N] [--time-limit MS]
+ *
+ * 敷地のリストは、1行目がヘッダのCSVファイルで、以下の列を持つ。
+ *   id			敷地の名前 (出力ファイル名に使う。省略時は行番号)
+ *   width		敷地の幅 (必須)
+ *   depth		敷地の奥行き (必須)
+ *   x, y, z	敷地の中心の位置 (省略時は0)
+ *   rotation	y軸周りの回転角度 [deg] (省略時は0)
+ * これ以外の列は、同じ名前のattrの値を上書きする (空欄なら上書きしない)。
+ *
+ * --outputを省略した場合は、derivationだけを行い、ファイルには書き出さない。
+ * 書き出す場合は、terminalのshapeをderivationしながら1つずつファイルへ流すので、
+ * 敷地の大きさに関わらずメモリの使用量は一定に収まる。
+ *
+ * --max-shapes, --max-depth, --time-limitは、1つの敷地のderivationの上限 (0なら制限しない)。
+ * 上限に達した敷地は、その時点までのshapeを書き出し、警告を表示する。
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <cstdlib>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <QElapsedTimer>
+#include "CGA.h"
+#include "Rectangle.h"
+#include "RuleParser.h"
+#include "RuleGraph.h"
+#include "ObjWriter.h"
+#include "GlbWriter.h"
+
+/**
+ * 1つの敷地。
+ */
+class Lot {
+public:
+	std::string id;
+	float width;
+	float depth;
+	glm::vec3 position;
+	float rotation;
+	std::map<std::string, std::string> attrs;
+
+public:
+	Lot() : width(0), depth(0), rotation(0) {}
+
+	/**
+	 * この敷地をaxiomとするshapeを作成する。
+	 * GLWidget3Dと同様に、y軸を上とし、敷地の中心をpositionに置く。
+	 */
+	boost::shared_ptr<cga::Shape> createAxiom() const {
+		glm::mat4 pivot = glm::translate(glm::mat4(), position);
+		pivot = glm::rotate(pivot, rotation * cga::M_PI / 180.0f, glm::vec3(0, 1, 0));
+		pivot = glm::rotate(pivot, -cga::M_PI * 0.5f, glm::vec3(1, 0, 0));
+		pivot = glm::translate(pivot, glm::vec3(-width * 0.5f, -depth * 0.5f, 0));
+		return boost::shared_ptr<cga::Shape>(new cga::Rectangle("Lot", pivot, glm::mat4(), width, depth, glm::vec3(1, 1, 1)));
+	}
+};
+
+/**
+ * 全スレッドで共有する、ジョブの状態。
+ */
+class BatchJob {
+public:
+	boost::shared_ptr<const cga::RuleSet> ruleSet;
+	std::vector<Lot> lots;
+	std::string output_dir;
+	std::string format;
+	int maxShapes;
+	int maxDepth;
+	int timeLimit;
+
+	boost::mutex mutex;
+	int next;
+	int numFailed;
+	int numTruncated;
+	long long numShapes;
+	long long numTriangles;
+
+public:
+	BatchJob() : maxShapes(0), maxDepth(0), timeLimit(0), next(0), numFailed(0), numTruncated(0), numShapes(0), numTriangles(0) {}
+
+	/**
+	 * 次に処理する敷地のindexを返す。全て処理済みなら-1を返す。
+	 */
+	int take() {
+		boost::mutex::scoped_lock lock(mutex);
+		if (next >= lots.size()) return -1;
+		return next++;
+	}
+};
+
+std::vector<std::string> splitCSVLine(const std::string& line) {
+	std::vector<std::string> fields;
+	std::stringstream ss(line);
+	std::string field;
+	while (std::getline(ss, field, ',')) {
+		// 前後の空白と、WindowsのCRを除く
+		size_t begin = field.find_first_not_of(" \t\r");
+		size_t end = field.find_last_not_of(" \t\r");
+		fields.push_back(begin == std::string::npos ? "" : field.substr(begin, end - begin + 1));
+	}
+	if (!line.empty() && line[line.size() - 1] == ',') fields.push_back("");
+	return fields;
+}
+
+/**
+ * 敷地のリストを読み込む。
+ *
+ * @param filename		CSVファイル
+ * @param lots [OUT]	敷地のリスト
+ */
+void loadLots(const std::string& filename, std::vector<Lot>& lots) {
+	std::ifstream in(filename.c_str());
+	if (!in.is_open()) {
+		throw "Cannot open the lot list: " + filename;
+	}
+
+	std::string line;
+	if (!std::getline(in, line)) {
+		throw "The lot list is empty: " + filename;
+	}
+	std::vector<std::string> header = splitCSVLine(line);
+
+	std::map<std::string, int> columns;
+	for (int i = 0; i < header.size(); ++i) {
+		columns[header[i]] = i;
+	}
+	if (columns.find("width") == columns.end() || columns.find("depth") == columns.end()) {
+		throw std::string("The lot list must have width and depth columns.");
+	}
+
+	int row = 0;
+	while (std::getline(in, line)) {
+		row++;
+		if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+
+		std::vector<std::string> fields = splitCSVLine(line);
+		fields.resize(header.size());
+
+		Lot lot;
+		std::stringstream ss;
+		ss << row;
+		lot.id = ss.str();
+
+		for (int i = 0; i < header.size(); ++i) {
+			const std::string& name = header[i];
+			const std::string& value = fields[i];
+			if (value.empty()) continue;
+
+			if (name == "id") {
+				lot.id = value;
+			} else if (name == "width") {
+				lot.width = atof(value.c_str());
+			} else if (name == "depth") {
+				lot.depth = atof(value.c_str());
+			} else if (name == "x") {
+				lot.position.x = atof(value.c_str());
+			} else if (name == "y") {
+				lot.position.y = atof(value.c_str());
+			} else if (name == "z") {
+				lot.position.z = atof(value.c_str());
+			} else if (name == "rotation") {
+				lot.rotation = atof(value.c_str());
+			} else {
+				lot.attrs[name] = value;
+			}
+		}
+
+		lots.push_back(lot);
+	}
+}
+
+/**
+ * derivationしながら、terminalのshapeをファイルへ書き出す。
+ *
+ * @param cga_system		axiomとルールをセットしたCGA
+ * @param writer			ObjWriterまたはGlbWriter
+ * @param filename			ファイル名
+ * @param numShapes [OUT]	terminalのshapeの数
+ * @param numTriangles [OUT]	三角形の数
+ */
+template<typename Writer>
+void exportLot(cga::CGA& cga_system, Writer& writer, const std::string& filename, long long& numShapes, long long& numTriangles) {
+	if (!writer.open(filename)) {
+		throw "Cannot open " + filename;
+	}
+	numShapes += cga_system.generate(&writer);
+	if (!writer.close()) {
+		throw "Cannot write " + filename;
+	}
+	numTriangles += writer.numTriangles;
+}
+
+/**
+ * ワーカースレッド。
+ * 敷地を1つずつ取り出してderivationし、terminalのshapeをOBJまたはGLBファイルに書き出す。
+ */
+void deriveLots(BatchJob* job) {
+	cga::CGA cga_system;
+	cga_system.maxShapes = job->maxShapes;
+	cga_system.maxDepth = job->maxDepth;
+	cga_system.timeLimit = job->timeLimit;
+	cga::ObjWriter objWriter;
+	cga::GlbWriter glbWriter;
+
+	int numFailed = 0;
+	int numTruncated = 0;
+	long long numShapes = 0;
+	long long numTriangles = 0;
+
+	for (int index = job->take(); index >= 0; index = job->take()) {
+		const Lot& lot = job->lots[index];
+
+		try {
+			// 共通のルールをbaseとし、敷地毎のattrだけを上書きする
+			cga_system.ruleSet.clear();
+			cga_system.ruleSet.base = job->ruleSet;
+			for (auto it = lot.attrs.begin(); it != lot.attrs.end(); ++it) {
+				cga_system.ruleSet.attrs[it->first] = it->second;
+			}
+			cga_system.axiom = lot.createAxiom();
+
+			if (job->output_dir.empty()) {
+				cga_system.generate();
+				numShapes += cga_system.shapes.size();
+			} else {
+				std::string filename = (boost::filesystem::path(job->output_dir) / ("lot_" + lot.id + "." + job->format)).string();
+				if (job->format == "glb") {
+					exportLot(cga_system, glbWriter, filename, numShapes, numTriangles);
+				} else {
+					exportLot(cga_system, objWriter, filename, numShapes, numTriangles);
+				}
+			}
+
+			if (!cga_system.truncationMessage.empty()) {
+				std::cerr << "WARNING: lot " << lot.id << ": " << cga_system.truncationMessage << std::endl;
+				numTruncated++;
+			}
+		} catch (const char* ex) {
+			std::cerr << "ERROR: lot " << lot.id << ": " << ex << std::endl;
+			numFailed++;
+		} catch (const std::string& ex) {
+			std::cerr << "ERROR: lot " << lot.id << ": " << ex << std::endl;
+			numFailed++;
+		}
+	}
+
+	boost::mutex::scoped_lock lock(job->mutex);
+	job->numFailed += numFailed;
+	job->numTruncated += numTruncated;
+	job->numShapes += numShapes;
+	job->numTriangles += numTriangles;
+}
+
+int main(int argc, char *argv[]) {
+	std::string rules_file;
+	std::string lots_file;
+	std::string output_dir;
+	std::string format = "obj";
+	int numThreads = boost::thread::hardware_concurrency();
+	cga::CGA defaults;
+	int maxShapes = defaults.maxShapes;
+	int maxDepth = defaults.maxDepth;
+	int timeLimit = defaults.timeLimit;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (i + 1 >= argc) {
+			std::cerr << "Missing value for " << arg << std::endl;
+			return 1;
+		}
+
+		if (arg == "--rules") {
+			rules_file = argv[++i];
+		} else if (arg == "--lots") {
+			lots_file = argv[++i];
+		} else if (arg == "--output") {
+			output_dir = argv[++i];
+		} else if (arg == "--format") {
+			format = argv[++i];
+		} else if (arg == "--threads") {
+			numThreads = atoi(argv[++i]);
+		} else if (arg == "--max-shapes") {
+			maxShapes = atoi(argv[++i]);
+		} else if (arg == "--max-depth") {
+			maxDepth = atoi(argv[++i]);
+		} else if (arg == "--time-limit") {
+			timeLimit = atoi(argv[++i]);
+		} else {
+			std::cerr << "Unknown option: " << arg << std::endl;
+			return 1;
+		}
+	}
+	if (rules_file.empty() || lots_file.empty()) {
+		std::cerr << "Usage: cga_batch --rules FILE --lots FILE [--output DIR] [--format obj|glb] [--threads N] [--max-shapes N] [--max-depth N] [--time-limit MS]" << std::endl;
+		return 1;
+	}
+	if (format != "obj" && format != "glb") {
+		std::cerr << "Unknown format: " << format << std::endl;
+		return 1;
+	}
+	if (numThreads < 1) numThreads = 1;
+
+	BatchJob job;
+	job.output_dir = output_dir;
+	job.format = format;
+	job.maxShapes = maxShapes;
+	job.maxDepth = maxDepth;
+	job.timeLimit = timeLimit;
+
+	// ルールは一度だけ読み込み、全スレッドで共有する
+	try {
+		boost::shared_ptr<cga::RuleSet> ruleSet(new cga::RuleSet());
+		cga::parseRules(rules_file, *ruleSet);
+
+		// Lotから到達できないルールを除き、終わらない可能性のある再帰を警告する
+		cga::RuleGraph graph;
+		int pruned = graph.check(*ruleSet, "Lot", rules_file, std::cerr);
+		if (graph.reachable.empty()) {
+			throw std::string("The rules have no Lot rule.");
+		}
+		std::cerr << "Rules: " << ruleSet->rules.size() << " reachable from Lot, " << pruned << " unreachable removed" << std::endl;
+
+		// 敷地毎のRuleSetは、このルールをbaseとしてattrだけを上書きするので、式の評価は一度だけ行う
+		ruleSet->compile();
+
+		job.ruleSet = ruleSet;
+		loadLots(lots_file, job.lots);
+		if (!output_dir.empty()) {
+			boost::filesystem::create_directories(output_dir);
+		}
+	} catch (const char* ex) {
+		std::cerr << "ERROR: " << ex << std::endl;
+		return 1;
+	} catch (const std::string& ex) {
+		std::cerr << "ERROR: " << ex << std::endl;
+		return 1;
+	} catch (const boost::filesystem::filesystem_error& ex) {
+		std::cerr << "ERROR: " << ex.what() << std::endl;
+		return 1;
+	}
+
+	std::cerr << "Deriving " << job.lots.size() << " lots with " << numThreads << " threads..." << std::endl;
+
+	QElapsedTimer timer;
+	timer.start();
+
+	boost::thread_group workers;
+	for (int i = 0; i < numThreads; ++i) {
+		workers.create_thread(boost::bind(deriveLots, &job));
+	}
+	workers.join_all();
+
+	double elapsed = timer.nsecsElapsed() * 1.0e-9;
+	int numDerived = job.lots.size() - job.numFailed;
+
+	std::cout << "lots:          " << numDerived << " derived, " << job.numFailed << " failed, " << job.numTruncated << " truncated" << std::endl;
+	std::cout << "shapes:        " << job.numShapes << std::endl;
+	if (!output_dir.empty()) {
+		std::cout << "triangles:     " << job.numTriangles << std::endl;
+	}
+	std::cout << "elapsed:       " << elapsed << " s" << std::endl;
+	std::cout << "throughput:    " << (elapsed > 0.0 ? numDerived / elapsed : 0.0) << " lots/s" << std::endl;
+
+	return job.numFailed > 0 ? 2 : 0;
+}
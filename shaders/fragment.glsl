@@ -11,32 +11,62 @@ noperspective in vec3 dist;
 out vec4 outputF;
 
 // uniform variables
-uniform int textureEnabled;	// 1 -- texture / 0 -- color only
+uniform int textureEnabled;	// 1 -- texture / 2 -- texture atlas / 0 -- color only
 uniform sampler2D tex0;
+uniform sampler2DArray atlasTex;	// pages of the texture atlas (the layer is in texCoord.z)
 uniform int wireframeEnalbed; // 1 -- wireframe / 0 -- no wireframe
+uniform int barycentricEdges; // 1 -- dist is barycentric (no geometry shader) / 0 -- dist is in pixels
 
 //uniform int shadowState;	// 1 -- normal / 2 -- shadow
 uniform int depthComputation;  // 1 -- depth computation / 0 - otherwise
 uniform int lineRendering;     // 1 -- line rendering / 0 - otherwise
-uniform mat4 light_mvpMatrix;
-uniform vec3 lightDir;
 uniform sampler2D shadowMap;
 
-float shadowCoef(){
-	vec4 shadow_coord2 = light_mvpMatrix * vec4(fPosition, 1.0);
+// per-frame matrices and light, shared by all the programs through a uniform buffer
+// (std140, bound to RenderManager::FRAME_UNIFORM_BINDING)
+layout(std140) uniform FrameUniforms {
+	mat4 mvpMatrix;
+	mat4 mvMatrix;
+	mat4 light_mvpMatrix;
+	vec3 lightDir;
+};
+
+// cascaded shadow maps (fitted to the view frustum)
+uniform int numCascades;
+uniform mat4 light_mvpMatrices[4];
+uniform float cascadeSplits[4];	// far distance of each cascade in view space
+uniform sampler2D shadowMaps[4];
+
+float shadowCoef(mat4 light_mvp, sampler2D depthMap){
+	vec4 shadow_coord2 = light_mvp * vec4(fPosition, 1.0);
 	vec3 ProjCoords = shadow_coord2.xyz / shadow_coord2.w;
 	vec2 UVCoords;
 	UVCoords.x = 0.5 * ProjCoords.x + 0.5;
     UVCoords.y = 0.5 * ProjCoords.y + 0.5;
     float z = 0.5 * ProjCoords.z + 0.5;
+
+	// outside the shadow distance
+	if (z > 1.0) return 1.0;
 	
 	float visibility = 1.0f;
-	if (texture2D(shadowMap, UVCoords).z  <  z) {
+	if (texture(depthMap, UVCoords).z  <  z) {
 		visibility = 0;
 	}
 	return visibility;
 }
 
+float shadowCoef(){
+	if (numCascades <= 1) return shadowCoef(light_mvpMatrix, shadowMap);
+
+	// choose the cascade by the view-space depth
+	// (sampler arrays can only be indexed by constants in GLSL 3.30)
+	float depth = -(mvMatrix * vec4(fPosition, 1.0)).z;
+	if (depth < cascadeSplits[0]) return shadowCoef(light_mvpMatrices[0], shadowMaps[0]);
+	if (depth < cascadeSplits[1] || numCascades == 2) return shadowCoef(light_mvpMatrices[1], shadowMaps[1]);
+	if (depth < cascadeSplits[2] || numCascades == 3) return shadowCoef(light_mvpMatrices[2], shadowMaps[2]);
+	return shadowCoef(light_mvpMatrices[3], shadowMaps[3]);
+}
+
 void main()
 {
 	// for color mode
@@ -47,7 +77,9 @@ void main()
 	if (depthComputation == 1) return;
 
 	// determine frag distance to closest edge
-	float nearD = min(min(dist[0],dist[1]),dist[2]);
+	vec3 d = dist;
+	if (barycentricEdges == 1) d = dist / max(fwidth(dist), vec3(1e-6));
+	float nearD = min(min(d[0],d[1]),d[2]);
 	float edgeIntensity = exp2(-1.0*nearD*nearD);
 	
 	if (lineRendering == 1) {
@@ -56,6 +88,8 @@ void main()
 	} else {
 		if (textureEnabled == 1) { // for texture mode
 			outputF = outputF * texture(tex0, fTexCoord.rg);
+		} else if (textureEnabled == 2) {
+			outputF = outputF * texture(atlasTex, fTexCoord);
 		}
 
 		// lighting
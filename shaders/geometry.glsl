@@ -14,13 +14,13 @@ out vec3 fNormal;
 out vec3 fPosition;
 out vec4 fColor;
 out vec3 fTexCoord;
-//uniform vec2 WIN_SCALE;
+uniform vec2 viewportScale;	// half of the viewport size in pixels
 noperspective out vec3 dist;
 
 void main(void)
 {
 	float MEW = 500.0;
-	vec2 WIN_SCALE = vec2(600, 600);
+	vec2 WIN_SCALE = viewportScale;
 
 	// taken from 'Single-Pass Wireframe Rendering'
 	// http://strattonbrazil.blogspot.com/2011/09/single-pass-wireframe-rendering_11.html
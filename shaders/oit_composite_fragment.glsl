@@ -0,0 +1,24 @@
+#version 330
+
+// Weighted blended order-independent transparency: composite pass
+// Blended over the opaque scene with glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA).
+
+// output color
+out vec4 outputF;
+
+// uniform variables
+uniform sampler2D accumColorTex;
+uniform sampler2D accumWeightTex;
+
+void main()
+{
+	ivec2 coord = ivec2(gl_FragCoord.xy);
+	vec4 accum = texelFetch(accumColorTex, coord, 0);
+	float revealage = accum.a;
+
+	// no translucent surface on this pixel
+	if (revealage >= 1.0) discard;
+
+	float weight = texelFetch(accumWeightTex, coord, 0).r;
+	outputF = vec4(accum.rgb / max(weight, 1e-5), revealage);
+}
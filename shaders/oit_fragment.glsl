@@ -0,0 +1,66 @@
+#version 330
+
+// Weighted blended order-independent transparency: accumulation pass
+// (McGuire and Bavoil, "Weighted Blended Order-Independent Transparency", JCGT 2013)
+// Both targets are blended with glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA).
+
+// varying variables
+in vec4 fColor;
+in vec3 fTexCoord;
+in vec3 fNormal;
+in vec3 fPosition;
+noperspective in vec3 dist;
+
+// output
+layout(location = 0) out vec4 accumColor;	// rgb -- sum of premultiplied color * weight / a -- product of (1 - alpha)
+layout(location = 1) out vec4 accumWeight;	// r -- sum of alpha * weight
+
+// uniform variables
+uniform int textureEnabled;	// 1 -- texture / 2 -- texture atlas / 0 -- color only
+uniform sampler2D tex0;
+uniform sampler2DArray atlasTex;	// pages of the texture atlas (the layer is in texCoord.z)
+uniform int wireframeEnalbed; // 1 -- wireframe / 0 -- no wireframe
+uniform int barycentricEdges; // 1 -- dist is barycentric (no geometry shader) / 0 -- dist is in pixels
+
+// per-frame matrices and light, shared by all the programs through a uniform buffer
+// (std140, bound to RenderManager::FRAME_UNIFORM_BINDING)
+layout(std140) uniform FrameUniforms {
+	mat4 mvpMatrix;
+	mat4 mvMatrix;
+	mat4 light_mvpMatrix;
+	vec3 lightDir;
+};
+
+void main()
+{
+	vec4 color = vec4(fColor.xyz, 1);
+	float alpha = fColor.w;
+
+	if (textureEnabled == 1) { // for texture mode
+		color = color * texture(tex0, fTexCoord.rg);
+	} else if (textureEnabled == 2) {
+		color = color * texture(atlasTex, fTexCoord);
+	}
+
+	// lighting (translucent faces do not receive shadows)
+	vec4 ambient = vec4(0.6, 0.6, 0.6, 1.0);
+	vec4 diffuse = vec4(0.8, 0.8, 0.8, 1.0) * max(0.0, dot(-lightDir, fNormal));
+	color = (ambient + diffuse) * color;
+
+	if (wireframeEnalbed == 1) {
+		// determine frag distance to closest edge
+		vec3 d = dist;
+		if (barycentricEdges == 1) d = dist / max(fwidth(dist), vec3(1e-6));
+		float nearD = min(min(d[0],d[1]),d[2]);
+		float edgeIntensity = exp2(-1.0*nearD*nearD);
+		color = edgeIntensity * vec4(0.05, 0.05, 0.05, 1.0) + (1.0 - edgeIntensity) * color;
+		alpha = max(alpha, edgeIntensity);
+	}
+
+	// depth weight (eq. 10 of the paper), so that nearer surfaces dominate
+	float z = gl_FragCoord.z;
+	float weight = clamp(alpha * max(1e-2, 3e3 * pow(1.0 - z, 3.0)), 1e-2, 3e3);
+
+	accumColor = vec4(color.rgb * alpha * weight, alpha);
+	accumWeight = vec4(alpha * weight, 0, 0, 0);
+}
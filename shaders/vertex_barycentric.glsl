@@ -0,0 +1,55 @@
+#version 330
+
+// Vertex shader for the pipeline without the geometry shader.
+// The edge distances for the wireframe are interpolated from barycentric coordinates
+// and converted to pixels in the fragment shader (see barycentricEdges in fragment.glsl).
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec4 color;
+layout(location = 3) in vec3 texCoord;
+layout(location = 4) in float drawEdge;
+layout(location = 5) in float edgeMask;	// bit k -- the edge opposite to the k-th vertex is excluded
+
+// varying variables
+out vec4 fColor;
+out vec3 fTexCoord;
+out vec3 fNormal;
+out vec3 fPosition;
+noperspective out vec3 dist;
+
+// uniform variables
+uniform int depthComputation;  // 1 -- depth computation (from light) / 0 - otherwise
+
+// per-frame matrices and light, shared by all the programs through a uniform buffer
+// (std140, bound to RenderManager::FRAME_UNIFORM_BINDING)
+layout(std140) uniform FrameUniforms {
+	mat4 mvpMatrix;
+	mat4 mvMatrix;
+	mat4 light_mvpMatrix;
+	vec3 lightDir;
+};
+
+void main(){
+	fColor = color;
+	fTexCoord = texCoord;
+	fPosition = position;
+	fNormal = normalize(normal).xyz;
+
+	// barycentric coordinate of this vertex
+	// (triangles are drawn with glDrawArrays, so every triangle starts at a multiple of 3)
+	int k = gl_VertexID % 3;
+	dist = vec3(k == 0, k == 1, k == 2);
+
+	// an excluded edge is never reached, because its coordinate is 1 at all the three vertices
+	int mask = int(edgeMask + 0.5);
+	dist = max(dist, vec3((mask & 1) != 0, (mask & 2) != 0, (mask & 4) != 0));
+
+	// SHADOW: From light
+	if (depthComputation == 1) {
+		gl_Position = light_mvpMatrix * vec4(position, 1.0);
+		return;
+	}
+
+	gl_Position = mvpMatrix * vec4(position, 1.0);
+}